@@ -14,7 +14,7 @@ def mse(a3, target):
 def gradient_check(nn, x, target, eps=1e-5, num_checks=5):
     # Forward + backward once to get analytical grads
     a3, cache = nn.forward(x)
-    grads = nn.backward(cache, target)
+    grads = nn.backward(cache, target, mode='mse')
 
     param_map = {
         "w1": nn.w1,
@@ -104,4 +104,33 @@ def gradient_check(nn, x, target, eps=1e-5, num_checks=5):
 
 
 nn = NeuralNetwork()
-gradient_check(nn, x, target)
\ No newline at end of file
+gradient_check(nn, x, target)
+
+
+def batch_check(nn, steps=50):
+    # Episode-level backward must match the per-step loop it replaces in train.py
+    caches, actions = [], []
+    for _ in range(steps):
+        _, _, cache = nn.sample_action(np.random.randn(12).astype(np.float32))
+        caches.append(cache)
+        actions.append(np.clip(cache['a3'] + nn.sigma * np.random.randn(2), -1, 1))
+    returns = np.random.randn(steps)
+
+    looped = None
+    for t in range(steps):
+        grads = nn.backward(caches[t], G=returns[t], action=actions[t], mode='policy')
+        if looped is None:
+            looped = grads
+        else:
+            for key in grads:
+                looped[key] = looped[key] + grads[key]
+
+    batched = nn.backward_batch(caches, returns, actions)
+
+    print("\n=== Batch Backward Check ===")
+    for key in looped:
+        max_err = np.max(np.abs(looped[key] - batched[key]))
+        print(f"{key} | max_abs_error={max_err:.3e} | {'PASS' if max_err < 1e-4 else 'FAIL'}")
+
+
+batch_check(nn)
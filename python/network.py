@@ -1,15 +1,39 @@
 import numpy as np
 from simulator import Simulator
 
+# Parameter order and shapes of weights.bin and the C Network struct
+LAYOUT = [
+    ('w1', (24, 12)), ('b1', (24,)),
+    ('w2', (16, 24)), ('b2', (16,)),
+    ('w3', (2, 16)), ('b3', (2,)),
+]
+NUM_PARAMS = sum(int(np.prod(shape)) for _, shape in LAYOUT)
+
+
+def layer_views(buffer: np.ndarray) -> dict:
+    # Named views of a flat buffer in LAYOUT order; writes through a view land in the buffer
+    views, offset = {}, 0
+    for name, shape in LAYOUT:
+        size = int(np.prod(shape))
+        views[name] = buffer[offset:offset + size].reshape(shape)
+        offset += size
+    return views
+
+
 class NeuralNetwork:
     def __init__(self):
-        self.w1 = np.random.normal(0, np.sqrt(1 / 12), size=(24, 12)).astype(np.float32)
-        self.w2 = np.random.normal(0, np.sqrt(1 / 24), size=(16, 24)).astype(np.float32)
-        self.w3 = np.random.normal(0, np.sqrt(1 / 16), size=(2, 16)).astype(np.float32)
-
-        self.b1 = np.zeros(24).astype(np.float32)
-        self.b2 = np.zeros(16).astype(np.float32)
-        self.b3 = np.zeros(2).astype(np.float32)
+        # All weights live in one contiguous float32 array (self.params, the weights.bin layout);
+        # w1..b3 are views into it, so an optimizer can step the whole network in one pass.
+        # backward_batch writes into self.grads the same way.
+        self.params = np.zeros(NUM_PARAMS, dtype=np.float32)
+        self.grads = np.zeros(NUM_PARAMS, dtype=np.float32)
+        self.grad_views = layer_views(self.grads)
+        for name, view in layer_views(self.params).items():
+            setattr(self, name, view)
+
+        self.w1[...] = np.random.normal(0, np.sqrt(1 / 12), size=(24, 12))
+        self.w2[...] = np.random.normal(0, np.sqrt(1 / 24), size=(16, 24))
+        self.w3[...] = np.random.normal(0, np.sqrt(1 / 16), size=(2, 16))
 
         self.sigma = 0.5
 
@@ -77,6 +101,30 @@ class NeuralNetwork:
 
         return grads
 
+    def backward_batch(self, caches, returns, actions) -> dict:
+        # Whole-episode policy gradient, summed over timesteps. Rows of each matrix are timesteps.
+        # The result is written into self.grads; the returned dict holds views of it.
+        A0 = np.stack([c['a0'] for c in caches])
+        A1 = np.stack([c['a1'] for c in caches])
+        A2 = np.stack([c['a2'] for c in caches])
+        A3 = np.stack([c['a3'] for c in caches])
+        G = np.asarray(returns)[:, None]
+        actions = np.asarray(actions)
+
+        dZ3 = -G * (actions - A3) / (self.sigma ** 2) * (1 - A3 ** 2)
+        dZ2 = (dZ3 @ self.w3) * (1 - A2 ** 2)
+        dZ1 = (dZ2 @ self.w2) * (1 - A1 ** 2)
+
+        g = self.grad_views
+        np.matmul(dZ1.T, A0, out=g['w1'])
+        np.sum(dZ1, axis=0, out=g['b1'])
+        np.matmul(dZ2.T, A1, out=g['w2'])
+        np.sum(dZ2, axis=0, out=g['b2'])
+        np.matmul(dZ3.T, A2, out=g['w3'])
+        np.sum(dZ3, axis=0, out=g['b3'])
+
+        return g
+
     def sample_action(self, state) -> tuple[np.ndarray, float, dict]:
         mu, cache = self.forward(state)
         noise = np.random.randn(2)
@@ -1,7 +1,84 @@
 import ctypes
 import numpy as np
+from contextlib import contextmanager
 from pathlib import Path
 
+class SimStats(ctypes.Structure):
+    # Mirrors SimStats in simulator/include/sim_stats.h
+    _fields_ = [(name, ctypes.c_uint64) for name in (
+        "steps",
+        "rays", "ray_nodes_visited", "ray_aabb_tests", "ray_segment_tests",
+        "queries", "query_nodes_visited", "query_segment_tests", "query_results",
+        "query_max_results", "query_truncations",
+        "ticks_physics", "ticks_rays", "ticks_collision", "ticks_progress",
+    )]
+
+
+class SimJacobian(ctypes.Structure):
+    # Mirrors SimJacobian in simulator/include/sim_lib.h: rows are outputs, columns the 7 car
+    # state values before the step followed by the two actions
+    _fields_ = [
+        ("car_state", (ctypes.c_float * 9) * 7),
+        ("state", (ctypes.c_float * 9) * 12),
+        ("reward", ctypes.c_float * 9),
+    ]
+
+
+class OptimConfig(ctypes.Structure):
+    # Mirrors OptimConfig in simulator/include/optim.h
+    _fields_ = [
+        ("kind", ctypes.c_int),
+        ("lr", ctypes.c_float),
+        ("beta1", ctypes.c_float),
+        ("beta2", ctypes.c_float),
+        ("epsilon", ctypes.c_float),
+        ("clip", ctypes.c_float),
+        ("weight_decay", ctypes.c_float),
+    ]
+
+
+OPTIM_KINDS = {"sgd": 0, "rmsprop": 1, "adam": 2}
+
+
+class Optimizer:
+    # Native optimizer state for a flat float32 parameter array. step() is one fused C pass per
+    # update (gradient scale and clip, weight decay, moments, parameter step) with no NumPy
+    # temporaries. Create through Simulator.optimizer().
+    def __init__(self, lib, size: int, kind: str, lr: float, **overrides):
+        self.handle = None
+        if kind not in OPTIM_KINDS:
+            raise ValueError(f"Unknown optimizer {kind}, expected one of {list(OPTIM_KINDS)}")
+        self.lib = lib
+        self.size = size
+        self.config = lib.optim_default_config(OPTIM_KINDS[kind], lr)
+        for name, value in overrides.items():
+            if name == "kind" or name not in dict(OptimConfig._fields_):
+                raise ValueError(f"Unknown optimizer setting {name}")
+            setattr(self.config, name, value)
+        self.handle = lib.optim_create(ctypes.byref(self.config), size)
+        if not self.handle:
+            raise ValueError("Failed optimizer creation")
+
+    def step(self, params: np.ndarray, grads: np.ndarray, grad_scale: float = 1.0):
+        # Updates params in place; both must be contiguous float32 arrays of self.size values
+        for array in (params, grads):
+            if array.dtype != np.float32 or not array.flags["C_CONTIGUOUS"] or array.size != self.size:
+                raise ValueError(f"Expected a contiguous float32 array of {self.size} values")
+        self.lib.optim_step(self.handle, params.ctypes.data_as(ctypes.POINTER(ctypes.c_float)),
+                            grads.ctypes.data_as(ctypes.POINTER(ctypes.c_float)), grad_scale)
+
+    def reset(self):
+        self.lib.optim_reset(self.handle)
+
+    def close(self):
+        if self.handle:
+            self.lib.optim_destroy(self.handle)
+            self.handle = None
+
+    def __del__(self):
+        self.close()
+
+
 class Simulator:
     def __init__(self, track: str, x, y, heading):
         sim_path = Path(__file__).parent / ".." / "simulator"
@@ -37,9 +114,90 @@ class Simulator:
         ]
         self.lib.sim_get_state.restype = None
 
+        self.lib.sim_step_with_jacobian.argtypes = [
+            ctypes.c_float,
+            ctypes.c_float,
+            ctypes.POINTER(ctypes.c_float),
+            ctypes.POINTER(ctypes.c_float),
+            ctypes.POINTER(ctypes.c_int),
+            ctypes.POINTER(ctypes.c_int),
+            ctypes.POINTER(SimJacobian),
+        ]
+        self.lib.sim_step_with_jacobian.restype = None
+
+        self.lib.sim_get_car_state.argtypes = [ctypes.POINTER(ctypes.c_float)]
+        self.lib.sim_get_car_state.restype = None
+
+        self.lib.sim_set_car_state.argtypes = [ctypes.POINTER(ctypes.c_float)]
+        self.lib.sim_set_car_state.restype = None
+
+        self.lib.sim_record_start.argtypes = [ctypes.c_char_p]
+        self.lib.sim_record_start.restype = ctypes.c_int
+
+        self.lib.sim_record_stop.argtypes = []
+        self.lib.sim_record_stop.restype = ctypes.c_int
+
+        self.lib.sim_snapshot.argtypes = [ctypes.c_void_p]
+        self.lib.sim_snapshot.restype = None
+
+        self.lib.sim_restore.argtypes = [ctypes.c_void_p]
+        self.lib.sim_restore.restype = ctypes.c_int
+
+        self.lib.sim_snapshot_size.argtypes = []
+        self.lib.sim_snapshot_size.restype = ctypes.c_int
+        self.snapshot_size = self.lib.sim_snapshot_size()
+
+        self.lib.sim_rng_normals.argtypes = [
+            ctypes.c_ulonglong,
+            ctypes.c_uint,
+            ctypes.c_uint,
+            ctypes.c_uint,
+            ctypes.POINTER(ctypes.c_float),
+            ctypes.c_int,
+        ]
+        self.lib.sim_rng_normals.restype = None
+
+        self.lib.sim_get_stats.argtypes = [ctypes.POINTER(SimStats)]
+        self.lib.sim_get_stats.restype = ctypes.c_int
+
+        self.lib.sim_reset_stats.argtypes = []
+        self.lib.sim_reset_stats.restype = None
+
+        self.lib.sim_trace_start.argtypes = [ctypes.c_char_p]
+        self.lib.sim_trace_start.restype = ctypes.c_int
+
+        self.lib.sim_trace_stop.argtypes = []
+        self.lib.sim_trace_stop.restype = ctypes.c_int
+
+        self.lib.sim_trace_begin.argtypes = []
+        self.lib.sim_trace_begin.restype = ctypes.c_ulonglong
+
+        self.lib.sim_trace_end.argtypes = [ctypes.c_char_p, ctypes.c_ulonglong]
+        self.lib.sim_trace_end.restype = None
+
         self.lib.sim_close.argtypes = []
         self.lib.sim_close.restype = None
 
+        self.lib.optim_default_config.argtypes = [ctypes.c_int, ctypes.c_float]
+        self.lib.optim_default_config.restype = OptimConfig
+
+        self.lib.optim_create.argtypes = [ctypes.POINTER(OptimConfig), ctypes.c_int]
+        self.lib.optim_create.restype = ctypes.c_void_p
+
+        self.lib.optim_step.argtypes = [
+            ctypes.c_void_p,
+            ctypes.POINTER(ctypes.c_float),
+            ctypes.POINTER(ctypes.c_float),
+            ctypes.c_float,
+        ]
+        self.lib.optim_step.restype = None
+
+        self.lib.optim_reset.argtypes = [ctypes.c_void_p]
+        self.lib.optim_reset.restype = None
+
+        self.lib.optim_destroy.argtypes = [ctypes.c_void_p]
+        self.lib.optim_destroy.restype = None
+
         output_array = ctypes.c_float * 12
         self.state_out = output_array()
 
@@ -65,5 +223,93 @@ class Simulator:
         success = bool(self.success.value)
         return state, reward, alive, success
 
+    def step_with_jacobian(self, delta_accel, delta_steer) -> tuple[np.ndarray, float, bool, bool, dict]:
+        # step() plus d(outputs)/d(car state before the step, actions): "car_state" (7, 9),
+        # "state" (12, 9) and "reward" (9,). Chain the car_state blocks for multi-step gradients.
+        jac = SimJacobian()
+        self.lib.sim_step_with_jacobian(delta_accel, delta_steer, self.state_out, ctypes.byref(self.reward),
+                                        ctypes.byref(self.alive), ctypes.byref(self.success), ctypes.byref(jac))
+        state = np.ctypeslib.as_array(self.state_out, shape=(12,))
+        jacobian = {
+            "car_state": np.ctypeslib.as_array(jac.car_state).copy(),
+            "state": np.ctypeslib.as_array(jac.state).copy(),
+            "reward": np.ctypeslib.as_array(jac.reward).copy(),
+        }
+        return state, float(self.reward.value), bool(self.alive.value), bool(self.success.value), jacobian
+
+    def car_state(self) -> np.ndarray:
+        # x, y, velocity x, velocity y, acceleration, steering angle, heading
+        out = np.empty(7, dtype=np.float32)
+        self.lib.sim_get_car_state(out.ctypes.data_as(ctypes.POINTER(ctypes.c_float)))
+        return out
+
+    def set_car_state(self, car_state) -> np.ndarray:
+        values = np.ascontiguousarray(car_state, dtype=np.float32)
+        self.lib.sim_set_car_state(values.ctypes.data_as(ctypes.POINTER(ctypes.c_float)))
+        self.lib.sim_get_state(self.state_out)
+        return np.ctypeslib.as_array(self.state_out, shape=(12,))
+
+    def record_start(self, path: str):
+        # Logs every following step to a trajectory file, viewable with ./simulator --replay path
+        if self.lib.sim_record_start(str(path).encode("utf-8")) != 0:
+            raise ValueError(f"Failed to start recording to {path}")
+
+    def record_stop(self):
+        self.lib.sim_record_stop()
+
+    def snapshot(self) -> bytes:
+        # Full mid-episode state; restore() it to branch several rollouts from the same point
+        buf = ctypes.create_string_buffer(self.snapshot_size)
+        self.lib.sim_snapshot(buf)
+        return buf.raw
+
+    def restore(self, snapshot: bytes) -> np.ndarray:
+        buf = ctypes.create_string_buffer(snapshot, self.snapshot_size)
+        if self.lib.sim_restore(buf) != 0:
+            raise ValueError("Invalid simulator snapshot")
+        self.lib.sim_get_state(self.state_out)
+        return np.ctypeslib.as_array(self.state_out, shape=(12,))
+
+    def normals(self, seed: int, episode: int, step: int, car: int = 0, n: int = 2) -> np.ndarray:
+        # Reproducible noise keyed by (seed, episode, step, car), the same the C rollouts draw
+        out = np.empty(n, dtype=np.float32)
+        self.lib.sim_rng_normals(seed, episode, step, car, out.ctypes.data_as(ctypes.POINTER(ctypes.c_float)), n)
+        return out
+
+    def optimizer(self, size: int, kind: str = "adam", lr: float = 3e-4, **overrides) -> Optimizer:
+        # kind: "sgd" (momentum), "rmsprop" or "adam"; overrides set any OptimConfig field, e.g.
+        # clip=1.0 or beta1=0.0 for plain SGD
+        return Optimizer(self.lib, size, kind, lr, **overrides)
+
+    def get_stats(self) -> dict:
+        # Hot-path counters since the last reset_stats(); empty unless the library was built with STATS=1
+        stats = SimStats()
+        if self.lib.sim_get_stats(ctypes.byref(stats)) == 0:
+            return {}
+        return {name: getattr(stats, name) for name, _ in SimStats._fields_}
+
+    def reset_stats(self):
+        self.lib.sim_reset_stats()
+
+    def trace_start(self, path: str):
+        # Chrome trace-event timeline (chrome://tracing, ui.perfetto.dev) of sim steps plus trace() spans
+        if self.lib.sim_trace_start(str(path).encode("utf-8")) != 0:
+            raise ValueError(f"Failed to start trace {path}")
+
+    def trace_stop(self):
+        self.lib.sim_trace_stop()
+
+    @contextmanager
+    def trace(self, name: str):
+        # Span on the timeline around the with block; nearly free while no trace is running.
+        # Each distinct name is kept by the library until exit, so use fixed names (not f"episode {i}")
+        start = self.lib.sim_trace_begin()
+        try:
+            yield
+        finally:
+            if start:
+                self.lib.sim_trace_end(name.encode("utf-8"), start)
+
     def close(self):
+        self.lib.sim_trace_stop()
         self.lib.sim_close()
\ No newline at end of file
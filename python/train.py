@@ -2,6 +2,7 @@ from simulator import Simulator
 from network import NeuralNetwork
 from utils import compute_returns
 import numpy as np
+import os
 
 lr = 3e-4
 gamma = 0.99
@@ -14,6 +15,13 @@ np.random.seed(16)
 
 sim = Simulator("tracks/track_001.txt", x=12.5, y=16.1, heading=0.0)
 nn = NeuralNetwork()
+# Plain SGD on gradients clipped to [-1, 1], as one fused C pass over nn.params. Other choices:
+# kind="sgd" with momentum (beta1), "rmsprop" or "adam" (see Simulator.optimizer)
+optimizer = sim.optimizer(nn.params.size, kind="sgd", lr=lr, beta1=0.0, clip=1.0)
+
+# TRACE=train.json python train.py records a timeline of sim steps, rollouts and updates
+if os.environ.get("TRACE"):
+    sim.trace_start(os.environ["TRACE"])
 
 best_avg = -np.inf
 best_weights = None
@@ -23,13 +31,14 @@ for episode in range(num_episodes):
     state = sim.reset()
     trajectory = []
 
-    while True:
-        action, logp, cache = nn.sample_action(state)
-        next_state, reward, alive, success = sim.step(action[0], action[1])
-        trajectory.append((logp, reward, action, cache))
-        state = next_state
-        if not alive or success:
-            break
+    with sim.trace("rollout"):
+        while True:
+            action, logp, cache = nn.sample_action(state)
+            next_state, reward, alive, success = sim.step(action[0], action[1])
+            trajectory.append((logp, reward, action, cache))
+            state = next_state
+            if not alive or success:
+                break
 
     rewards = [r for _, r, _, _ in trajectory]
     if success:
@@ -40,19 +49,13 @@ for episode in range(num_episodes):
     if std > 1e-8:
         returns = (returns - mean) / std
 
-    total_grads = None
-    for t, (logp, reward, action, cache) in enumerate(trajectory):
-        grads = nn.backward(cache, G=returns[t], action=action, mode='policy')
-        if total_grads is None:
-            total_grads = grads
-        else:
-            for key in grads:
-                total_grads[key] += grads[key]
-
-    for key in total_grads:
-        total_grads[key] = np.clip(total_grads[key], -1.0, 1.0)
+    caches = [cache for _, _, _, cache in trajectory]
+    actions = [action for _, _, action, _ in trajectory]
+    with sim.trace("backward"):
+        nn.backward_batch(caches, returns[:len(trajectory)], actions)  # Fills nn.grads
 
-    nn.update(total_grads, lr)
+    with sim.trace("update"):
+        optimizer.step(nn.params, nn.grads)
 
     total_reward = sum(rewards)
     recent_rewards.append(total_reward)
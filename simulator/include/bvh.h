@@ -0,0 +1,50 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <stdint.h>
+#include "types.h"
+#include "track_internals.h"
+#include "quad_tree.h"
+#include "ray_cast.h"
+
+// Bounding volume hierarchy over the boundary segments, an alternative to the quad tree.
+//
+// Built top-down as a binary tree, splitting each node where the surface area heuristic (here:
+// bounding box perimeter, the 2D analogue) says rays and queries will do the least work, then
+// collapsed into 4-wide nodes. Every segment is stored exactly once, in one leaf. Each node keeps
+// its four child boxes as separate x/y arrays, so one node visit tests all four lanes with
+// straight-line code the compiler vectorizes.
+
+#define BVH_WIDTH         4
+#define BVH_MAX_LEAF_SIZE 8  // Leaves never hold more, whatever the heuristic says
+#define BVH_SAH_BINS      16 // Candidate split positions per node and axis
+#define BVH_STACK_SIZE    256 // Traversal stack: covers trees up to 85 levels of 4-wide nodes
+
+typedef struct {
+    float min_x[BVH_WIDTH];
+    float min_y[BVH_WIDTH];
+    float max_x[BVH_WIDTH];
+    float max_y[BVH_WIDTH];
+    int32_t child[BVH_WIDTH];         // Node index of an inner lane, -1 for leaf and empty lanes
+    int32_t first_segment[BVH_WIDTH]; // Leaf lanes: range in Bvh.segments
+    int32_t segment_count[BVH_WIDTH]; // 0 for inner and empty lanes (empty lanes have a box at FLT_MAX)
+} BvhNode;
+
+typedef struct {
+    BvhNode* nodes; // nodes[0] is the root
+    int node_count;
+    struct BoundarySegment* segments; // In leaf order
+    int segment_count;
+    Bounds bounds;
+    int depth; // Levels of BvhNodes; traversal keeps at most (BVH_WIDTH - 1) * depth + 1 on its stack
+} Bvh;
+
+// NULL (with a message) if the tree is too deep for BVH_STACK_SIZE
+Bvh* build_track_bvh(const Track* track);
+void free_bvh(Bvh* bvh);
+
+// Same results as cast_ray and query_region on a quad tree of the same track
+RayHit bvh_cast_ray(const Bvh* bvh, Point origin, float direction, float max_distance);
+void bvh_query_region(const Bvh* bvh, Bounds* region, struct BoundarySegment* results, int* count, int max_results);
+
+#endif
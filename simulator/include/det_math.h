@@ -0,0 +1,27 @@
+#ifndef DET_MATH_H
+#define DET_MATH_H
+
+#include <math.h>
+
+// Trig and remainder used by the sim step. libm's results depend on the libc version and on
+// whether the compiler vectorized the call, so two machines (or a scalar and a batched run) can
+// drift apart. det_* are built from +, -, *, conversions and (in det_fmodf) correctly rounded
+// IEEE division and power-of-two scaling, so they give the same bits on every IEEE-754 platform
+// as long as the compiler does not fuse them (-ffp-contract=off).
+// Building with DETERMINISTIC=1 defines SIM_DETERMINISTIC and routes the sim through them.
+
+float det_sinf(float x); // Accurate to ~1 ulp for |x| < 1e5
+float det_cosf(float x);
+float det_fmodf(float x, float y); // Same result as fmodf for finite x and y != 0, at any x / y
+
+#ifdef SIM_DETERMINISTIC
+#define sim_sinf det_sinf
+#define sim_cosf det_cosf
+#define sim_fmodf det_fmodf
+#else
+#define sim_sinf sinf
+#define sim_cosf cosf
+#define sim_fmodf fmodf
+#endif
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef DUAL_H
+#define DUAL_H
+
+#include "det_math.h"
+
+// Forward-mode automatic differentiation: a value plus its derivatives with respect to
+// DUAL_WIDTH inputs. Seed each input with dual_var, run the same arithmetic on Duals, and the
+// derivatives come out exact (up to rounding) with no finite-difference step to tune.
+// Used by update_car_physics_dual; DUAL_WIDTH matches SIM_JAC_INPUTS in sim_lib.h.
+
+#define DUAL_WIDTH 9
+
+typedef struct {
+    float v;
+    float d[DUAL_WIDTH];
+} Dual;
+
+static inline Dual dual_const(float v) {
+    Dual r = {.v = v};
+    return r;
+}
+
+static inline Dual dual_var(float v, int input) {
+    Dual r = {.v = v};
+    r.d[input] = 1.0f;
+    return r;
+}
+
+static inline Dual dual_add(Dual a, Dual b) {
+    Dual r = {.v = a.v + b.v};
+    for (int i = 0; i < DUAL_WIDTH; i++) r.d[i] = a.d[i] + b.d[i];
+    return r;
+}
+
+static inline Dual dual_sub(Dual a, Dual b) {
+    Dual r = {.v = a.v - b.v};
+    for (int i = 0; i < DUAL_WIDTH; i++) r.d[i] = a.d[i] - b.d[i];
+    return r;
+}
+
+static inline Dual dual_mul(Dual a, Dual b) {
+    Dual r = {.v = a.v * b.v};
+    for (int i = 0; i < DUAL_WIDTH; i++) r.d[i] = a.d[i] * b.v + a.v * b.d[i];
+    return r;
+}
+
+static inline Dual dual_scale(Dual a, float k) {
+    Dual r = {.v = a.v * k};
+    for (int i = 0; i < DUAL_WIDTH; i++) r.d[i] = a.d[i] * k;
+    return r;
+}
+
+static inline Dual dual_sin(Dual a) {
+    Dual r = {.v = sim_sinf(a.v)};
+    float c = sim_cosf(a.v);
+    for (int i = 0; i < DUAL_WIDTH; i++) r.d[i] = a.d[i] * c;
+    return r;
+}
+
+static inline Dual dual_cos(Dual a) {
+    Dual r = {.v = sim_cosf(a.v)};
+    float s = -sim_sinf(a.v);
+    for (int i = 0; i < DUAL_WIDTH; i++) r.d[i] = a.d[i] * s;
+    return r;
+}
+
+// Same branches as clamp() in physics.c; a clamped value is constant, so its derivatives are 0
+static inline Dual dual_clamp(Dual x, float min, float max) {
+    if (x.v > max) return dual_const(max);
+    if (x.v < min) return dual_const(min);
+    return x;
+}
+
+#endif
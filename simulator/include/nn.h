@@ -1,5 +1,6 @@
 #ifndef NN_H
 #define NN_H
+#include <stdint.h>
 
 #define NN_INPUT  12
 #define NN_H1     24
@@ -12,7 +13,41 @@ typedef struct {
     float w3[NN_OUTPUT][NN_H2]; float b3[NN_OUTPUT];
 } Network;
 
+// Activations of a whole episode, one row per timestep (row-major)
+typedef struct {
+    int count;
+    float* a0; // [count][NN_INPUT]
+    float* a1; // [count][NN_H1]
+    float* a2; // [count][NN_H2]
+    float* a3; // [count][NN_OUTPUT]
+} NNBatchCache;
+
+// Critic for actor-critic training (train_ppo): a linear value estimate read off the policy's
+// second hidden layer. Kept out of Network so weights files stay the policy-only layout.
+typedef struct {
+    float w[NN_H2];
+    float b;
+} ValueHead;
+
 int  nn_load(Network* nn, const char* path);
+int  nn_save(const Network* nn, const char* path);
+// Fan-in scaled normal weights and zero biases, drawn from Philox so a seed gives the same
+// network on every platform (train_es, train_ppo)
+void nn_init_random(Network* nn, uint64_t seed);
 void nn_forward(Network* nn, float* input, float* output);
 
-#endif
\ No newline at end of file
+void nn_batch_cache_init(NNBatchCache* cache, int capacity);
+void nn_batch_cache_free(NNBatchCache* cache);
+void nn_forward_cached(Network* nn, float* input, NNBatchCache* cache, int row, float* output);
+void nn_policy_output_grad(const NNBatchCache* cache, const float* actions, const float* returns, float sigma, float* dL_da3);
+void nn_backward_batch(Network* nn, const NNBatchCache* cache, const float* dL_da3, Network* grads);
+
+// Policy output and value from one pass through the shared hidden layers
+void nn_forward_value(Network* nn, const ValueHead* head, float* input, float* output, float* value_out);
+void nn_forward_value_cached(Network* nn, const ValueHead* head, float* input, NNBatchCache* cache, int row, float* output, float* value_out);
+// nn_backward_batch plus the value head: dL_dv holds one value gradient per row, and the hidden
+// layers receive the sum of both heads' gradients
+void nn_backward_value_batch(Network* nn, const ValueHead* head, const NNBatchCache* cache, const float* dL_da3, const float* dL_dv,
+                             Network* grads, ValueHead* head_grads);
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef OPTIM_H
+#define OPTIM_H
+
+// First-order optimizers over one flat float buffer (e.g. a Network cast to float*). Each
+// optim_step is a single pass: for every parameter it scales and clips the gradient, adds weight
+// decay, updates the moments and moves the parameter, with no temporaries. Minimizes; pass a
+// negative grad_scale to climb instead.
+
+typedef enum {
+    OPTIM_SGD = 0,     // Heavy-ball momentum (momentum 0: plain SGD, no moment buffer used)
+    OPTIM_RMSPROP = 1,
+    OPTIM_ADAM = 2,
+} OptimKind;
+
+typedef struct {
+    int kind;           // OptimKind
+    float lr;
+    float beta1;        // SGD momentum, Adam first-moment decay
+    float beta2;        // RMSProp and Adam second-moment decay
+    float epsilon;
+    float clip;         // Elementwise gradient clip to [-clip, clip] after scaling; 0 = off
+    float weight_decay; // L2: weight_decay * param is added to the clipped gradient
+} OptimConfig;
+
+typedef struct {
+    OptimConfig config;
+    int n;
+    int steps;
+    float* m; // First moment / velocity
+    float* v; // Second moment
+} Optimizer;
+
+// lr plus the usual defaults for kind: momentum 0.9; RMSProp decay 0.99; Adam 0.9 / 0.999;
+// epsilon 1e-8; no clipping or weight decay
+OptimConfig optim_default_config(int kind, float lr);
+
+Optimizer* optim_create(const OptimConfig* config, int n); // NULL on an unknown kind or n < 1
+void       optim_step(Optimizer* opt, float* params, const float* grads, float grad_scale);
+void       optim_reset(Optimizer* opt); // Zeroes the moments and the step count
+void       optim_destroy(Optimizer* opt);
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef PHILOX_H
+#define PHILOX_H
+
+#include <stdint.h>
+
+// Counter-based RNG (Philox4x32-10, Salmon et al. 2011). There is no generator state: every
+// draw is a pure function of (seed, episode, step, car), so a rollout gets the same noise
+// whichever thread or process runs it and in whatever order, and snapshots need not save it.
+
+void philox4x32(const uint32_t counter[4], uint64_t key, uint32_t out[4]);
+
+// n standard normals for one car at one step
+void philox_normals(uint64_t seed, uint32_t episode, uint32_t step, uint32_t car, float* out, int n);
+
+// n normals for each of cars first_car .. first_car + num_cars - 1, car-major in out[num_cars * n];
+// the same values as philox_normals per car, generated several cars at a time
+void philox_normals_batch(uint64_t seed, uint32_t episode, uint32_t step, uint32_t first_car, int num_cars, int n, float* out);
+
+#endif
@@ -2,7 +2,22 @@
 #define PHYSICS_H
 
 #include "car.h"
+#include "dual.h"
 
 void update_car_physics(Car *car, float acceleration, float steering_angle, const float dt);
 
-#endif
\ No newline at end of file
+// The differentiable part of a Car, as Duals
+typedef struct {
+    Dual x, y;
+    Dual velocity_x, velocity_y;
+    Dual speed;
+    Dual acceleration;
+    Dual steering_angle;
+    Dual heading;
+} CarDual;
+
+// update_car_physics in forward mode: same arithmetic and branches, carrying derivatives along.
+// Clamps that bind zero the derivatives through them. Does nothing when the car is not alive.
+void update_car_physics_dual(const Car *car, CarDual *state, Dual acceleration, Dual steering_angle, const float dt);
+
+#endif
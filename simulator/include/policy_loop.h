@@ -0,0 +1,21 @@
+#ifndef POLICY_LOOP_H
+#define POLICY_LOOP_H
+
+#include "car_internals.h"
+#include "track_internals.h"
+#include "quad_tree.h"
+#include "nn.h"
+
+typedef enum {
+    POLICY_RUNNING,
+    POLICY_CRASHED,
+    POLICY_FINISHED
+} PolicyStatus;
+
+void policy_cast_rays(Car* car, QuadTreeNode* tree);
+void policy_get_state(const Car* car, float* state);
+PolicyStatus policy_step(Network* nn, Car* car, const Track* track, QuadTreeNode* tree, float dt);
+// noise[NN_OUTPUT] is added to the network output before clipping to [-1, 1], as when sampling in training
+PolicyStatus policy_step_noisy(Network* nn, Car* car, const Track* track, QuadTreeNode* tree, float dt, const float* noise);
+
+#endif
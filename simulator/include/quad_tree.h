@@ -3,6 +3,7 @@
 
 #include "types.h"
 #include "track_internals.h"
+#include "segment_block.h"
 
 typedef struct {
     float min_x;
@@ -15,9 +16,29 @@ typedef struct QuadTreeNode {
     Bounds bounds;
     struct BoundarySegment* segments;
     int segment_count;
+    SegmentBlock* blocks; // The leaf's segments again, packed for the ray kernel
+    int block_count;
     struct QuadTreeNode *children[4];
 } QuadTreeNode;
 
+// Build limits: a node becomes a leaf once it holds at most max_segments_per_node segments or
+// sits max_depth levels down. The best values depend on the track (see quad_tree_tune.h).
+typedef struct {
+    int max_depth;
+    int max_segments_per_node;
+} QuadTreeParams;
+
+// Shape of a built tree. Segments crossing a split are copied into every child they cross;
+// duplicates counts those extra copies.
+typedef struct {
+    int nodes;
+    int leaves;
+    int leaf_segments;      // Sum of segment_count over leaves
+    int max_leaf_segments;
+    float mean_leaf_segments;
+    int duplicates;         // leaf_segments minus the distinct segments indexed
+} QuadTreeStats;
+
 Bounds calculateBounds(Point* points, int count);
 QuadTreeNode* createQuadTreeNode(Bounds bounds, struct BoundarySegment* segment, int segment_count, int depth);
 void free_quadtree(QuadTreeNode* node);
@@ -25,7 +46,11 @@ int segmentIntersectsBound(Bounds* bound, struct BoundarySegment* segment);
 int pointIntersectsBound(Point p, Bounds* bound);
 void query_region(QuadTreeNode* node, Bounds* region, struct BoundarySegment* results, int* count, int max_results);
 QuadTreeNode* build_track_quadtree(Track* track);
+QuadTreeNode* build_track_quadtree_ex(Track* track, const QuadTreeParams* params);
+void quadtree_default_params(QuadTreeParams* params);
+void quadtree_stats(const QuadTreeNode* tree, int unique_segments, QuadTreeStats* stats);
 
-#define MAX_DEPTH 10
+#define MAX_DEPTH 10 // Defaults for QuadTreeParams
 #define MAX_SEGMENTS_PER_NODE 30
+#define CLIP_EPSILON 1e-4f // Slack when assigning segments to children, in track units
 #endif
\ No newline at end of file
@@ -0,0 +1,27 @@
+#ifndef QUAD_TREE_TUNE_H
+#define QUAD_TREE_TUNE_H
+
+#include "quad_tree.h"
+#include "track_internals.h"
+
+// Picks QuadTreeParams for one track by timing the sim's own queries: a fan of NUM_RAYS rays
+// and a collision-sized region query at each of a fixed set of random on-track poses, against
+// a tree built with every candidate in a small grid of max depths and leaf sizes.
+// The fastest candidate of that quick pass is then timed again against the defaults, interleaved
+// over many rounds, and is kept only if its median beats theirs by QUADTREE_TUNE_MIN_GAIN.
+// Timing a tree against an identical copy this way differs by up to about 10%, hence the margin.
+
+#define QUADTREE_TUNE_POSES    512
+#define QUADTREE_TUNE_MIN_GAIN 0.10f
+
+typedef struct {
+    QuadTreeParams params;  // Chosen
+    double default_ns;      // Per pose, with the default params (confirmation median)
+    double best_ns;         // Per pose, with the chosen params (confirmation median)
+    int candidates;         // Grid points timed
+} QuadTreeTuneReport;
+
+// Fills params_out (and report when non-NULL); the returned tree was built with params_out
+QuadTreeNode* build_track_quadtree_tuned(Track* track, QuadTreeParams* params_out, QuadTreeTuneReport* report);
+
+#endif
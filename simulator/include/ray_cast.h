@@ -11,8 +11,21 @@ typedef struct {
 } RayHit;
 
 RayHit cast_ray(QuadTreeNode* node, Point origin, float direction, float max_distance);
+RayHit ray_segment_intersection(Point origin, float direction, struct BoundarySegment* segment); // One segment, scalar
+
+// Distances along the NUM_RAYS rays at heading + RAY_ANGLES[j], equal to cast_ray's. One region
+// query of radius max_distance gathers the candidate segments once; every ray is then tested
+// against that list, one SegmentBlock at a time. Falls back to cast_ray per ray when more
+// than RAY_FAN_MAX_CANDIDATES segments are near.
+void cast_ray_fan(QuadTreeNode* node, Point origin, float heading, float max_distance, float distances[NUM_RAYS]);
+// Derivatives of those distances with respect to origin.x, origin.y and heading, from the segment
+// each ray hits. Rays that hit nothing within max_distance get zeros. Off the hot path: one
+// scalar descent per ray, for sim_env_step_with_jacobian.
+void ray_fan_gradients(QuadTreeNode* node, Point origin, float heading, float max_distance,
+                       const float distances[NUM_RAYS], float gradients[NUM_RAYS][3]);
 extern const float RAY_ANGLES[NUM_RAYS];
 
 #define MAX_RAY_DISTANCE 10.0f
+#define RAY_FAN_MAX_CANDIDATES 1024
 
 #endif
\ No newline at end of file
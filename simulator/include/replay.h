@@ -0,0 +1,10 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "trajectory.h"
+
+// Plays a recorded trajectory in the visualizer window until it is closed. Expects the window
+// and the track, car (1 car) and ray renderers to be initialized.
+void replay_run(TrajectoryReader* reader);
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef SEGMENT_BLOCK_H
+#define SEGMENT_BLOCK_H
+
+#include "types.h"
+#include "track_internals.h"
+
+// Boundary segments in structure-of-arrays blocks of SEGMENT_BLOCK_SIZE, so one ray is tested
+// against a whole block with vector instructions (AVX2, SSE2 or NEON, whichever the compiler
+// targets; plain C otherwise). Unused lanes hold zero-length segments, which never hit.
+//
+// The kernel gives exactly the distances of ray_segment_intersection: the validity tests
+// compare numerators against the determinant instead of dividing, and the one division left
+// (the hit distance) is the same IEEE division on every instruction set. Approximate
+// reciprocals would be faster but differ between CPUs, which would break DETERMINISTIC builds.
+// Exactness also needs unfused multiply-adds, so the Makefile builds this file, ray_cast.c and
+// bvh.c with -ffp-contract=off (EXACT_FLAGS) in every mode.
+
+#define SEGMENT_BLOCK_SIZE 8
+
+typedef struct SegmentBlock {
+    float start_x[SEGMENT_BLOCK_SIZE];
+    float start_y[SEGMENT_BLOCK_SIZE];
+    float delta_x[SEGMENT_BLOCK_SIZE]; // end - start
+    float delta_y[SEGMENT_BLOCK_SIZE];
+} SegmentBlock;
+
+// Packs count segments into *block_count blocks (NULL when count is 0)
+SegmentBlock* segment_blocks_build(const struct BoundarySegment* segments, int count, int* block_count);
+
+// Nearest hit distance below nearest along the ray from origin with unit direction (dx, dy),
+// or nearest when nothing closer is hit
+float segment_blocks_nearest(const SegmentBlock* blocks, int block_count, Point origin, float dx, float dy, float nearest);
+float segment_blocks_nearest_scalar(const SegmentBlock* blocks, int block_count, Point origin, float dx, float dy, float nearest);
+
+#endif
@@ -1,10 +1,93 @@
 #ifndef SIM_LIB_H
 #define SIM_LIB_H
 
+#include "sim_stats.h"
+
+typedef struct SimEnv SimEnv;
+typedef struct SimBatch SimBatch;
+
+// Bytes written by sim_env_snapshot: a flat copy of the car, episode counters and track id that
+// can be memcpy'd, stored or restored into any env (e.g. to branch rollouts from a shared prefix).
+// There is no RNG state to save: Philox noise is a pure function of its (seed, episode, step, car)
+// counter, so a restored rollout redraws the same noise from the same counters.
+#define SIM_SNAPSHOT_SIZE 192
+
+// Jacobian of one step (sim_env_step_with_jacobian). Inputs, in column order: the car state
+// before the step (SIM_CAR_STATE values, as sim_env_get_car_state), then the two actions.
+// Rows are the car state after the step, the 12 state_out values and the reward. Chaining the
+// car_state blocks across steps gives derivatives of a whole rollout.
+#define SIM_CAR_STATE  7 // x, y, velocity x, velocity y, acceleration, steering angle, heading
+#define SIM_JAC_INPUTS 9 // SIM_CAR_STATE, then delta_accel and delta_steering
+typedef struct {
+    float car_state[SIM_CAR_STATE][SIM_JAC_INPUTS];
+    float state[12][SIM_JAC_INPUTS];
+    float reward[SIM_JAC_INPUTS];
+} SimJacobian;
+
+// Single-instance API used by python/simulator.py
 int  sim_init(const char* track_filename, float car_start_x, float car_start_y, float car_start_heading);
 void sim_reset(float* state_out);
 void sim_step(float delta_accel, float delta_steering, float* state_out, float* reward_out, int* alive_out, int* success_out);
 void sim_get_state(float* state_out);
+void sim_step_with_jacobian(float delta_accel, float delta_steering, float* state_out, float* reward_out, int* alive_out, int* success_out, SimJacobian* jacobian_out);
+void sim_get_car_state(float* car_state_out);
+void sim_set_car_state(const float* car_state);
+int  sim_record_start(const char* path);
+int  sim_record_stop(void);
+void sim_snapshot(void* snapshot_out);
+int  sim_restore(const void* snapshot);
+int  sim_snapshot_size(void);
+int  sim_get_stats(SimStats* stats_out);
+void sim_reset_stats(void);
 void sim_close(void);
 
-#endif
\ No newline at end of file
+// Multi-env API: tracks are loaded once into a shared registry and any env can reset onto any of them
+int     sim_register_track(const char* track_filename, float car_start_x, float car_start_y, float car_start_heading);
+int     sim_unregister_track(int track_id);
+SimEnv* sim_env_create(int track_id);
+int     sim_env_reset(SimEnv* env, int track_id, float* state_out);
+void    sim_env_step(SimEnv* env, float delta_accel, float delta_steering, float* state_out, float* reward_out, int* alive_out, int* success_out);
+void    sim_env_get_state(SimEnv* env, float* state_out);
+// sim_env_step plus its derivatives. The step itself is the same as sim_env_step. Discrete parts
+// (collisions, alive/success, the reward's whole-point progress) are treated as locally constant,
+// except that the reward's position derivative follows the boundary tangent (see sim_lib.c).
+void    sim_env_step_with_jacobian(SimEnv* env, float delta_accel, float delta_steering, float* state_out, float* reward_out,
+                                   int* alive_out, int* success_out, SimJacobian* jacobian_out);
+void    sim_env_get_car_state(const SimEnv* env, float* car_state_out); // SIM_CAR_STATE floats
+void    sim_env_set_car_state(SimEnv* env, const float* car_state);     // Also recasts the rays
+// Logs every step to a trajectory file (trajectory.h). The file names one track, so while
+// recording, sim_env_reset / sim_env_restore onto a different track fail (return 1).
+int     sim_env_record_start(SimEnv* env, const char* path);
+int     sim_env_record_stop(SimEnv* env);
+void    sim_env_snapshot(const SimEnv* env, void* snapshot_out); // Writes SIM_SNAPSHOT_SIZE bytes
+int     sim_env_restore(SimEnv* env, const void* snapshot);      // 1 if the snapshot is invalid or its track is not here
+int     sim_env_get_stats(const SimEnv* env, SimStats* stats_out); // Counters since the last reset; returns sim_stats_enabled()
+void    sim_env_reset_stats(SimEnv* env);
+int     sim_stats_enabled(void); // 1 in a STATS=1 build, else the counters are always zero
+void    sim_env_destroy(SimEnv* env);
+
+// Batched stepping on a pool of threads (num_threads <= 0: one per CPU). actions holds 2 floats
+// per env and state_out 12; every env is stepped as by sim_env_step, so the results match a
+// scalar loop bit for bit whatever the thread count.
+SimBatch* sim_batch_create(int num_threads);
+void      sim_batch_step(SimBatch* batch, SimEnv** envs, int num_envs, const float* actions,
+                         float* state_out, float* reward_out, int* alive_out, int* success_out);
+// Runs fn(ctx, begin, end) over consecutive chunks of [0, num_items) on the same threads and
+// returns when all are done; for per-env work besides the step, e.g. a policy forward pass
+void      sim_batch_for(SimBatch* batch, int num_items, void (*fn)(void* ctx, int begin, int end), void* ctx);
+void      sim_batch_destroy(SimBatch* batch);
+
+// Chrome trace-event timeline of sim_step phases and batches (trace.h). sim_trace_begin /
+// sim_trace_end let the caller add its own spans (e.g. Python's rollout and update phases);
+// the name is interned: each distinct name is copied once and kept until the process exits,
+// so use a fixed set of names rather than ones built per span.
+int  sim_trace_start(const char* path);
+int  sim_trace_stop(void);
+unsigned long long sim_trace_begin(void);
+void sim_trace_end(const char* name, unsigned long long start);
+
+// Exploration noise shared with the C rollouts: n standard normals that depend only on
+// (seed, episode, step, car), see philox.h
+void sim_rng_normals(unsigned long long seed, unsigned int episode, unsigned int step, unsigned int car, float* out, int n);
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef SIM_RUNNER_H
+#define SIM_RUNNER_H
+
+#include "car_internals.h"
+#include "track_internals.h"
+#include "quad_tree.h"
+#include "nn.h"
+#include "policy_loop.h"
+#include <stdint.h>
+
+// Runs a population of policy-driven cars on its own thread at a fixed time step, independent
+// of the render rate. The sim clock advances at speed x wall time through an accumulator;
+// the renderer asks for poses interpolated between the last two sim steps.
+
+#define SIM_RUNNER_MIN_SPEED 1.0f
+#define SIM_RUNNER_MAX_SPEED 1000.0f
+
+typedef struct SimRunner SimRunner;
+
+typedef struct {
+    Network* nn;
+    const Track* track;
+    QuadTreeNode* tree;
+    Point start_point;
+    float start_heading;
+    int population;
+    float sigma; // Std of the Gaussian action noise, 0 for the deterministic policy
+    uint64_t seed; // Noise for (episode, step, car) is drawn from philox keyed by this seed
+    float dt;    // Fixed sim step in seconds
+} SimRunnerConfig;
+
+SimRunner* sim_runner_create(const SimRunnerConfig* config);
+void sim_runner_destroy(SimRunner* runner); // Stops and joins the sim thread
+
+void  sim_runner_set_speed(SimRunner* runner, float speed); // Clamped to [MIN_SPEED, MAX_SPEED]
+float sim_runner_get_speed(SimRunner* runner);
+void  sim_runner_set_paused(SimRunner* runner, int paused);
+int   sim_runner_is_paused(SimRunner* runner);
+
+// Writes the interpolated pose of every car into cars[0 .. population) (only position, heading
+// and ray distances are meaningful) and each car's status and track progress in [0, 1]
+void sim_runner_interpolate(SimRunner* runner, Car* cars, PolicyStatus* status, float* fitness);
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef SIM_STATS_H
+#define SIM_STATS_H
+
+#include <stdint.h>
+
+// Hot-path counters, compiled in with make STATS=1 (SIM_STATS). Each SimEnv owns a SimStats;
+// sim_env_step points the thread-local sim_stats_current at it so the ray cast, quad tree and
+// collision code can count without being passed the env. Without SIM_STATS the macros below
+// expand to nothing and the counters stay zero.
+
+typedef struct {
+    uint64_t steps;
+
+    uint64_t rays;                 // Rays cast (NUM_RAYS per step)
+    uint64_t ray_nodes_visited;    // Quad tree nodes entered by cast_ray, or by cast_ray_fan's gather
+    uint64_t ray_aabb_tests;       // Ray vs. node bounds tests (cast_ray only)
+    uint64_t ray_segment_tests;    // Ray vs. segment intersection tests
+
+    uint64_t queries;              // query_region calls from collision and progress checks
+    uint64_t query_nodes_visited;
+    uint64_t query_segment_tests;  // Segments tested against the query region
+    uint64_t query_results;        // Segments returned, summed over queries
+    uint64_t query_max_results;    // Largest single result
+    uint64_t query_truncations;    // Queries that filled MAX_COLLISION_CHECKS (results may be missing)
+
+    // Time per phase of sim_env_step in sim_stats_ticks() units (TSC cycles on x86, the
+    // virtual counter on ARM, nanoseconds elsewhere)
+    uint64_t ticks_physics;
+    uint64_t ticks_rays;
+    uint64_t ticks_collision;
+    uint64_t ticks_progress;
+} SimStats;
+
+#ifdef SIM_STATS
+
+extern _Thread_local SimStats* sim_stats_current;
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+static inline uint64_t sim_stats_ticks(void) { return __rdtsc(); }
+#elif defined(__aarch64__)
+static inline uint64_t sim_stats_ticks(void) {
+    uint64_t ticks;
+    __asm__ volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+    return ticks;
+}
+#else
+#include <time.h>
+static inline uint64_t sim_stats_ticks(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+#endif
+
+#define SIM_STATS_ADD(field, n) do { if (sim_stats_current) sim_stats_current->field += (n); } while (0)
+#define SIM_STATS_QUERY(count, max_results) do {                                      \
+        SimStats* stats_ = sim_stats_current;                                          \
+        if (stats_) {                                                                  \
+            stats_->queries++;                                                         \
+            stats_->query_results += (count);                                          \
+            if ((uint64_t)(count) > stats_->query_max_results) stats_->query_max_results = (count); \
+            if ((count) >= (max_results)) stats_->query_truncations++;                 \
+        }                                                                              \
+    } while (0)
+#define SIM_STATS_TIMER(name) uint64_t name = sim_stats_ticks()
+#define SIM_STATS_LAP(name, field) do {                                                \
+        uint64_t now_ = sim_stats_ticks();                                             \
+        SIM_STATS_ADD(field, now_ - name);                                             \
+        name = now_;                                                                   \
+    } while (0)
+
+#else
+
+#define SIM_STATS_ADD(field, n) ((void)0)
+#define SIM_STATS_QUERY(count, max_results) ((void)0)
+#define SIM_STATS_TIMER(name) ((void)0)
+#define SIM_STATS_LAP(name, field) ((void)0)
+
+#endif
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+// Timeline tracing in Chrome trace-event JSON (open in chrome://tracing or ui.perfetto.dev).
+// Each thread appends complete events to its own lock-free ring buffer; a background thread
+// drains the rings into the file, so recording an event costs two clock reads and a store.
+// While no trace is running, trace_begin is a relaxed atomic load and trace_end returns at once.
+//
+//     uint64_t t = trace_begin();
+//     ...                                   // work
+//     trace_lap("physics", &t);             // closes "physics", starts the next phase at now
+//     ...
+//     trace_end("rays", t);
+//
+// Names are stored by pointer and must stay valid until trace_stop: use string literals, or
+// trace_intern for names built at runtime.
+
+int  trace_start(const char* path);  // 0 on success; restarts if a trace is already running
+int  trace_stop(void);               // Drains every ring, closes the JSON; 0 on success
+int  trace_enabled(void);
+
+uint64_t trace_begin(void);                          // 0 while tracing is off
+void     trace_end(const char* name, uint64_t start);
+void     trace_lap(const char* name, uint64_t* start);
+void     trace_set_thread_name(const char* name);    // Label for the calling thread in the viewer
+// Copy kept until the process exits, one per distinct name: names that differ per span
+// (e.g. "episode 17") leak a copy each, so put such counters in the thread name or a phase
+const char* trace_intern(const char* name);
+
+#endif
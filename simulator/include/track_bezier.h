@@ -0,0 +1,19 @@
+#ifndef TRACK_BEZIER_H
+#define TRACK_BEZIER_H
+
+#include "types.h"
+#include "track_internals.h"
+
+typedef struct {
+    float tolerance;  // Max distance between a boundary chord and the true offset curve
+    float max_angle;  // Max tangent turn (radians) across one boundary segment
+    float max_length; // Max centerline length of one boundary segment
+} TessellationParams;
+
+void bezier_evaluate(const BezierSegment *segment, float t, Point *point, Vector2d *tangent);
+void tessellation_default_params(TessellationParams *params);
+void tessellate_boundaries(const BezierSegment *segments, int count, float width, const TessellationParams *params,
+                           Boundary *left, Boundary *right);
+void track_tessellate(Track *track, const TessellationParams *params); // Defined in track_loader.c
+
+#endif
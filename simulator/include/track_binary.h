@@ -0,0 +1,48 @@
+#ifndef TRACK_BINARY_H
+#define TRACK_BINARY_H
+
+#include <stdint.h>
+#include "track_internals.h"
+#include "quad_tree.h"
+
+#define TRACK_BINARY_MAGIC   0x4B525443u // "CTRK"
+#define TRACK_BINARY_VERSION 2u
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t segment_size; // sizeof(struct BoundarySegment) of the writer
+    uint32_t node_size;    // sizeof(TrackBinaryNode) of the writer
+    float width;
+    float total_length;
+    int32_t left_count;
+    int32_t right_count;
+    int32_t node_count;
+    int32_t leaf_segment_count;
+    uint64_t left_points_offset;
+    uint64_t right_points_offset;
+    uint64_t left_segments_offset;
+    uint64_t right_segments_offset;
+    uint64_t start_segment_offset;
+    uint64_t cumulative_length_offset;
+    uint64_t nodes_offset;
+    uint64_t leaf_segments_offset;
+    uint64_t file_size;
+    int32_t quadtree_max_depth; // QuadTreeParams the stored tree was built with
+    int32_t quadtree_max_segments_per_node;
+} TrackBinaryHeader;
+
+// Quad tree node flattened in pre-order, children referenced by index (-1 for none)
+typedef struct {
+    Bounds bounds;
+    int32_t first_segment; // Index into the leaf segment pool
+    int32_t segment_count;
+    int32_t children[4];
+} TrackBinaryNode;
+
+int    track_is_binary(const char *path);
+int    save_track_binary(const Track *track, const QuadTreeNode *tree, const QuadTreeParams *params, const char *path);
+Track *load_track_binary(const char *path, QuadTreeNode **tree_out);
+int    track_binary_params(const char *path, QuadTreeParams *params_out); // 0 on success
+
+#endif
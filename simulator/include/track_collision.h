@@ -4,9 +4,12 @@
 #include "quad_tree.h"
 #include "car_internals.h"
 #include "car.h"
+#include "track_internals.h"
 
 int check_car_collision(Car* car, QuadTreeNode* node);
 void get_corners(Car* car, Point* corners);
+int nearest_left_segment_index(const Track* track, QuadTreeNode* node, Point position);
+int track_reached_finish(const Track* track, Point position);
 
 #define MAX_COLLISION_CHECKS 128
 
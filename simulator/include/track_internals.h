@@ -1,6 +1,7 @@
 #ifndef TRACK_INTERNALS_H
 #define TRACK_INTERNALS_H
 
+#include <stddef.h>
 #include "types.h"
 #include "track_loader.h"
 
@@ -15,6 +16,10 @@ typedef enum {
     BOUNDARY_START
 } BoundaryType;
 
+typedef struct {
+    Point p[4]; // Cubic Bezier control points of one centerline segment
+} BezierSegment;
+
 struct BoundarySegment {
     Point start;
     Point end;
@@ -33,6 +38,10 @@ struct Track {
     struct BoundarySegment start_segment;
     float *cumulative_length;
     float total_length;
+    int num_bezier_segments;
+    BezierSegment *bezier_segments; // Centerline from the SEGMENT blocks (NULL for binary tracks)
+    void *mapped_data; // Non-NULL when the arrays above point into a mapped binary track file
+    size_t mapped_size;
 };
 
 #endif
\ No newline at end of file
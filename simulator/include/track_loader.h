@@ -4,7 +4,21 @@
 typedef struct Track Track;
 typedef struct BoundarySegment Segment;
 
+typedef enum {
+    TRACK_OK = 0,
+    TRACK_ERR_OPEN,   // File could not be opened or read
+    TRACK_ERR_SYNTAX, // Missing keyword or malformed number
+    TRACK_ERR_COUNT   // Declared count does not match the lines in the file
+} TrackErrorCode;
+
+typedef struct {
+    TrackErrorCode code;
+    int line; // 1-based line number, 0 when not tied to a line
+    char message[128];
+} TrackLoadError;
+
 Track *load_track(const char *path);
+Track *load_track_ex(const char *path, TrackLoadError *error);
 void   free_track(Track *t);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,31 @@
+#ifndef TRACK_REGISTRY_H
+#define TRACK_REGISTRY_H
+
+#include <stdint.h>
+#include "types.h"
+#include "track_internals.h"
+#include "quad_tree.h"
+
+// Immutable track data plus its spatial index, shared by every env driving on it
+typedef struct {
+    char *path;
+    Track *track;
+    QuadTreeNode *tree;
+    uint64_t fingerprint; // Hash of the boundary points: names the track across processes, unlike its id
+    int ref_count;
+} SharedTrack;
+
+// A registered track: shared data plus the start pose used when an env resets onto it
+typedef struct {
+    SharedTrack *shared;
+    Point start_point;
+    float start_heading;
+} TrackEntry;
+
+int  track_registry_add(const char *path, Point start_point, float start_heading);
+int  track_registry_remove(int track_id);
+int  track_registry_acquire(int track_id, TrackEntry *entry_out);
+void track_registry_release(SharedTrack *shared);
+int  track_registry_count(void);
+
+#endif
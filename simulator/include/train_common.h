@@ -0,0 +1,16 @@
+#ifndef TRAIN_COMMON_H
+#define TRAIN_COMMON_H
+#include <time.h>
+
+// Shared by the C trainers (train_es, train_ppo); include after defining _POSIX_C_SOURCE
+
+#define NUM_STATE 12
+#define SUCCESS_BONUS 1000.0f // Added to a finishing episode's return, as in train.py
+
+static inline double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+#endif
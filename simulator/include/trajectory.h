@@ -0,0 +1,88 @@
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+#include <stdint.h>
+#include "types.h"
+
+// Append-only log of every sim step, for replaying episodes without re-running training.
+//
+// Each step is quantized to fixed-point integers (scales below), predicted from the previous
+// steps of the same block, and stored as zigzag LEB128 varints of the prediction error behind a
+// varint bit mask of the fields whose error is non-zero. Steps are grouped into blocks of
+// TRAJECTORY_BLOCK_STEPS; every block starts with an empty history (a keyframe), so any step is
+// at most one block decode away. A footer indexes the blocks; files cut short without one
+// (a crashed run) are recovered by scanning the block headers.
+
+#define TRAJECTORY_MAGIC        0x4A415254u // "TRAJ"
+#define TRAJECTORY_BLOCK_MAGIC  0x4B4C4254u // "TBLK"
+#define TRAJECTORY_FOOTER_MAGIC 0x444E4554u // "TEND"
+#define TRAJECTORY_VERSION      1u
+#define TRAJECTORY_BLOCK_STEPS  256
+
+enum {
+    TRAJECTORY_FLAG_ALIVE         = 1 << 0,
+    TRAJECTORY_FLAG_SUCCESS       = 1 << 1,
+    TRAJECTORY_FLAG_EPISODE_START = 1 << 2 // First step after a reset
+};
+
+typedef struct {
+    Point position;
+    float heading;
+    float speed;
+    float acceleration;
+    float steering_angle;
+    float action[2]; // delta_accel, delta_steering passed to the step
+    float ray_distances[NUM_RAYS];
+    float reward;
+    uint32_t flags;
+} TrajectoryStep;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t block_steps;
+    uint32_t field_count;
+    float start_x;
+    float start_y;
+    float start_heading;
+    uint32_t reserved;
+    char track_path[256];
+} TrajectoryHeader;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t step_count;
+    uint64_t first_step;
+    uint32_t payload_size;
+    uint32_t flags; // Reserved for a compressed payload, always 0 for now
+} TrajectoryBlockHeader;
+
+typedef struct {
+    uint64_t first_step;
+    uint64_t offset; // Of the block header
+} TrajectoryIndexEntry;
+
+typedef struct {
+    uint64_t index_offset;
+    uint64_t block_count;
+    uint64_t step_count;
+    uint32_t magic;
+    uint32_t reserved;
+} TrajectoryFooter;
+
+typedef struct TrajectoryWriter TrajectoryWriter;
+typedef struct TrajectoryReader TrajectoryReader;
+
+// Writer: steps are encoded on the caller's thread, full blocks are written by a background thread
+TrajectoryWriter *trajectory_writer_open(const char *path, const char *track_path, Point start_point, float start_heading);
+void trajectory_writer_append(TrajectoryWriter *writer, const TrajectoryStep *step);
+int  trajectory_writer_close(TrajectoryWriter *writer); // Flushes, writes the footer; 0 on success
+
+// Reader: maps the file; reading any step decodes at most one block
+TrajectoryReader *trajectory_reader_open(const char *path);
+uint64_t trajectory_reader_step_count(const TrajectoryReader *reader);
+const TrajectoryHeader *trajectory_reader_header(const TrajectoryReader *reader);
+int  trajectory_reader_get(TrajectoryReader *reader, uint64_t step, TrajectoryStep *out); // 0 on success
+void trajectory_reader_close(TrajectoryReader *reader);
+
+#endif
@@ -5,8 +5,8 @@
 #include "shader.h"
 #include "glad.h"
 
-int car_renderer_init(int num);
-void car_renderer_update(int num, Car** cars);
+int car_renderer_init(int max_cars);
+void car_renderer_update(int num, Car** cars, const float* fitness);
 void car_renderer_draw();
 void car_renderer_cleanup();
 
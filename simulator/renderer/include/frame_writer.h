@@ -0,0 +1,24 @@
+#ifndef FRAME_WRITER_H
+#define FRAME_WRITER_H
+
+#include <stdint.h>
+
+// Streams RGBA8 frames (e.g. from soft_raster) to a video file. The format comes from the
+// path's extension:
+//   .y4m  YUV4MPEG2, 4:2:0 full range — plays in mpv / ffplay, encodes with `ffmpeg -i frames.y4m out.mp4`
+//   .ppm  Concatenated binary PPM (P6) images — `ffmpeg -f image2pipe -c:v ppm -i frames.ppm out.mp4`
+//   other Raw RGBA, no header — `ffmpeg -f rawvideo -pix_fmt rgba -s WxH -i frames.rgba out.mp4`
+
+typedef enum {
+    FRAME_FORMAT_RAW,
+    FRAME_FORMAT_PPM,
+    FRAME_FORMAT_Y4M
+} FrameFormat;
+
+typedef struct FrameWriter FrameWriter;
+
+FrameWriter* frame_writer_open(const char* path, int width, int height, int fps);
+int frame_writer_write(FrameWriter* writer, const uint8_t* rgba); // Returns 0 on success
+int frame_writer_close(FrameWriter* writer);                       // Returns 0 if every write succeeded
+
+#endif
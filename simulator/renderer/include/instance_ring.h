@@ -0,0 +1,25 @@
+#ifndef INSTANCE_RING_H
+#define INSTANCE_RING_H
+
+#include "glad.h"
+
+// Triple-buffered streaming VBO for per-instance data. Each frame writes the next region of
+// one buffer through an unsynchronized mapping, so the CPU never waits on a region the GPU may
+// still be reading; a fence per region guards reuse three frames later.
+
+#define INSTANCE_RING_REGIONS 3
+
+typedef struct {
+    GLuint vbo;
+    GLsizeiptr region_size; // Bytes per region
+    int region;             // Region written by the last instance_ring_map
+    GLsync fences[INSTANCE_RING_REGIONS];
+} InstanceRing;
+
+void instance_ring_init(InstanceRing* ring, GLsizeiptr region_size);
+void* instance_ring_map(InstanceRing* ring);      // Leaves ring->vbo bound to GL_ARRAY_BUFFER; NULL on failure
+GLintptr instance_ring_unmap(InstanceRing* ring); // Byte offset of the region just written
+void instance_ring_fence(InstanceRing* ring);     // Call after the draws that read the region
+void instance_ring_cleanup(InstanceRing* ring);
+
+#endif
@@ -5,8 +5,8 @@
 #include "shader.h"
 #include "glad.h"
 
-int ray_renderer_init();
-void ray_renderer_update(Car* car);
+int ray_renderer_init(int max_cars);
+void ray_renderer_update(int num, Car** cars);
 void ray_renderer_draw();
 void ray_renderer_cleanup();
 
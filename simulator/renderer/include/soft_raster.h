@@ -0,0 +1,33 @@
+#ifndef SOFT_RASTER_H
+#define SOFT_RASTER_H
+
+#include <stdint.h>
+#include "track_internals.h"
+#include "car_internals.h"
+
+// CPU rasterizer for offscreen frames: draws the same scene as track_renderer, car_renderer and
+// ray_renderer into an RGBA8 buffer, with no OpenGL. Draw calls only record primitives; the
+// frame is rasterized in soft_raster_end, which splits the image into tiles shared by a pool
+// of worker threads.
+
+typedef struct SoftRaster SoftRaster;
+
+SoftRaster* soft_raster_create(int width, int height, int num_threads); // num_threads <= 0: one per CPU
+void soft_raster_destroy(SoftRaster* sr);
+
+void soft_raster_begin(SoftRaster* sr, float r, float g, float b);
+void soft_raster_draw_track(SoftRaster* sr, const Track* track);
+void soft_raster_draw_cars(SoftRaster* sr, int num, Car** cars);
+void soft_raster_draw_rays(SoftRaster* sr, int num, Car** cars);
+void soft_raster_draw_line(SoftRaster* sr, Point from, Point to, float r, float g, float b);
+void soft_raster_end(SoftRaster* sr);
+
+// Keeps the last rendered frame as the starting image of every later soft_raster_begin
+// (e.g. render the track once, save it, then draw only cars and rays per frame)
+void soft_raster_save_background(SoftRaster* sr);
+
+const uint8_t* soft_raster_pixels(const SoftRaster* sr); // width * height * 4 bytes, top row first
+int soft_raster_width(const SoftRaster* sr);
+int soft_raster_height(const SoftRaster* sr);
+
+#endif
@@ -8,7 +8,12 @@
 #include "glad.h"
 #include <GLFW/glfw3.h>
 
+typedef void (*WindowKeyHandler)(int key); // GLFW_KEY_* of a key press or auto-repeat
+
 int window_init(int width, int height, const char* title);
+void window_set_key_handler(WindowKeyHandler handler);
+void window_set_title(const char* title);
+void window_close(void);
 int window_should_close(void);
 void window_swap_and_poll(void);
 void window_cleanup(void);
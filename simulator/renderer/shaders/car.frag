@@ -1,8 +1,8 @@
 #version 330 core
 
-uniform vec3 colour;
+in vec3 carColour;
 out vec4 FragColor;
 
 void main() {
-    FragColor = vec4(colour.r, colour.g, colour.b, 1);
-}
\ No newline at end of file
+    FragColor = vec4(carColour.r, carColour.g, carColour.b, 1);
+}
@@ -3,8 +3,12 @@
 layout (location = 0) in vec2 vertexPos;
 layout (location = 1) in vec2 instancePos;
 layout (location = 2) in float heading;
+layout (location = 3) in float fitness; // [0, 1], or negative for the uniform colour
 
 uniform mat4 projection;
+uniform vec3 colour;
+
+out vec3 carColour;
 
 void main() {
     float c = cos(heading);
@@ -14,4 +18,9 @@ void main() {
         vertexPos.x * s + vertexPos.y * c
     );
     gl_Position = projection * vec4(rotated + instancePos, 0, 1.0);
-}
\ No newline at end of file
+
+    // Red -> yellow -> green as fitness goes 0 -> 1
+    float f = clamp(fitness, 0.0, 1.0);
+    vec3 ramp = vec3(min(1.0, 2.0 - 2.0 * f), min(1.0, 2.0 * f), 0.0);
+    carColour = fitness < 0.0 ? colour : ramp;
+}
@@ -0,0 +1,22 @@
+#version 330 core
+
+layout (location = 0) in vec3 pose;   // x, y, heading
+layout (location = 1) in vec4 dist0;  // Hit distances of rays 0-3
+layout (location = 2) in vec4 dist1;  // Rays 4-7
+layout (location = 3) in float dist2; // Ray 8
+
+uniform mat4 projection;
+uniform float ray_angles[9];
+
+void main() {
+    // Vertices 2 * ray and 2 * ray + 1 are the start and end of one ray
+    int ray = gl_VertexID / 2;
+    float distance = 0.0;
+    if (gl_VertexID % 2 == 1) {
+        distance = ray < 4 ? dist0[ray] : (ray < 8 ? dist1[ray - 4] : dist2);
+    }
+
+    float angle = pose.z + ray_angles[ray];
+    vec2 end = pose.xy + distance * vec2(cos(angle), sin(angle));
+    gl_Position = projection * vec4(end, 0, 1.0);
+}
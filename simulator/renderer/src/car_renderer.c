@@ -1,16 +1,23 @@
 #include "car_renderer.h"
 #include <stdio.h>
 #include "util.h"
+#include "instance_ring.h"
 
-static GLuint vao = 0, rectVBO = 0, dynaVBO;
+#define CAR_INSTANCE_FLOATS 4 // x, y, heading, fitness
+
+static GLuint vao = 0, rectVBO = 0;
+static InstanceRing instances;
+static GLintptr instance_offset = 0;
 static GLuint shader = 0;
 static float transformation_matrix[16];
+static int max_cars = 0;
 static int num_cars = 0;
 
-int car_renderer_init(int num) {
+int car_renderer_init(int max) {
     create_transformation_matrix(transformation_matrix, 0, 100, 0, 100);
 
-    num_cars = num;
+    max_cars = max;
+    num_cars = 0;
 
     const char* fragFile = "renderer/shaders/car.frag";
     const char* vertexFile = "renderer/shaders/car.vert";
@@ -32,43 +39,47 @@ int car_renderer_init(int num) {
     glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
 
-    glGenBuffers(1, &dynaVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, dynaVBO);
-
-    glBufferData(GL_ARRAY_BUFFER, sizeof(float) * num_cars * 3, NULL, GL_DYNAMIC_DRAW);
-
-    // Location 1 — instance position (x, y)
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+    // Locations 1-3 (position, heading, fitness) are per instance; their pointers are set in
+    // car_renderer_draw because the ring region they read from changes every frame
     glEnableVertexAttribArray(1);
     glVertexAttribDivisor(1, 1);
-
-    // Location 2 — heading (after 2 floats)
-    glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)(2 * sizeof(float)));
     glEnableVertexAttribArray(2);
     glVertexAttribDivisor(2, 1);
+    glEnableVertexAttribArray(3);
+    glVertexAttribDivisor(3, 1);
 
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
 
+    instance_ring_init(&instances, sizeof(float) * CAR_INSTANCE_FLOATS * max_cars);
+
     return 0;
 }
 
-void car_renderer_update(int num, Car** cars) {
-    num_cars = num;
+void car_renderer_update(int num, Car** cars, const float* fitness) {
+    // fitness[i] in [0, 1] colours car i from red to green; NULL draws every car in cyan
+    if (num > max_cars) num = max_cars;
+
+    float* car_data = instance_ring_map(&instances);
+    if (car_data == NULL) {
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        return; // Keep drawing the previous frame's instances
+    }
 
-    float car_data[num * 3];
     for (int i = 0; i < num; i++) {
-        car_data[i * 3 + 0] = cars[i]->position.x;
-        car_data[i * 3 + 1] = cars[i]->position.y;
-        car_data[i * 3 + 2] = cars[i]->heading;
+        car_data[i * CAR_INSTANCE_FLOATS + 0] = cars[i]->position.x;
+        car_data[i * CAR_INSTANCE_FLOATS + 1] = cars[i]->position.y;
+        car_data[i * CAR_INSTANCE_FLOATS + 2] = cars[i]->heading;
+        car_data[i * CAR_INSTANCE_FLOATS + 3] = fitness ? fitness[i] : -1.0f;
     }
 
-    glBindBuffer(GL_ARRAY_BUFFER, dynaVBO);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(float) * num_cars * 3, car_data);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    instance_offset = instance_ring_unmap(&instances);
+    num_cars = num;
 }
 
 void car_renderer_draw() {
+    if (num_cars == 0) return;
+
     shader_use(shader);
 
     GLint projLoc = shader_get_uniform(shader, "projection");
@@ -78,12 +89,20 @@ void car_renderer_draw() {
     glUniform3f(colourLoc, 0.0f, 1.0f, 1.0f);
 
     glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, instances.vbo);
+    GLsizei stride = CAR_INSTANCE_FLOATS * sizeof(float);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void*)instance_offset);
+    glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, stride, (void*)(instance_offset + 2 * sizeof(float)));
+    glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, stride, (void*)(instance_offset + 3 * sizeof(float)));
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
     glDrawArraysInstanced(GL_TRIANGLE_FAN, 0, 4, num_cars);
+    instance_ring_fence(&instances);
 }
 
 void car_renderer_cleanup() {
     shader_clean_up(shader);
     glDeleteVertexArrays(1, &vao);
     glDeleteBuffers(1, &rectVBO);
-    glDeleteBuffers(1, &dynaVBO);
-}
\ No newline at end of file
+    instance_ring_cleanup(&instances);
+}
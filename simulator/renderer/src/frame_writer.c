@@ -0,0 +1,139 @@
+#include "frame_writer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "util.h"
+
+struct FrameWriter {
+    FILE* file;
+    FrameFormat format;
+    int width;
+    int height;
+    uint8_t* scratch; // One converted frame (RGB or Y'CbCr planes)
+    int failed;
+};
+
+static FrameFormat format_from_path(const char* path);
+static void rgba_to_rgb(const FrameWriter* writer, const uint8_t* rgba);
+static void rgba_to_yuv420(const FrameWriter* writer, const uint8_t* rgba);
+
+FrameWriter* frame_writer_open(const char* path, int width, int height, int fps) {
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        fprintf(stderr, "Failed to open frame output: %s\n", path);
+        return NULL;
+    }
+
+    FrameWriter* writer = xalloc(1, sizeof(FrameWriter));
+    writer->file = file;
+    writer->format = format_from_path(path);
+    writer->width = width;
+    writer->height = height;
+
+    size_t pixels = (size_t)width * height;
+    size_t chroma = (size_t)((width + 1) / 2) * ((height + 1) / 2);
+    if (writer->format == FRAME_FORMAT_PPM) {
+        writer->scratch = xalloc(pixels, 3);
+    } else if (writer->format == FRAME_FORMAT_Y4M) {
+        writer->scratch = xalloc(pixels + 2 * chroma, 1);
+        // Full-range BT.601 chroma sited between luma samples, as in JPEG
+        if (fprintf(file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg XCOLORRANGE=FULL\n", width, height, fps) < 0) {
+            writer->failed = 1;
+        }
+    }
+    return writer;
+}
+
+int frame_writer_write(FrameWriter* writer, const uint8_t* rgba) {
+    size_t pixels = (size_t)writer->width * writer->height;
+    size_t chroma = (size_t)((writer->width + 1) / 2) * ((writer->height + 1) / 2);
+    const void* data = rgba;
+    size_t size = pixels * 4;
+
+    if (writer->format == FRAME_FORMAT_PPM) {
+        if (fprintf(writer->file, "P6\n%d %d\n255\n", writer->width, writer->height) < 0) {
+            writer->failed = 1;
+        }
+        rgba_to_rgb(writer, rgba);
+        data = writer->scratch;
+        size = pixels * 3;
+    } else if (writer->format == FRAME_FORMAT_Y4M) {
+        if (fputs("FRAME\n", writer->file) < 0) {
+            writer->failed = 1;
+        }
+        rgba_to_yuv420(writer, rgba);
+        data = writer->scratch;
+        size = pixels + 2 * chroma;
+    }
+
+    if (fwrite(data, 1, size, writer->file) != size) {
+        writer->failed = 1;
+    }
+    return writer->failed;
+}
+
+int frame_writer_close(FrameWriter* writer) {
+    if (writer == NULL) {
+        return 1;
+    }
+    int failed = writer->failed;
+    if (fclose(writer->file) != 0) {
+        failed = 1;
+    }
+    free(writer->scratch);
+    free(writer);
+    return failed;
+}
+
+static FrameFormat format_from_path(const char* path) {
+    const char* ext = strrchr(path, '.');
+    if (ext && strcmp(ext, ".y4m") == 0) return FRAME_FORMAT_Y4M;
+    if (ext && strcmp(ext, ".ppm") == 0) return FRAME_FORMAT_PPM;
+    return FRAME_FORMAT_RAW;
+}
+
+static void rgba_to_rgb(const FrameWriter* writer, const uint8_t* rgba) {
+    size_t pixels = (size_t)writer->width * writer->height;
+    uint8_t* rgb = writer->scratch;
+    for (size_t i = 0; i < pixels; i++) {
+        rgb[i * 3 + 0] = rgba[i * 4 + 0];
+        rgb[i * 3 + 1] = rgba[i * 4 + 1];
+        rgb[i * 3 + 2] = rgba[i * 4 + 2];
+    }
+}
+
+static void rgba_to_yuv420(const FrameWriter* writer, const uint8_t* rgba) {
+    // JFIF (full range BT.601) coefficients in 16.16 fixed point; chroma is the average
+    // of each 2x2 block, clamped at the right and bottom edges for odd sizes
+    int w = writer->width, h = writer->height;
+    int cw = (w + 1) / 2, ch = (h + 1) / 2;
+    uint8_t* y_plane = writer->scratch;
+    uint8_t* u_plane = y_plane + (size_t)w * h;
+    uint8_t* v_plane = u_plane + (size_t)cw * ch;
+
+    for (int y = 0; y < h; y++) {
+        const uint8_t* row = rgba + (size_t)y * w * 4;
+        for (int x = 0; x < w; x++) {
+            int r = row[x * 4], g = row[x * 4 + 1], b = row[x * 4 + 2];
+            y_plane[(size_t)y * w + x] = (uint8_t)((19595 * r + 38470 * g + 7471 * b + 32768) >> 16);
+        }
+    }
+
+    for (int cy = 0; cy < ch; cy++) {
+        int y0 = cy * 2, y1 = y0 + 1 < h ? y0 + 1 : y0;
+        for (int cx = 0; cx < cw; cx++) {
+            int x0 = cx * 2, x1 = x0 + 1 < w ? x0 + 1 : x0;
+            const uint8_t* p[4] = {
+                rgba + ((size_t)y0 * w + x0) * 4, rgba + ((size_t)y0 * w + x1) * 4,
+                rgba + ((size_t)y1 * w + x0) * 4, rgba + ((size_t)y1 * w + x1) * 4
+            };
+            int r = (p[0][0] + p[1][0] + p[2][0] + p[3][0] + 2) >> 2;
+            int g = (p[0][1] + p[1][1] + p[2][1] + p[3][1] + 2) >> 2;
+            int b = (p[0][2] + p[1][2] + p[2][2] + p[3][2] + 2) >> 2;
+            int u = (-11059 * r - 21709 * g + 32768 * b + (128 << 16) + 32768) >> 16;
+            int v = (32768 * r - 27439 * g - 5329 * b + (128 << 16) + 32768) >> 16;
+            u_plane[(size_t)cy * cw + cx] = (uint8_t)(u < 0 ? 0 : u > 255 ? 255 : u);
+            v_plane[(size_t)cy * cw + cx] = (uint8_t)(v < 0 ? 0 : v > 255 ? 255 : v);
+        }
+    }
+}
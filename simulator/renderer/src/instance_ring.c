@@ -0,0 +1,65 @@
+#include "instance_ring.h"
+#include <stdio.h>
+
+#define FENCE_TIMEOUT_NS 1000000000ull
+
+void instance_ring_init(InstanceRing* ring, GLsizeiptr region_size) {
+    ring->region_size = region_size;
+    ring->region = INSTANCE_RING_REGIONS - 1; // First map uses region 0
+    for (int i = 0; i < INSTANCE_RING_REGIONS; i++) {
+        ring->fences[i] = NULL;
+    }
+
+    glGenBuffers(1, &ring->vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, ring->vbo);
+    glBufferData(GL_ARRAY_BUFFER, region_size * INSTANCE_RING_REGIONS, NULL, GL_STREAM_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void* instance_ring_map(InstanceRing* ring) {
+    // GL 3.3 (the macOS limit) has no glBufferStorage, so the region is mapped each frame
+    // instead of persistently; GL_MAP_UNSYNCHRONIZED_BIT keeps that from stalling
+    ring->region = (ring->region + 1) % INSTANCE_RING_REGIONS;
+
+    GLsync fence = ring->fences[ring->region];
+    if (fence) {
+        GLenum result;
+        do {
+            result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT_NS);
+        } while (result == GL_TIMEOUT_EXPIRED);
+        glDeleteSync(fence);
+        ring->fences[ring->region] = NULL;
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, ring->vbo);
+    void* data = glMapBufferRange(GL_ARRAY_BUFFER, ring->region * ring->region_size, ring->region_size,
+                                  GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    if (data == NULL) {
+        fprintf(stderr, "Instance buffer mapping failed\n");
+    }
+    return data;
+}
+
+GLintptr instance_ring_unmap(InstanceRing* ring) {
+    glBindBuffer(GL_ARRAY_BUFFER, ring->vbo);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return ring->region * ring->region_size;
+}
+
+void instance_ring_fence(InstanceRing* ring) {
+    if (ring->fences[ring->region]) {
+        glDeleteSync(ring->fences[ring->region]);
+    }
+    ring->fences[ring->region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void instance_ring_cleanup(InstanceRing* ring) {
+    for (int i = 0; i < INSTANCE_RING_REGIONS; i++) {
+        if (ring->fences[i]) {
+            glDeleteSync(ring->fences[i]);
+            ring->fences[i] = NULL;
+        }
+    }
+    glDeleteBuffers(1, &ring->vbo);
+}
@@ -1,58 +1,78 @@
 #include "ray_renderer.h"
 #include <stdio.h>
-#include <math.h>
 #include "util.h"
 #include "ray_cast.h"
+#include "instance_ring.h"
 
-static GLuint vao = 0, vbo = 0;
+// Per car: x, y, heading and the NUM_RAYS hit distances. ray.vert expands each instance into
+// NUM_RAYS line segments, so all rays of all cars are one instanced draw.
+#define RAY_INSTANCE_FLOATS (3 + NUM_RAYS)
+
+static GLuint vao = 0;
+static InstanceRing instances;
+static GLintptr instance_offset = 0;
 static GLuint shader = 0;
 static float transformation_matrix[16];
-static float ray_array[4 * NUM_RAYS];
+static int max_cars = 0;
+static int num_cars = 0;
 
-int ray_renderer_init() {
+int ray_renderer_init(int max) {
     create_transformation_matrix(transformation_matrix, 0, 100, 0, 100);
 
+    max_cars = max;
+    num_cars = 0;
+
     const char* fragFile = "renderer/shaders/basic.frag";
-    const char* vertexFile = "renderer/shaders/basic.vert";
+    const char* vertexFile = "renderer/shaders/ray.vert";
     shader = shader_create(vertexFile, fragFile);
     if (!shader) {
         fprintf(stderr, "Shader Error");
         return 1;
     }
 
+    shader_use(shader);
+    glUniform1fv(shader_get_uniform(shader, "ray_angles"), NUM_RAYS, RAY_ANGLES);
+
+    // No per-vertex attributes: ray.vert derives the ray and endpoint from gl_VertexID
     glGenVertexArrays(1, &vao);
     glBindVertexArray(vao);
-
-    glGenBuffers(1, &vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 4 * NUM_RAYS, NULL, GL_DYNAMIC_DRAW);
-
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    for (int location = 0; location < 4; location++) {
+        glEnableVertexAttribArray(location);
+        glVertexAttribDivisor(location, 1);
+    }
     glBindVertexArray(0);
 
+    instance_ring_init(&instances, sizeof(float) * RAY_INSTANCE_FLOATS * max_cars);
+
     return 0;
 }
 
-void ray_renderer_update(Car* car) {
+void ray_renderer_update(int num, Car** cars) {
+    if (num > max_cars) num = max_cars;
 
-    for (int j = 0; j < NUM_RAYS; j++) {
-        float end_x = car->position.x + car->ray_distances[j] * cosf(car->heading + RAY_ANGLES[j]);
-        float end_y = car->position.y + car->ray_distances[j] * sinf(car->heading + RAY_ANGLES[j]);
-        ray_array[j*4] = car->position.x;
-        ray_array[j*4 + 1] = car->position.y;
-        ray_array[j*4 + 2] = end_x;
-        ray_array[j*4 + 3] = end_y;
+    float* ray_data = instance_ring_map(&instances);
+    if (ray_data == NULL) {
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        return; // Keep drawing the previous frame's rays
     }
-    
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(float) * NUM_RAYS * 4, ray_array);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    for (int i = 0; i < num; i++) {
+        float* out = ray_data + i * RAY_INSTANCE_FLOATS;
+        out[0] = cars[i]->position.x;
+        out[1] = cars[i]->position.y;
+        out[2] = cars[i]->heading;
+        for (int j = 0; j < NUM_RAYS; j++) {
+            out[3 + j] = cars[i]->ray_distances[j];
+        }
+    }
+
+    instance_offset = instance_ring_unmap(&instances);
+    num_cars = num;
 }
 
 void ray_renderer_draw() {
+    if (num_cars == 0) return;
+
     shader_use(shader);
 
     GLint projLoc = shader_get_uniform(shader, "projection");
@@ -62,11 +82,20 @@ void ray_renderer_draw() {
     glUniform3f(colourLoc, 1.0f, 0.0f, 0.0f);
 
     glBindVertexArray(vao);
-    glDrawArrays(GL_LINES, 0, NUM_RAYS * 2);
+    glBindBuffer(GL_ARRAY_BUFFER, instances.vbo);
+    GLsizei stride = RAY_INSTANCE_FLOATS * sizeof(float);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)instance_offset);                      // x, y, heading
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, stride, (void*)(instance_offset + 3 * sizeof(float))); // rays 0-3
+    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, stride, (void*)(instance_offset + 7 * sizeof(float))); // rays 4-7
+    glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, stride, (void*)(instance_offset + 11 * sizeof(float))); // ray 8
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glDrawArraysInstanced(GL_LINES, 0, NUM_RAYS * 2, num_cars);
+    instance_ring_fence(&instances);
 }
 
 void ray_renderer_cleanup() {
     shader_clean_up(shader);
     glDeleteVertexArrays(1, &vao);
-    glDeleteBuffers(1, &vbo);
-}
\ No newline at end of file
+    instance_ring_cleanup(&instances);
+}
@@ -0,0 +1,481 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "soft_raster.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "ray_cast.h"
+#include "util.h"
+
+#define TILE_SIZE 64
+
+typedef enum {
+    PRIM_LINE,
+    PRIM_QUAD
+} PrimType;
+
+typedef struct {
+    PrimType type;
+    uint32_t colour;
+    float v[8];         // Screen-space vertices: 2 for a line, 4 for a quad
+    int x0, y0, x1, y1; // Inclusive pixel bounds, clamped to the image
+} Prim;
+
+struct SoftRaster {
+    int width;
+    int height;
+    uint32_t* pixels;
+    uint32_t* background; // NULL until soft_raster_save_background
+    uint32_t clear_colour;
+    float transformation_matrix[16];
+
+    Prim* prims;
+    int num_prims;
+    int prim_capacity;
+
+    // Primitives binned per tile, in draw order: tile t uses tile_prims[tile_start[t] .. tile_start[t + 1])
+    int tiles_x;
+    int tiles_y;
+    int* tile_start;
+    int* tile_prims;
+    int tile_prims_capacity;
+
+    // Workers render tiles alongside the calling thread in soft_raster_end
+    int num_workers;
+    pthread_t* workers;
+    pthread_mutex_t lock;
+    pthread_cond_t work_ready;
+    pthread_cond_t work_done;
+    int generation;
+    int busy_workers;
+    int shutdown;
+    atomic_int next_tile;
+};
+
+static void* worker_main(void* arg);
+static void render_tiles(SoftRaster* sr);
+static void render_tile(SoftRaster* sr, int tile);
+static void raster_line(SoftRaster* sr, const Prim* p, int tx0, int ty0, int tx1, int ty1);
+static void raster_quad(SoftRaster* sr, const Prim* p, int tx0, int ty0, int tx1, int ty1);
+static void bin_prims(SoftRaster* sr);
+static Prim* push_prim(SoftRaster* sr, PrimType type, const float* v, int num_vertices, uint32_t colour);
+static void project(const SoftRaster* sr, Point p, float* out);
+static uint32_t pack_colour(float r, float g, float b);
+
+SoftRaster* soft_raster_create(int width, int height, int num_threads) {
+    if (width <= 0 || height <= 0) {
+        return NULL;
+    }
+    if (num_threads <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        num_threads = cpus > 0 ? (int)cpus : 1;
+    }
+
+    SoftRaster* sr = xalloc(1, sizeof(SoftRaster));
+    sr->width = width;
+    sr->height = height;
+    sr->pixels = xalloc((size_t)width * height, sizeof(uint32_t));
+    create_transformation_matrix(sr->transformation_matrix, 0, 100, 0, 100);
+
+    sr->tiles_x = (width + TILE_SIZE - 1) / TILE_SIZE;
+    sr->tiles_y = (height + TILE_SIZE - 1) / TILE_SIZE;
+    sr->tile_start = xalloc(sr->tiles_x * sr->tiles_y + 1, sizeof(int));
+
+    pthread_mutex_init(&sr->lock, NULL);
+    pthread_cond_init(&sr->work_ready, NULL);
+    pthread_cond_init(&sr->work_done, NULL);
+
+    sr->workers = xalloc(num_threads, sizeof(pthread_t));
+    for (int i = 0; i < num_threads - 1; i++) {
+        if (pthread_create(&sr->workers[i], NULL, worker_main, sr) != 0) {
+            break; // Render with however many workers started
+        }
+        sr->num_workers++;
+    }
+    return sr;
+}
+
+void soft_raster_destroy(SoftRaster* sr) {
+    if (sr == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&sr->lock);
+    sr->shutdown = 1;
+    pthread_cond_broadcast(&sr->work_ready);
+    pthread_mutex_unlock(&sr->lock);
+    for (int i = 0; i < sr->num_workers; i++) {
+        pthread_join(sr->workers[i], NULL);
+    }
+
+    pthread_cond_destroy(&sr->work_done);
+    pthread_cond_destroy(&sr->work_ready);
+    pthread_mutex_destroy(&sr->lock);
+    free(sr->workers);
+    free(sr->tile_prims);
+    free(sr->tile_start);
+    free(sr->prims);
+    free(sr->background);
+    free(sr->pixels);
+    free(sr);
+}
+
+void soft_raster_begin(SoftRaster* sr, float r, float g, float b) {
+    sr->clear_colour = pack_colour(r, g, b);
+    sr->num_prims = 0;
+}
+
+void soft_raster_draw_track(SoftRaster* sr, const Track* track) {
+    // Same colours as track_renderer: white boundaries, red start line
+    uint32_t white = pack_colour(1.0f, 1.0f, 1.0f);
+    const Boundary* boundaries[2] = {&track->left_boundary, &track->right_boundary};
+
+    for (int side = 0; side < 2; side++) {
+        const Boundary* boundary = boundaries[side];
+        float v[4];
+        for (int i = 0; i + 1 < boundary->count; i++) {
+            project(sr, boundary->points[i], &v[0]);
+            project(sr, boundary->points[i + 1], &v[2]);
+            push_prim(sr, PRIM_LINE, v, 2, white);
+        }
+    }
+
+    soft_raster_draw_line(sr, track->start_segment.start, track->start_segment.end, 1.0f, 0.0f, 0.0f);
+}
+
+void soft_raster_draw_cars(SoftRaster* sr, int num, Car** cars) {
+    // Rectangle of car_renderer: half width along x, half length along y, rotated by the heading
+    static const float corners[4][2] = {
+        {-CAR_HALF_WIDTH, CAR_HALF_LENGTH}, {CAR_HALF_WIDTH, CAR_HALF_LENGTH},
+        {CAR_HALF_WIDTH, -CAR_HALF_LENGTH}, {-CAR_HALF_WIDTH, -CAR_HALF_LENGTH}
+    };
+    uint32_t cyan = pack_colour(0.0f, 1.0f, 1.0f);
+
+    for (int i = 0; i < num; i++) {
+        const Car* car = cars[i];
+        float c = cosf(car->heading);
+        float s = sinf(car->heading);
+        float v[8];
+        for (int k = 0; k < 4; k++) {
+            Point corner = {
+                .x = corners[k][0] * c - corners[k][1] * s + car->position.x,
+                .y = corners[k][0] * s + corners[k][1] * c + car->position.y
+            };
+            project(sr, corner, &v[k * 2]);
+        }
+        push_prim(sr, PRIM_QUAD, v, 4, cyan);
+    }
+}
+
+void soft_raster_draw_rays(SoftRaster* sr, int num, Car** cars) {
+    uint32_t red = pack_colour(1.0f, 0.0f, 0.0f);
+
+    for (int i = 0; i < num; i++) {
+        const Car* car = cars[i];
+        float v[4];
+        project(sr, car->position, &v[0]);
+        for (int j = 0; j < NUM_RAYS; j++) {
+            Point end = {
+                .x = car->position.x + car->ray_distances[j] * cosf(car->heading + RAY_ANGLES[j]),
+                .y = car->position.y + car->ray_distances[j] * sinf(car->heading + RAY_ANGLES[j])
+            };
+            project(sr, end, &v[2]);
+            push_prim(sr, PRIM_LINE, v, 2, red);
+        }
+    }
+}
+
+void soft_raster_draw_line(SoftRaster* sr, Point from, Point to, float r, float g, float b) {
+    float v[4];
+    project(sr, from, &v[0]);
+    project(sr, to, &v[2]);
+    push_prim(sr, PRIM_LINE, v, 2, pack_colour(r, g, b));
+}
+
+void soft_raster_end(SoftRaster* sr) {
+    bin_prims(sr);
+    atomic_store(&sr->next_tile, 0);
+
+    pthread_mutex_lock(&sr->lock);
+    sr->busy_workers = sr->num_workers;
+    sr->generation++;
+    pthread_cond_broadcast(&sr->work_ready);
+    pthread_mutex_unlock(&sr->lock);
+
+    render_tiles(sr);
+
+    pthread_mutex_lock(&sr->lock);
+    while (sr->busy_workers > 0) {
+        pthread_cond_wait(&sr->work_done, &sr->lock);
+    }
+    pthread_mutex_unlock(&sr->lock);
+}
+
+void soft_raster_save_background(SoftRaster* sr) {
+    size_t size = (size_t)sr->width * sr->height * sizeof(uint32_t);
+    if (sr->background == NULL) {
+        sr->background = xalloc(1, size);
+    }
+    memcpy(sr->background, sr->pixels, size);
+}
+
+const uint8_t* soft_raster_pixels(const SoftRaster* sr) {
+    return (const uint8_t*)sr->pixels;
+}
+
+int soft_raster_width(const SoftRaster* sr) {
+    return sr->width;
+}
+
+int soft_raster_height(const SoftRaster* sr) {
+    return sr->height;
+}
+
+static void* worker_main(void* arg) {
+    SoftRaster* sr = arg;
+    int seen_generation = 0;
+
+    pthread_mutex_lock(&sr->lock);
+    while (1) {
+        while (!sr->shutdown && sr->generation == seen_generation) {
+            pthread_cond_wait(&sr->work_ready, &sr->lock);
+        }
+        if (sr->shutdown) {
+            break;
+        }
+        seen_generation = sr->generation;
+        pthread_mutex_unlock(&sr->lock);
+
+        render_tiles(sr);
+
+        pthread_mutex_lock(&sr->lock);
+        if (--sr->busy_workers == 0) {
+            pthread_cond_signal(&sr->work_done);
+        }
+    }
+    pthread_mutex_unlock(&sr->lock);
+    return NULL;
+}
+
+static void render_tiles(SoftRaster* sr) {
+    int num_tiles = sr->tiles_x * sr->tiles_y;
+    int tile;
+    while ((tile = atomic_fetch_add(&sr->next_tile, 1)) < num_tiles) {
+        render_tile(sr, tile);
+    }
+}
+
+static void render_tile(SoftRaster* sr, int tile) {
+    int tx0 = (tile % sr->tiles_x) * TILE_SIZE;
+    int ty0 = (tile / sr->tiles_x) * TILE_SIZE;
+    int tx1 = tx0 + TILE_SIZE < sr->width ? tx0 + TILE_SIZE : sr->width;
+    int ty1 = ty0 + TILE_SIZE < sr->height ? ty0 + TILE_SIZE : sr->height;
+
+    // Clear (or restore the background) only inside this tile so no other thread touches it
+    for (int y = ty0; y < ty1; y++) {
+        uint32_t* row = sr->pixels + (size_t)y * sr->width;
+        if (sr->background) {
+            memcpy(row + tx0, sr->background + (size_t)y * sr->width + tx0, sizeof(uint32_t) * (tx1 - tx0));
+        } else {
+            for (int x = tx0; x < tx1; x++) row[x] = sr->clear_colour;
+        }
+    }
+
+    for (int i = sr->tile_start[tile]; i < sr->tile_start[tile + 1]; i++) {
+        const Prim* p = &sr->prims[sr->tile_prims[i]];
+        if (p->type == PRIM_LINE) {
+            raster_line(sr, p, tx0, ty0, tx1, ty1);
+        } else {
+            raster_quad(sr, p, tx0, ty0, tx1, ty1);
+        }
+    }
+}
+
+static void raster_line(SoftRaster* sr, const Prim* p, int tx0, int ty0, int tx1, int ty1) {
+    // One pixel per column (or row, for steep lines) at the pixel centre, evaluated from the
+    // whole line's equation so a line crossing several tiles has no seams between them
+    float ax = p->v[0], ay = p->v[1], bx = p->v[2], by = p->v[3];
+    int steep = fabsf(by - ay) > fabsf(bx - ax);
+    if (steep) {
+        // Walk along y: swap the roles of x and y
+        float t;
+        t = ax; ax = ay; ay = t;
+        t = bx; bx = by; by = t;
+    }
+    if (ax > bx) {
+        float t;
+        t = ax; ax = bx; bx = t;
+        t = ay; ay = by; by = t;
+    }
+
+    int major_lo = steep ? ty0 : tx0, major_hi = steep ? ty1 : tx1;
+    int minor_lo = steep ? tx0 : ty0, minor_hi = steep ? tx1 : ty1;
+
+    int first = (int)ceilf(ax - 0.5f);
+    int last = (int)floorf(bx - 0.5f);
+    if (first > last) {
+        // Shorter than a pixel along its major axis: draw the pixel under its midpoint
+        first = last = (int)floorf(0.5f * (ax + bx));
+    }
+    if (first < major_lo) first = major_lo;
+    if (last > major_hi - 1) last = major_hi - 1;
+
+    float slope = bx - ax > 0.0f ? (by - ay) / (bx - ax) : 0.0f;
+    for (int m = first; m <= last; m++) {
+        float f = ay + (m + 0.5f - ax) * slope;
+        if (f < minor_lo || f >= minor_hi) continue;
+        int n = (int)f; // f >= 0 here, so truncation is floor
+        int x = steep ? n : m;
+        int y = steep ? m : n;
+        sr->pixels[(size_t)y * sr->width + x] = p->colour;
+    }
+}
+
+static void raster_quad(SoftRaster* sr, const Prim* p, int tx0, int ty0, int tx1, int ty1) {
+    // Convex quad: a pixel is filled when its centre is on the inner side of all four edges.
+    // Each edge is the plane e(x, y) = a * x + b * y + c, oriented so the inside is e >= 0.
+    const float* v = p->v;
+    float area = 0.0f;
+    for (int k = 0; k < 4; k++) {
+        int n = (k + 1) % 4;
+        area += v[k * 2] * v[n * 2 + 1] - v[n * 2] * v[k * 2 + 1];
+    }
+    float sign = area < 0.0f ? -1.0f : 1.0f;
+
+    float ea[4], eb[4], ec[4], inv_ea[4];
+    for (int k = 0; k < 4; k++) {
+        int n = (k + 1) % 4;
+        float ex = v[n * 2] - v[k * 2];
+        float ey = v[n * 2 + 1] - v[k * 2 + 1];
+        ea[k] = -sign * ey;
+        eb[k] = sign * ex;
+        ec[k] = sign * (ey * v[k * 2] - ex * v[k * 2 + 1]);
+        inv_ea[k] = ea[k] != 0.0f ? 1.0f / ea[k] : 0.0f;
+    }
+
+    int x0 = p->x0 > tx0 ? p->x0 : tx0;
+    int y0 = p->y0 > ty0 ? p->y0 : ty0;
+    int x1 = p->x1 < tx1 - 1 ? p->x1 : tx1 - 1;
+    int y1 = p->y1 < ty1 - 1 ? p->y1 : ty1 - 1;
+
+    for (int y = y0; y <= y1; y++) {
+        // Intersect the four half-planes with this row of pixel centres to get one span
+        float py = y + 0.5f;
+        float lo = x0 + 0.5f, hi = x1 + 0.5f;
+        for (int k = 0; k < 4; k++) {
+            float row_e = eb[k] * py + ec[k];
+            if (ea[k] > 0.0f) {
+                lo = fmaxf(lo, -row_e * inv_ea[k]);
+            } else if (ea[k] < 0.0f) {
+                hi = fminf(hi, -row_e * inv_ea[k]);
+            } else if (row_e < 0.0f) {
+                hi = lo - 1.0f;
+            }
+        }
+        if (lo > hi) continue;
+
+        uint32_t* row = sr->pixels + (size_t)y * sr->width;
+        // lo - 0.5 >= x0 >= 0, so truncation is floor here
+        float first_f = lo - 0.5f;
+        int first = (int)first_f;
+        if (first < first_f) first++;
+        int last = (int)(hi - 0.5f);
+        for (int x = first; x <= last; x++) row[x] = p->colour;
+    }
+}
+
+static void bin_prims(SoftRaster* sr) {
+    // Counting sort of primitives into the tiles their bounds overlap, keeping draw order
+    int num_tiles = sr->tiles_x * sr->tiles_y;
+    int* count = sr->tile_start;
+    memset(count, 0, sizeof(int) * (num_tiles + 1));
+
+    for (int i = 0; i < sr->num_prims; i++) {
+        const Prim* p = &sr->prims[i];
+        for (int ty = p->y0 / TILE_SIZE; ty <= p->y1 / TILE_SIZE; ty++)
+            for (int tx = p->x0 / TILE_SIZE; tx <= p->x1 / TILE_SIZE; tx++)
+                count[ty * sr->tiles_x + tx + 1]++;
+    }
+    for (int t = 0; t < num_tiles; t++) {
+        count[t + 1] += count[t];
+    }
+
+    int total = sr->tile_start[num_tiles];
+    if (total > sr->tile_prims_capacity) {
+        free(sr->tile_prims);
+        sr->tile_prims_capacity = total * 2;
+        sr->tile_prims = xalloc(sr->tile_prims_capacity, sizeof(int));
+    }
+
+    // tile_start[t] is used as the fill cursor of tile t, then shifted back by one tile
+    for (int i = 0; i < sr->num_prims; i++) {
+        const Prim* p = &sr->prims[i];
+        for (int ty = p->y0 / TILE_SIZE; ty <= p->y1 / TILE_SIZE; ty++)
+            for (int tx = p->x0 / TILE_SIZE; tx <= p->x1 / TILE_SIZE; tx++)
+                sr->tile_prims[sr->tile_start[ty * sr->tiles_x + tx]++] = i;
+    }
+    for (int t = num_tiles; t > 0; t--) {
+        sr->tile_start[t] = sr->tile_start[t - 1];
+    }
+    sr->tile_start[0] = 0;
+}
+
+static Prim* push_prim(SoftRaster* sr, PrimType type, const float* v, int num_vertices, uint32_t colour) {
+    float min_x = v[0], max_x = v[0], min_y = v[1], max_y = v[1];
+    for (int k = 1; k < num_vertices; k++) {
+        min_x = fminf(min_x, v[k * 2]);
+        max_x = fmaxf(max_x, v[k * 2]);
+        min_y = fminf(min_y, v[k * 2 + 1]);
+        max_y = fmaxf(max_y, v[k * 2 + 1]);
+    }
+    // Entirely off screen (also rejects NaN coordinates)
+    if (!(max_x >= 0.0f && max_y >= 0.0f && min_x < sr->width && min_y < sr->height)) {
+        return NULL;
+    }
+
+    if (sr->num_prims == sr->prim_capacity) {
+        int capacity = sr->prim_capacity ? sr->prim_capacity * 2 : 1024;
+        Prim* grown = xalloc(capacity, sizeof(Prim));
+        if (sr->num_prims > 0) {
+            memcpy(grown, sr->prims, sizeof(Prim) * sr->num_prims);
+        }
+        free(sr->prims);
+        sr->prims = grown;
+        sr->prim_capacity = capacity;
+    }
+
+    Prim* p = &sr->prims[sr->num_prims++];
+    p->type = type;
+    p->colour = colour;
+    memcpy(p->v, v, sizeof(float) * 2 * num_vertices);
+    p->x0 = min_x > 0.0f ? (int)min_x : 0;
+    p->y0 = min_y > 0.0f ? (int)min_y : 0;
+    p->x1 = max_x < sr->width - 1 ? (int)max_x : sr->width - 1;
+    p->y1 = max_y < sr->height - 1 ? (int)max_y : sr->height - 1;
+    return p;
+}
+
+static void project(const SoftRaster* sr, Point p, float* out) {
+    // Same column-major matrix the GL shaders use, then NDC to pixels with the y axis flipped
+    // so row 0 is the top of the image
+    const float* M = sr->transformation_matrix;
+    float ndc_x = M[0] * p.x + M[4] * p.y + M[12];
+    float ndc_y = M[1] * p.x + M[5] * p.y + M[13];
+    out[0] = (ndc_x + 1.0f) * 0.5f * sr->width;
+    out[1] = (1.0f - ndc_y) * 0.5f * sr->height;
+}
+
+static uint32_t pack_colour(float r, float g, float b) {
+    // Bytes in R, G, B, A order in memory whatever the host endianness
+    uint8_t rgba[4] = {
+        (uint8_t)(fminf(fmaxf(r, 0.0f), 1.0f) * 255.0f + 0.5f),
+        (uint8_t)(fminf(fmaxf(g, 0.0f), 1.0f) * 255.0f + 0.5f),
+        (uint8_t)(fminf(fmaxf(b, 0.0f), 1.0f) * 255.0f + 0.5f),
+        255
+    };
+    uint32_t colour;
+    memcpy(&colour, rgba, sizeof(colour));
+    return colour;
+}
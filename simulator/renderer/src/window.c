@@ -2,7 +2,9 @@
 #include <stdio.h>
 
 static GLFWwindow* window;
+static WindowKeyHandler key_handler = NULL;
 static void framebuffer_size_callback(GLFWwindow* w, int width, int height);
+static void key_callback(GLFWwindow* w, int key, int scancode, int action, int mods);
 
 int window_init(int width, int height, const char* title) {
     if (glfwInit() == GLFW_FALSE) {
@@ -38,10 +40,23 @@ int window_init(int width, int height, const char* title) {
     int fb_width, fb_height;
     glfwGetFramebufferSize(window, &fb_width, &fb_height);
     glViewport(0, 0, fb_width, fb_height);
+    glfwSetKeyCallback(window, key_callback);
 
     return 0;
 }
 
+void window_set_key_handler(WindowKeyHandler handler) {
+    key_handler = handler;
+}
+
+void window_set_title(const char* title) {
+    glfwSetWindowTitle(window, title);
+}
+
+void window_close(void) {
+    glfwSetWindowShouldClose(window, GLFW_TRUE);
+}
+
 int window_should_close(void) {
     return glfwWindowShouldClose(window);
 }
@@ -59,4 +74,13 @@ void window_cleanup(void) {
 static void framebuffer_size_callback(GLFWwindow* w, int width, int height) {
     (void) w;
     glViewport(0, 0, width, height);
+}
+
+static void key_callback(GLFWwindow* w, int key, int scancode, int action, int mods) {
+    (void) w;
+    (void) scancode;
+    (void) mods;
+    if (key_handler && (action == GLFW_PRESS || action == GLFW_REPEAT)) {
+        key_handler(key);
+    }
 }
\ No newline at end of file
@@ -0,0 +1,490 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "bvh.h"
+#include "car.h"
+#include "car_internals.h"
+#include "nn.h"
+#include "philox.h"
+#include "physics.h"
+#include "physics_constants.h"
+#include "quad_tree.h"
+#include "ray_cast.h"
+#include "track_collision.h"
+#include "track_internals.h"
+#include "track_loader.h"
+#include "util.h"
+
+// Microbenchmarks of the sim hot paths on generated tracks of several sizes.
+//   make bench && ./bench [--json out.json] [--filter name] [--quick]
+//
+// Every benchmark is warmed up, then timed as a series of samples of a fixed number of ops
+// (chosen so a sample lasts about SAMPLE_SECONDS); the table shows the median and p99 of the
+// per-op time over the samples. --json writes the same numbers for regression tracking.
+// The bvh_* benchmarks repeat the ray and region ones on a BVH of the same track; setup checks
+// that both indexes (and cast_ray_fan) return the same distances and segment counts on every
+// pose first.
+
+#define SAMPLE_SECONDS   0.0002 // Target length of one timed sample
+#define BENCH_SECONDS    0.5    // Target time spent sampling one benchmark
+#define MIN_SAMPLES      11
+#define MAX_SAMPLES      500
+#define WARMUP_SECONDS   0.05
+#define NUM_POSES        4096   // Car poses cycled through by the per-pose benchmarks
+#define MAX_RESULTS      MAX_COLLISION_CHECKS
+
+static const int TRACK_SIZES[] = {100, 1000, 10000, 100000}; // Points per boundary
+
+typedef struct {
+    int track_points;
+    const char* track_path;
+    Track* track;
+    QuadTreeNode* tree;
+    Bvh* bvh;
+    Point positions[NUM_POSES];
+    float headings[NUM_POSES];
+    Network nn;
+    float inputs[NUM_POSES][NN_INPUT];
+} BenchContext;
+
+typedef void (*BenchFn)(BenchContext* ctx, long ops);
+
+typedef struct {
+    const char* name;
+    BenchFn fn;
+    int per_track; // Run once per track size (else once, on the smallest track)
+} Benchmark;
+
+typedef struct {
+    const char* name;
+    int track_points;
+    long ops_per_sample;
+    int samples;
+    double median_ns;
+    double p99_ns;
+    double mean_ns;
+} BenchResult;
+
+static volatile float sink; // Keeps results alive so the timed work is not optimized away
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static float uniform(uint32_t* state) {
+    *state = *state * 1664525u + 1013904223u;
+    return (*state >> 8) * (1.0f / 16777216.0f);
+}
+
+// --- Benchmarks -------------------------------------------------------------------------------
+
+static void bench_cast_ray(BenchContext* ctx, long ops) {
+    float total = 0.0f;
+    for (long i = 0; i < ops; i++) {
+        int p = i % NUM_POSES;
+        total += cast_ray(ctx->tree, ctx->positions[p], ctx->headings[p], MAX_RAY_DISTANCE).distance;
+    }
+    sink = total;
+}
+
+static void bench_ray_fan(BenchContext* ctx, long ops) {
+    float total = 0.0f;
+    for (long i = 0; i < ops; i++) {
+        int p = i % NUM_POSES;
+        for (int j = 0; j < NUM_RAYS; j++) {
+            total += cast_ray(ctx->tree, ctx->positions[p], ctx->headings[p] + RAY_ANGLES[j], MAX_RAY_DISTANCE).distance;
+        }
+    }
+    sink = total;
+}
+
+static void bench_cast_ray_fan(BenchContext* ctx, long ops) {
+    float distances[NUM_RAYS];
+    float total = 0.0f;
+    for (long i = 0; i < ops; i++) {
+        int p = i % NUM_POSES;
+        cast_ray_fan(ctx->tree, ctx->positions[p], ctx->headings[p], MAX_RAY_DISTANCE, distances);
+        total += distances[0];
+    }
+    sink = total;
+}
+
+static void bench_query_region(BenchContext* ctx, long ops) {
+    // The region check_car_collision asks for: the car's box padded by 2.5 on each side
+    struct BoundarySegment results[MAX_RESULTS];
+    int total = 0;
+    for (long i = 0; i < ops; i++) {
+        Point p = ctx->positions[i % NUM_POSES];
+        Bounds region = {p.x - 3.5f, p.y - 3.5f, p.x + 3.5f, p.y + 3.5f};
+        int count = 0;
+        query_region(ctx->tree, &region, results, &count, MAX_RESULTS);
+        total += count;
+    }
+    sink = (float)total;
+}
+
+static void bench_bvh_cast_ray(BenchContext* ctx, long ops) {
+    float total = 0.0f;
+    for (long i = 0; i < ops; i++) {
+        int p = i % NUM_POSES;
+        total += bvh_cast_ray(ctx->bvh, ctx->positions[p], ctx->headings[p], MAX_RAY_DISTANCE).distance;
+    }
+    sink = total;
+}
+
+static void bench_bvh_ray_fan(BenchContext* ctx, long ops) {
+    float total = 0.0f;
+    for (long i = 0; i < ops; i++) {
+        int p = i % NUM_POSES;
+        for (int j = 0; j < NUM_RAYS; j++) {
+            total += bvh_cast_ray(ctx->bvh, ctx->positions[p], ctx->headings[p] + RAY_ANGLES[j], MAX_RAY_DISTANCE).distance;
+        }
+    }
+    sink = total;
+}
+
+static void bench_bvh_query_region(BenchContext* ctx, long ops) {
+    struct BoundarySegment results[MAX_RESULTS];
+    int total = 0;
+    for (long i = 0; i < ops; i++) {
+        Point p = ctx->positions[i % NUM_POSES];
+        Bounds region = {p.x - 3.5f, p.y - 3.5f, p.x + 3.5f, p.y + 3.5f};
+        int count = 0;
+        bvh_query_region(ctx->bvh, &region, results, &count, MAX_RESULTS);
+        total += count;
+    }
+    sink = (float)total;
+}
+
+static void bench_check_car_collision(BenchContext* ctx, long ops) {
+    Car* car = create_car(ctx->positions[0], ctx->headings[0]);
+    int total = 0;
+    for (long i = 0; i < ops; i++) {
+        int p = i % NUM_POSES;
+        car->position = ctx->positions[p];
+        car->heading = ctx->headings[p];
+        car->is_alive = true;
+        total += check_car_collision(car, ctx->tree);
+    }
+    sink = (float)total;
+    destroy_car(car);
+}
+
+static void bench_update_car_physics(BenchContext* ctx, long ops) {
+    Car* car = create_car(ctx->positions[0], ctx->headings[0]);
+    for (long i = 0; i < ops; i++) {
+        if ((i & 1023) == 0) {
+            reset_car(car, ctx->positions[0], ctx->headings[0]);
+        }
+        update_car_physics(car, 0.5f, (i & 64) ? 0.2f : -0.2f, 1.0f);
+    }
+    sink = car->position.x;
+    destroy_car(car);
+}
+
+static void bench_update_furthest_point_index(BenchContext* ctx, long ops) {
+    // The progress update done by sim_env_step after every move
+    int furthest = 0;
+    for (long i = 0; i < ops; i++) {
+        int nearest = nearest_left_segment_index(ctx->track, ctx->tree, ctx->positions[i % NUM_POSES]);
+        if (nearest > furthest) furthest = nearest;
+    }
+    sink = (float)furthest;
+}
+
+static void bench_nn_forward(BenchContext* ctx, long ops) {
+    float output[NN_OUTPUT];
+    float total = 0.0f;
+    for (long i = 0; i < ops; i++) {
+        nn_forward(&ctx->nn, ctx->inputs[i % NUM_POSES], output);
+        total += output[0];
+    }
+    sink = total;
+}
+
+static void bench_philox_normals(BenchContext* ctx, long ops) {
+    (void)ctx;
+    float noise[NN_OUTPUT];
+    float total = 0.0f;
+    for (long i = 0; i < ops; i++) {
+        philox_normals(1, 0, (uint32_t)i, 0, noise, NN_OUTPUT);
+        total += noise[0];
+    }
+    sink = total;
+}
+
+static void bench_load_track(BenchContext* ctx, long ops) {
+    for (long i = 0; i < ops; i++) {
+        Track* track = load_track(ctx->track_path);
+        sink = track->total_length;
+        free_track(track);
+    }
+}
+
+static void bench_build_track_quadtree(BenchContext* ctx, long ops) {
+    for (long i = 0; i < ops; i++) {
+        QuadTreeNode* tree = build_track_quadtree(ctx->track);
+        sink = tree->bounds.max_x;
+        free_quadtree(tree);
+    }
+}
+
+static void bench_build_track_bvh(BenchContext* ctx, long ops) {
+    for (long i = 0; i < ops; i++) {
+        Bvh* bvh = build_track_bvh(ctx->track);
+        sink = bvh->bounds.max_x;
+        free_bvh(bvh);
+    }
+}
+
+static const Benchmark BENCHMARKS[] = {
+    {"cast_ray", bench_cast_ray, 1},
+    {"ray_fan", bench_ray_fan, 1},
+    {"cast_ray_fan", bench_cast_ray_fan, 1},
+    {"query_region", bench_query_region, 1},
+    {"check_car_collision", bench_check_car_collision, 1},
+    {"update_furthest_point_index", bench_update_furthest_point_index, 1},
+    {"load_track", bench_load_track, 1},
+    {"build_track_quadtree", bench_build_track_quadtree, 1},
+    {"bvh_cast_ray", bench_bvh_cast_ray, 1},
+    {"bvh_ray_fan", bench_bvh_ray_fan, 1},
+    {"bvh_query_region", bench_bvh_query_region, 1},
+    {"build_track_bvh", bench_build_track_bvh, 1},
+    {"update_car_physics", bench_update_car_physics, 0},
+    {"nn_forward", bench_nn_forward, 0},
+    {"philox_normals", bench_philox_normals, 0},
+};
+
+// --- Harness ----------------------------------------------------------------------------------
+
+static BenchResult run_benchmark(const Benchmark* bench, BenchContext* ctx, double time_scale) {
+    // Calibrate ops per sample, doubling until a sample takes SAMPLE_SECONDS; doubles as warmup
+    long ops = 1;
+    double elapsed = 0.0;
+    double warmup_end = now_seconds() + WARMUP_SECONDS * time_scale;
+    while (1) {
+        double start = now_seconds();
+        bench->fn(ctx, ops);
+        elapsed = now_seconds() - start;
+        if (elapsed >= SAMPLE_SECONDS && now_seconds() >= warmup_end) break;
+        if (elapsed < SAMPLE_SECONDS) ops *= 2;
+    }
+
+    int samples = (int)(BENCH_SECONDS * time_scale / elapsed);
+    if (samples < MIN_SAMPLES) samples = MIN_SAMPLES;
+    if (samples > MAX_SAMPLES) samples = MAX_SAMPLES;
+
+    double* times = xalloc(samples, sizeof(double));
+    double total = 0.0;
+    for (int i = 0; i < samples; i++) {
+        double start = now_seconds();
+        bench->fn(ctx, ops);
+        times[i] = (now_seconds() - start) / ops * 1e9;
+        total += times[i];
+    }
+    qsort(times, samples, sizeof(double), compare_doubles);
+
+    BenchResult result = {
+        .name = bench->name,
+        .track_points = bench->per_track ? ctx->track_points : 0,
+        .ops_per_sample = ops,
+        .samples = samples,
+        .median_ns = times[samples / 2],
+        .p99_ns = times[(int)ceil(samples * 0.99) - 1],
+        .mean_ns = total / samples
+    };
+    free(times);
+    return result;
+}
+
+static int write_track(const char* path, int points) {
+    // A 350 degree arc of a wavy ring, boundary points 0.2 apart like the drawn tracks
+    const float width = 5.0f;
+    float radius = points * 0.2f / (2.0f * PI) + 20.0f;
+    FILE* file = fopen(path, "w");
+    if (file == NULL) {
+        fprintf(stderr, "Failed to write %s\n", path);
+        return 1;
+    }
+
+    float cx = radius + 10.0f, cy = radius + 10.0f;
+    float sweep = 2.0f * PI * 350.0f / 360.0f;
+    fprintf(file, "WIDTH %.1f\nSEGMENTS 1\n\nSEGMENT 0\nCONTROL_POINTS 4\n", width);
+    for (int i = 0; i < 4; i++) {
+        float a = sweep * i / 3.0f;
+        fprintf(file, "%.6f %.6f\n", cx + radius * cosf(a), cy + radius * sinf(a));
+    }
+    for (int side = 0; side < 2; side++) {
+        fprintf(file, "\n%s %d\n", side == 0 ? "LEFT_BOUNDARY" : "RIGHT_BOUNDARY", points);
+        for (int i = 0; i < points; i++) {
+            float a = sweep * i / (points - 1);
+            float r = radius + 3.0f * sinf(a * 40.0f) + (side == 0 ? width / 2 : -width / 2);
+            fprintf(file, "%.6f %.6f\n", cx + r * cosf(a), cy + r * sinf(a));
+        }
+    }
+    fclose(file);
+    return 0;
+}
+
+static int check_equivalence(BenchContext* ctx) {
+    // The BVH and cast_ray_fan must answer exactly like the quad tree, or their timings mean nothing
+    struct BoundarySegment tree_results[MAX_RESULTS], bvh_results[MAX_RESULTS];
+    for (int i = 0; i < NUM_POSES; i++) {
+        float fan[NUM_RAYS];
+        cast_ray_fan(ctx->tree, ctx->positions[i], ctx->headings[i], MAX_RAY_DISTANCE, fan);
+        for (int j = 0; j < NUM_RAYS; j++) {
+            float direction = ctx->headings[i] + RAY_ANGLES[j];
+            float expected = cast_ray(ctx->tree, ctx->positions[i], direction, MAX_RAY_DISTANCE).distance;
+            float actual = bvh_cast_ray(ctx->bvh, ctx->positions[i], direction, MAX_RAY_DISTANCE).distance;
+            if (actual != expected) {
+                fprintf(stderr, "BVH ray mismatch at pose %d ray %d: %f vs %f\n", i, j, actual, expected);
+                return 1;
+            }
+            if (fan[j] != expected) {
+                fprintf(stderr, "cast_ray_fan mismatch at pose %d ray %d: %f vs %f\n", i, j, fan[j], expected);
+                return 1;
+            }
+        }
+
+        Point p = ctx->positions[i];
+        Bounds region = {p.x - 3.5f, p.y - 3.5f, p.x + 3.5f, p.y + 3.5f};
+        int tree_count = 0, bvh_count = 0;
+        query_region(ctx->tree, &region, tree_results, &tree_count, MAX_RESULTS);
+        bvh_query_region(ctx->bvh, &region, bvh_results, &bvh_count, MAX_RESULTS);
+        if (tree_count != bvh_count) {
+            fprintf(stderr, "BVH query mismatch at pose %d: %d vs %d segments\n", i, bvh_count, tree_count);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int setup_context(BenchContext* ctx, int points, const char* path) {
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->track_points = points;
+    ctx->track_path = path;
+    if (write_track(path, points) != 0) {
+        return 1;
+    }
+    ctx->track = load_track(path);
+    if (ctx->track == NULL) {
+        return 1;
+    }
+    ctx->tree = build_track_quadtree(ctx->track);
+
+    // Poses on the track between the boundaries, heading roughly along it
+    uint32_t state = 12345u;
+    const Boundary* left = &ctx->track->left_boundary;
+    const Boundary* right = &ctx->track->right_boundary;
+    for (int i = 0; i < NUM_POSES; i++) {
+        int k = (int)(uniform(&state) * (left->count - 1));
+        float t = 0.2f + 0.6f * uniform(&state);
+        Point l = left->points[k], r = right->points[k];
+        ctx->positions[i].x = l.x + (r.x - l.x) * t;
+        ctx->positions[i].y = l.y + (r.y - l.y) * t;
+        Point next = left->points[k + 1];
+        ctx->headings[i] = atan2f(next.y - l.y, next.x - l.x) + (uniform(&state) - 0.5f);
+        for (int j = 0; j < NN_INPUT; j++) {
+            ctx->inputs[i][j] = uniform(&state) * 2.0f - 1.0f;
+        }
+    }
+    float* weights = (float*)&ctx->nn;
+    for (size_t i = 0; i < sizeof(Network) / sizeof(float); i++) {
+        weights[i] = (uniform(&state) - 0.5f) * 0.5f;
+    }
+
+    ctx->bvh = build_track_bvh(ctx->track);
+    if (ctx->bvh == NULL) {
+        return 1;
+    }
+    return check_equivalence(ctx);
+}
+
+static void free_context(BenchContext* ctx) {
+    free_bvh(ctx->bvh);
+    free_quadtree(ctx->tree);
+    free_track(ctx->track);
+    remove(ctx->track_path);
+}
+
+int main(int argc, char** argv) {
+    const char* json_path = NULL;
+    const char* filter = NULL;
+    double time_scale = 1.0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            json_path = argv[++i];
+        } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (strcmp(argv[i], "--quick") == 0) {
+            time_scale = 0.1;
+        } else {
+            fprintf(stderr, "Usage: %s [--json out.json] [--filter name] [--quick]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    int num_sizes = sizeof(TRACK_SIZES) / sizeof(TRACK_SIZES[0]);
+    int num_benchmarks = sizeof(BENCHMARKS) / sizeof(BENCHMARKS[0]);
+    BenchResult* results = xalloc((size_t)num_sizes * num_benchmarks, sizeof(BenchResult));
+    int num_results = 0;
+
+    printf("%-30s %8s %12s %12s %12s %8s\n", "benchmark", "points", "median ns", "p99 ns", "mean ns", "samples");
+    for (int s = 0; s < num_sizes; s++) {
+        char path[64];
+        snprintf(path, sizeof(path), "/tmp/bench_track_%d.txt", TRACK_SIZES[s]);
+        BenchContext* ctx = xalloc(1, sizeof(BenchContext));
+        if (setup_context(ctx, TRACK_SIZES[s], path) != 0) {
+            fprintf(stderr, "Failed to set up track with %d points\n", TRACK_SIZES[s]);
+            free(ctx);
+            free(results);
+            return 1;
+        }
+
+        for (int b = 0; b < num_benchmarks; b++) {
+            const Benchmark* bench = &BENCHMARKS[b];
+            if (!bench->per_track && s > 0) continue;
+            if (filter != NULL && strstr(bench->name, filter) == NULL) continue;
+
+            BenchResult r = run_benchmark(bench, ctx, time_scale);
+            results[num_results++] = r;
+            printf("%-30s %8d %12.1f %12.1f %12.1f %8d\n", r.name, r.track_points, r.median_ns, r.p99_ns, r.mean_ns, r.samples);
+            fflush(stdout);
+        }
+        free_context(ctx);
+        free(ctx);
+    }
+
+    if (json_path != NULL) {
+        FILE* file = fopen(json_path, "w");
+        if (file == NULL) {
+            fprintf(stderr, "Failed to write %s\n", json_path);
+            free(results);
+            return 1;
+        }
+        fprintf(file, "{\n  \"benchmarks\": [\n");
+        for (int i = 0; i < num_results; i++) {
+            const BenchResult* r = &results[i];
+            fprintf(file, "    {\"name\": \"%s\", \"track_points\": %d, \"median_ns\": %.2f, \"p99_ns\": %.2f, "
+                          "\"mean_ns\": %.2f, \"samples\": %d, \"ops_per_sample\": %ld}%s\n",
+                    r->name, r->track_points, r->median_ns, r->p99_ns, r->mean_ns, r->samples, r->ops_per_sample,
+                    i + 1 < num_results ? "," : "");
+        }
+        fprintf(file, "  ]\n}\n");
+        fclose(file);
+    }
+
+    free(results);
+    return 0;
+}
@@ -0,0 +1,60 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "philox.h"
+#include "util.h"
+
+// Throughput of philox normals, one car at a time vs. a batch of cars per call
+//   make bench_rng && ./bench_rng
+
+#define NUM_CARS 4096
+#define NORMALS_PER_CAR 2 // One action per step
+#define NUM_STEPS 200
+#define NUM_RUNS 7
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static double run(int batched, float* out) {
+    double start = now_seconds();
+    for (uint32_t step = 0; step < NUM_STEPS; step++) {
+        if (batched) {
+            philox_normals_batch(1234, 0, step, 0, NUM_CARS, NORMALS_PER_CAR, out);
+        } else {
+            for (uint32_t car = 0; car < NUM_CARS; car++) {
+                philox_normals(1234, 0, step, car, &out[car * NORMALS_PER_CAR], NORMALS_PER_CAR);
+            }
+        }
+    }
+    return now_seconds() - start;
+}
+
+int main(void) {
+    float* out = xalloc(NUM_CARS * NORMALS_PER_CAR, sizeof(float));
+    const char* names[2] = {"per car", "batched"};
+    double normals = (double)NUM_CARS * NORMALS_PER_CAR * NUM_STEPS;
+
+    for (int batched = 0; batched < 2; batched++) {
+        double times[NUM_RUNS];
+        run(batched, out); // Warmup
+        for (int i = 0; i < NUM_RUNS; i++) {
+            times[i] = run(batched, out);
+        }
+        qsort(times, NUM_RUNS, sizeof(double), compare_doubles);
+        printf("%-8s %7.1f M normals/s  (%.2f ns/normal, median of %d)\n",
+               names[batched], normals / times[NUM_RUNS / 2] / 1e6, times[NUM_RUNS / 2] / normals * 1e9, NUM_RUNS);
+    }
+
+    free(out);
+    return 0;
+}
@@ -0,0 +1,407 @@
+#include "bvh.h"
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "det_math.h"
+#include "sim_stats.h"
+#include "util.h"
+
+#define TRAVERSAL_COST    1.0f // Relative to one ray vs. segment test
+#define INTERSECTION_COST 1.0f
+
+// Binary tree produced by the SAH build, collapsed into BvhNodes afterwards
+typedef struct {
+    Bounds bounds;
+    int left;  // -1 for a leaf
+    int right;
+    int first; // Leaf: range in the builder's order array
+    int count;
+} BuildNode;
+
+typedef struct {
+    BuildNode* nodes;
+    int node_count;
+    Bounds* segment_bounds;
+    Point* centroids;
+    int* order; // Segment indices, partitioned in place as the tree is built
+} Builder;
+
+typedef struct {
+    int node;
+    float t; // Entry distance of the ray into the node
+} StackEntry;
+
+static int build_node(Builder* builder, int first, int count);
+static int collapse_node(const Builder* builder, int build_index, Bvh* bvh, int depth);
+
+// Plain compares rather than fminf/fmaxf, which are library calls unless NaN handling is relaxed
+static inline float min_f(float a, float b) { return a < b ? a : b; }
+static inline float max_f(float a, float b) { return a > b ? a : b; }
+
+static Bounds empty_bounds(void) {
+    Bounds b = {FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX};
+    return b;
+}
+
+static void grow_bounds(Bounds* b, const Bounds* other) {
+    b->min_x = min_f(b->min_x, other->min_x);
+    b->min_y = min_f(b->min_y, other->min_y);
+    b->max_x = max_f(b->max_x, other->max_x);
+    b->max_y = max_f(b->max_y, other->max_y);
+}
+
+static float half_perimeter(const Bounds* b) {
+    // The 2D stand-in for surface area: proportional to the chance a random line crosses the box
+    return (b->max_x - b->min_x) + (b->max_y - b->min_y);
+}
+
+Bvh* build_track_bvh(const Track* track) {
+    // Same segment set as build_track_quadtree: both boundaries plus the start line
+    int left_count = track->left_boundary.count - 1;
+    int right_count = track->right_boundary.count - 1;
+    int total_segments = left_count + right_count + 1;
+
+    Bvh* bvh = xalloc(1, sizeof(Bvh));
+    struct BoundarySegment* all_segments = xalloc(total_segments, sizeof(struct BoundarySegment));
+    memcpy(all_segments, track->left_boundary_segments, left_count * sizeof(struct BoundarySegment));
+    memcpy(all_segments + left_count, track->right_boundary_segments, right_count * sizeof(struct BoundarySegment));
+    all_segments[left_count + right_count] = track->start_segment;
+
+    Builder builder;
+    builder.nodes = xalloc(2 * total_segments - 1, sizeof(BuildNode)); // A binary tree over n leaves has at most 2n - 1 nodes
+    builder.node_count = 0;
+    builder.segment_bounds = xalloc(total_segments, sizeof(Bounds));
+    builder.centroids = xalloc(total_segments, sizeof(Point));
+    builder.order = xalloc(total_segments, sizeof(int));
+    for (int i = 0; i < total_segments; i++) {
+        Point ends[2] = {all_segments[i].start, all_segments[i].end};
+        builder.segment_bounds[i] = calculateBounds(ends, 2);
+        builder.centroids[i].x = (ends[0].x + ends[1].x) * 0.5f;
+        builder.centroids[i].y = (ends[0].y + ends[1].y) * 0.5f;
+        builder.order[i] = i;
+    }
+
+    int root = build_node(&builder, 0, total_segments);
+
+    bvh->segment_count = total_segments;
+    bvh->segments = xalloc(total_segments, sizeof(struct BoundarySegment));
+    for (int i = 0; i < total_segments; i++) {
+        bvh->segments[i] = all_segments[builder.order[i]];
+    }
+    bvh->bounds = builder.nodes[root].bounds;
+    bvh->nodes = xalloc(total_segments, sizeof(BvhNode)); // Fewer than one 4-wide node per segment
+    bvh->node_count = 0;
+    bvh->depth = 0;
+    collapse_node(&builder, root, bvh, 1);
+
+    free(builder.nodes);
+    free(builder.segment_bounds);
+    free(builder.centroids);
+    free(builder.order);
+    free(all_segments);
+
+    // Each level leaves at most BVH_WIDTH - 1 siblings on the stack while its nearest child is walked
+    if ((BVH_WIDTH - 1) * bvh->depth + 1 > BVH_STACK_SIZE) {
+        fprintf(stderr, "build_track_bvh: tree depth %d overflows the %d-entry traversal stack\n", bvh->depth, BVH_STACK_SIZE);
+        free_bvh(bvh);
+        return NULL;
+    }
+    return bvh;
+}
+
+void free_bvh(Bvh* bvh) {
+    if (!bvh) {
+        return;
+    }
+    free(bvh->nodes);
+    free(bvh->segments);
+    free(bvh);
+}
+
+static int build_node(Builder* builder, int first, int count) {
+    int index = builder->node_count++;
+    BuildNode* node = &builder->nodes[index];
+    node->left = node->right = -1;
+    node->first = first;
+    node->count = count;
+
+    Bounds bounds = empty_bounds();
+    Bounds centroid_bounds = empty_bounds();
+    for (int i = first; i < first + count; i++) {
+        int s = builder->order[i];
+        grow_bounds(&bounds, &builder->segment_bounds[s]);
+        Bounds c = {builder->centroids[s].x, builder->centroids[s].y, builder->centroids[s].x, builder->centroids[s].y};
+        grow_bounds(&centroid_bounds, &c);
+    }
+    node->bounds = bounds;
+    if (count == 1) {
+        return index;
+    }
+
+    // Binned SAH: bin the centroids along each axis, try a split between every pair of bins
+    float parent_area = half_perimeter(&bounds);
+    float best_cost = FLT_MAX;
+    int best_axis = -1;
+    int best_bin = 0;
+    for (int axis = 0; axis < 2; axis++) {
+        float lo = axis == 0 ? centroid_bounds.min_x : centroid_bounds.min_y;
+        float hi = axis == 0 ? centroid_bounds.max_x : centroid_bounds.max_y;
+        if (hi - lo <= 0.0f) continue;
+
+        Bounds bin_bounds[BVH_SAH_BINS];
+        int bin_count[BVH_SAH_BINS] = {0};
+        for (int b = 0; b < BVH_SAH_BINS; b++) bin_bounds[b] = empty_bounds();
+
+        float scale = BVH_SAH_BINS / (hi - lo);
+        for (int i = first; i < first + count; i++) {
+            int s = builder->order[i];
+            float c = axis == 0 ? builder->centroids[s].x : builder->centroids[s].y;
+            int b = (int)((c - lo) * scale);
+            if (b >= BVH_SAH_BINS) b = BVH_SAH_BINS - 1;
+            bin_count[b]++;
+            grow_bounds(&bin_bounds[b], &builder->segment_bounds[s]);
+        }
+
+        // Sweep from the right for the area and count of everything past each split
+        float right_area[BVH_SAH_BINS];
+        int right_count[BVH_SAH_BINS];
+        Bounds acc = empty_bounds();
+        int acc_count = 0;
+        for (int b = BVH_SAH_BINS - 1; b > 0; b--) {
+            grow_bounds(&acc, &bin_bounds[b]);
+            acc_count += bin_count[b];
+            right_area[b] = acc_count ? half_perimeter(&acc) : 0.0f;
+            right_count[b] = acc_count;
+        }
+
+        acc = empty_bounds();
+        acc_count = 0;
+        for (int b = 0; b < BVH_SAH_BINS - 1; b++) {
+            grow_bounds(&acc, &bin_bounds[b]);
+            acc_count += bin_count[b];
+            if (acc_count == 0 || right_count[b + 1] == 0) continue;
+            float cost = TRAVERSAL_COST + INTERSECTION_COST *
+                         (half_perimeter(&acc) * acc_count + right_area[b + 1] * right_count[b + 1]) / parent_area;
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_axis = axis;
+                best_bin = b;
+            }
+        }
+    }
+
+    // Stay a leaf when splitting would not pay for the extra traversal
+    if (count <= BVH_MAX_LEAF_SIZE && (best_axis < 0 || best_cost >= INTERSECTION_COST * count)) {
+        return index;
+    }
+
+    int mid;
+    if (best_axis < 0) {
+        // All centroids coincide, so no bin split exists; halve the range to respect the leaf size
+        mid = first + count / 2;
+    } else {
+        float lo = best_axis == 0 ? centroid_bounds.min_x : centroid_bounds.min_y;
+        float hi = best_axis == 0 ? centroid_bounds.max_x : centroid_bounds.max_y;
+        float scale = BVH_SAH_BINS / (hi - lo);
+        int i = first, j = first + count - 1;
+        while (i <= j) {
+            int s = builder->order[i];
+            float c = best_axis == 0 ? builder->centroids[s].x : builder->centroids[s].y;
+            int b = (int)((c - lo) * scale);
+            if (b >= BVH_SAH_BINS) b = BVH_SAH_BINS - 1;
+            if (b <= best_bin) {
+                i++;
+            } else {
+                builder->order[i] = builder->order[j];
+                builder->order[j--] = s;
+            }
+        }
+        mid = i;
+    }
+
+    int left = build_node(builder, first, mid - first);
+    int right = build_node(builder, mid, first + count - mid);
+    node = &builder->nodes[index];
+    node->left = left;
+    node->right = right;
+    return index;
+}
+
+static int collapse_node(const Builder* builder, int build_index, Bvh* bvh, int depth) {
+    // Pulls grandchildren up until the node has BVH_WIDTH lanes, opening the largest inner child first.
+    // depth is this node's level (the root is 1); the deepest one is kept in bvh->depth.
+    const BuildNode* build = &builder->nodes[build_index];
+    int lanes[BVH_WIDTH];
+    int lane_count = 0;
+    if (build->left < 0) {
+        lanes[lane_count++] = build_index; // Whole tree is one leaf
+    } else {
+        lanes[lane_count++] = build->left;
+        lanes[lane_count++] = build->right;
+    }
+
+    while (lane_count < BVH_WIDTH) {
+        int open = -1;
+        float open_area = -1.0f;
+        for (int i = 0; i < lane_count; i++) {
+            const BuildNode* lane = &builder->nodes[lanes[i]];
+            if (lane->left >= 0 && half_perimeter(&lane->bounds) > open_area) {
+                open = i;
+                open_area = half_perimeter(&lane->bounds);
+            }
+        }
+        if (open < 0) break;
+        const BuildNode* opened = &builder->nodes[lanes[open]];
+        lanes[open] = opened->left;
+        lanes[lane_count++] = opened->right;
+    }
+
+    if (depth > bvh->depth) bvh->depth = depth;
+    int index = bvh->node_count++;
+    BvhNode* node = &bvh->nodes[index]; // Preallocated, so recursion below does not move it
+    for (int i = 0; i < BVH_WIDTH; i++) {
+        if (i >= lane_count) {
+            node->min_x[i] = node->min_y[i] = node->max_x[i] = node->max_y[i] = FLT_MAX;
+            node->child[i] = -1;
+            node->first_segment[i] = 0;
+            node->segment_count[i] = 0;
+            continue;
+        }
+
+        const BuildNode* lane = &builder->nodes[lanes[i]];
+        node->min_x[i] = lane->bounds.min_x;
+        node->min_y[i] = lane->bounds.min_y;
+        node->max_x[i] = lane->bounds.max_x;
+        node->max_y[i] = lane->bounds.max_y;
+        if (lane->left < 0) {
+            node->child[i] = -1;
+            node->first_segment[i] = lane->first;
+            node->segment_count[i] = lane->count;
+        } else {
+            node->first_segment[i] = 0;
+            node->segment_count[i] = 0;
+            node->child[i] = collapse_node(builder, lanes[i], bvh, depth + 1);
+        }
+    }
+    return index;
+}
+
+RayHit bvh_cast_ray(const Bvh* bvh, Point origin, float direction, float max_distance) {
+    RayHit result = {.hit = 0, .distance = max_distance};
+    float dx = sim_cosf(direction);
+    float dy = sim_sinf(direction);
+
+    // An axis-parallel ray gets a huge reciprocal: the slab then spans everything or nothing
+    float inv_dx = fabsf(dx) > 1e-10f ? 1.0f / dx : 1e30f;
+    float inv_dy = fabsf(dy) > 1e-10f ? 1.0f / dy : 1e30f;
+
+    StackEntry stack[BVH_STACK_SIZE];
+    int top = 0;
+    stack[top++] = (StackEntry){0, 0.0f};
+
+    while (top > 0) {
+        StackEntry entry = stack[--top];
+        if (entry.t > result.distance) continue;
+
+        const BvhNode* node = &bvh->nodes[entry.node];
+        SIM_STATS_ADD(ray_nodes_visited, 1);
+        SIM_STATS_ADD(ray_aabb_tests, BVH_WIDTH);
+
+        // Slab test of all four lanes at once
+        float t_near[BVH_WIDTH];
+        int hit_mask = 0;
+        for (int i = 0; i < BVH_WIDTH; i++) {
+            float tx1 = (node->min_x[i] - origin.x) * inv_dx;
+            float tx2 = (node->max_x[i] - origin.x) * inv_dx;
+            float ty1 = (node->min_y[i] - origin.y) * inv_dy;
+            float ty2 = (node->max_y[i] - origin.y) * inv_dy;
+            float tmin = max_f(max_f(min_f(tx1, tx2), min_f(ty1, ty2)), 0.0f);
+            float tmax = min_f(min_f(max_f(tx1, tx2), max_f(ty1, ty2)), result.distance);
+            t_near[i] = tmin;
+            hit_mask |= (tmax >= tmin) << i;
+        }
+
+        // Visit lanes nearest first: leaves now, inner nodes pushed so the nearest pops next
+        int sorted[BVH_WIDTH];
+        int hits = 0;
+        for (int i = 0; i < BVH_WIDTH; i++) {
+            if (!(hit_mask & (1 << i))) continue;
+            int j = hits++;
+            while (j > 0 && t_near[sorted[j - 1]] > t_near[i]) {
+                sorted[j] = sorted[j - 1];
+                j--;
+            }
+            sorted[j] = i;
+        }
+
+        for (int k = hits - 1; k >= 0; k--) {
+            int lane = sorted[k];
+            if (node->child[lane] >= 0) { // build_track_bvh checked the depth, so the stack has room
+                stack[top++] = (StackEntry){node->child[lane], t_near[lane]};
+            }
+        }
+
+        for (int k = 0; k < hits; k++) {
+            int lane = sorted[k];
+            if (node->segment_count[lane] == 0 || t_near[lane] > result.distance) continue;
+            const struct BoundarySegment* segments = &bvh->segments[node->first_segment[lane]];
+            SIM_STATS_ADD(ray_segment_tests, node->segment_count[lane]);
+            for (int s = 0; s < node->segment_count[lane]; s++) {
+                // Same arithmetic as ray_segment_intersection, so distances match cast_ray exactly
+                float sx = segments[s].end.x - segments[s].start.x;
+                float sy = segments[s].end.y - segments[s].start.y;
+                float determinant = dx * sy - dy * sx;
+                if (fabsf(determinant) < 1e-10f) continue;
+
+                float t = ((segments[s].start.x - origin.x) * sy - (segments[s].start.y - origin.y) * sx) / determinant;
+                float u = ((segments[s].start.x - origin.x) * dy - (segments[s].start.y - origin.y) * dx) / determinant;
+                if (t >= 0 && u >= 0 && u <= 1 && t < result.distance) {
+                    result.hit = 1;
+                    result.distance = t;
+                    result.point.x = origin.x + t * dx;
+                    result.point.y = origin.y + t * dy;
+                }
+            }
+        }
+    }
+
+    return result;
+}
+
+void bvh_query_region(const Bvh* bvh, Bounds* region, struct BoundarySegment* results, int* count, int max_results) {
+    // Appends the segments passing segmentIntersectsBound, up to max_results; no duplicates to
+    // filter since every segment lives in one leaf
+    int stack[BVH_STACK_SIZE];
+    int top = 0;
+    stack[top++] = 0;
+
+    while (top > 0) {
+        const BvhNode* node = &bvh->nodes[stack[--top]];
+        SIM_STATS_ADD(query_nodes_visited, 1);
+
+        int overlap_mask = 0;
+        for (int i = 0; i < BVH_WIDTH; i++) {
+            int outside = (node->max_x[i] < region->min_x) | (region->max_x < node->min_x[i]) |
+                          (node->max_y[i] < region->min_y) | (region->max_y < node->min_y[i]);
+            overlap_mask |= !outside << i;
+        }
+
+        for (int i = 0; i < BVH_WIDTH; i++) {
+            if (!(overlap_mask & (1 << i))) continue;
+            if (node->child[i] >= 0) {
+                stack[top++] = node->child[i];
+                continue;
+            }
+
+            struct BoundarySegment* segments = &bvh->segments[node->first_segment[i]];
+            SIM_STATS_ADD(query_segment_tests, node->segment_count[i]);
+            for (int s = 0; s < node->segment_count[i]; s++) {
+                if (!segmentIntersectsBound(region, &segments[s])) continue;
+                if (*count >= max_results) return;
+                results[(*count)++] = segments[s];
+            }
+        }
+    }
+}
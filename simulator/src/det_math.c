@@ -0,0 +1,75 @@
+#include "det_math.h"
+#include <stdint.h>
+
+// pi/2 split into three parts whose leading bits make k * PIO2_1 and k * PIO2_2 exact for the
+// k reached below 1e5, as in Cody-Waite reduction
+#define TWO_OVER_PI 0.636619772367581343f
+#define PIO2_1 1.5703125f
+#define PIO2_2 4.837512969970703125e-4f
+#define PIO2_3 7.54978995489188216e-8f
+
+// Minimax polynomials on [-pi/4, pi/4] (Cephes sinf / cosf)
+static float sin_poly(float r) {
+    float r2 = r * r;
+    return r + r * r2 * (-1.6666654611e-1f + r2 * (8.3321608736e-3f + r2 * -1.9515295891e-4f));
+}
+
+static float cos_poly(float r) {
+    float r2 = r * r;
+    return 1.0f - 0.5f * r2 + r2 * r2 * (4.166664568298827e-2f + r2 * (-1.388731625493765e-3f + r2 * 2.443315711809948e-5f));
+}
+
+// Reduces x to r in [-pi/4, pi/4] with x = r + k * pi/2; returns k mod 4
+static int reduce(float x, float* r) {
+    float q = x * TWO_OVER_PI;
+    int32_t k = (int32_t)(q >= 0.0f ? q + 0.5f : q - 0.5f);
+    float kf = (float)k;
+    *r = ((x - kf * PIO2_1) - kf * PIO2_2) - kf * PIO2_3;
+    return k & 3;
+}
+
+float det_sinf(float x) {
+    float r;
+    switch (reduce(x, &r)) {
+        case 0: return sin_poly(r);
+        case 1: return cos_poly(r);
+        case 2: return -sin_poly(r);
+        default: return -cos_poly(r);
+    }
+}
+
+float det_cosf(float x) {
+    float r;
+    switch (reduce(x, &r)) {
+        case 0: return cos_poly(r);
+        case 1: return -sin_poly(r);
+        case 2: return -cos_poly(r);
+        default: return sin_poly(r);
+    }
+}
+
+float det_fmodf(float x, float y) {
+    // Subtracts multiples of y * 2^k, each a multiple of y, so every step keeps the remainder.
+    // k is chosen so the quotient is below 2^29: q * t then fits a double's 53 bits and
+    // ax - q * t is exact. Quotients under 2^29 (all the sim uses) take one pass with k = 0;
+    // larger ones lose up to 28 bits of exponent per pass. The fix-ups handle a quotient that
+    // rounded up across an integer.
+    double ax = fabs((double)x);
+    double ay = fabs((double)y);
+    if (ax < ay) {
+        return x;
+    }
+    int ey;
+    frexp(ay, &ey);
+    while (ax >= ay) {
+        int ex;
+        frexp(ax, &ex);
+        double t = ex - ey > 28 ? ldexp(ay, ex - ey - 28) : ay;
+        double q = (double)(int64_t)(ax / t);
+        double r = ax - q * t;
+        if (r < 0) r += t;
+        if (r >= t) r -= t;
+        ax = r;
+    }
+    return (float)(x < 0 ? -ax : ax);
+}
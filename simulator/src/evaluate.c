@@ -0,0 +1,226 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "track_loader.h"
+#include "track_internals.h"
+#include "track_binary.h"
+#include "track_collision.h"
+#include "quad_tree.h"
+#include "car.h"
+#include "nn.h"
+#include "philox.h"
+#include "policy_loop.h"
+#include "soft_raster.h"
+#include "frame_writer.h"
+#include "trace.h"
+
+// Headless policy evaluation: runs the visualizer's loop (policy_step) with no window or
+// OpenGL, as fast as the CPU allows, and prints one JSON line of metrics per episode.
+// The policy is deterministic, so every episode would be the same run: --sigma adds Gaussian
+// noise to the actions as in training, from Philox keyed by (seed, episode, step), and the
+// episodes then sample the policy's success rate. Without it a single episode is run.
+// With --frames, every step is also drawn by the CPU rasterizer and streamed to a video file.
+// Usage: ./evaluate [--track path] [--weights path] [--episodes n] [--sigma s] [--seed n] [--max-steps n] [--dt s]
+//                   [--start x y heading] [--frames path.y4m|.ppm|.rgba] [--size pixels] [--fps n] [--threads n] [--trace out.json]
+// --trace records a Chrome trace-event timeline of every episode, step phase and frame.
+
+#define DEFAULT_EPISODES  10 // With --sigma; one otherwise
+#define DEFAULT_MAX_STEPS 1000 // Episode cap of sim_step
+#define DEFAULT_DT        1.0f // Time step of sim_step, which the policy is trained on
+#define DEFAULT_FRAME_SIZE 600 // Same as the visualizer window
+#define DEFAULT_FPS        60
+
+static const char* OUTCOME_NAMES[] = {"timeout", "crashed", "finished"};
+
+static double now_seconds(void);
+
+int main(int argc, char** argv) {
+    const char* track_path = "tracks/track_001.txt";
+    const char* weights_path = "../python/weights.bin";
+    int episodes = DEFAULT_EPISODES;
+    float sigma = 0.0f;
+    uint64_t seed = 1;
+    int max_steps = DEFAULT_MAX_STEPS;
+    float dt = DEFAULT_DT;
+    Point start_point = {.x = 12.5f, .y = 16.1f};
+    float start_heading = 0.0f;
+    const char* frames_path = NULL;
+    int frame_size = DEFAULT_FRAME_SIZE;
+    int fps = DEFAULT_FPS;
+    int threads = 0;
+    const char* trace_path = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--track") == 0 && i + 1 < argc) {
+            track_path = argv[++i];
+        } else if (strcmp(argv[i], "--weights") == 0 && i + 1 < argc) {
+            weights_path = argv[++i];
+        } else if (strcmp(argv[i], "--episodes") == 0 && i + 1 < argc) {
+            episodes = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--sigma") == 0 && i + 1 < argc) {
+            sigma = strtof(argv[++i], NULL);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--max-steps") == 0 && i + 1 < argc) {
+            max_steps = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--dt") == 0 && i + 1 < argc) {
+            dt = strtof(argv[++i], NULL);
+        } else if (strcmp(argv[i], "--start") == 0 && i + 3 < argc) {
+            start_point.x = strtof(argv[++i], NULL);
+            start_point.y = strtof(argv[++i], NULL);
+            start_heading = strtof(argv[++i], NULL);
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            frames_path = argv[++i];
+        } else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+            frame_size = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc) {
+            fps = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            trace_path = argv[++i];
+        } else {
+            fprintf(stderr, "Usage: %s [--track path] [--weights path] [--episodes n] [--sigma s] [--seed n] [--max-steps n] [--dt s] "
+                            "[--start x y heading] [--frames path] [--size pixels] [--fps n] [--threads n] [--trace path]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (sigma <= 0.0f && episodes > 1) {
+        fprintf(stderr, "Without --sigma every episode is the same run; evaluating one\n");
+        episodes = 1;
+    }
+
+    QuadTreeNode* tree = NULL;
+    Track* track;
+    if (track_is_binary(track_path)) {
+        track = load_track_binary(track_path, &tree);
+    } else {
+        track = load_track(track_path);
+        if (track) tree = build_track_quadtree(track);
+    }
+    if (track == NULL) {
+        fprintf(stderr, "Failed to load track: %s\n", track_path);
+        return 1;
+    }
+
+    Network nn;
+    if (nn_load(&nn, weights_path) != 0) {
+        fprintf(stderr, "Failed to load neural network weights: %s\n", weights_path);
+        free_quadtree(tree);
+        free_track(track);
+        return 1;
+    }
+
+    SoftRaster* raster = NULL;
+    FrameWriter* frames = NULL;
+    if (frames_path) {
+        raster = soft_raster_create(frame_size, frame_size, threads);
+        frames = raster ? frame_writer_open(frames_path, frame_size, frame_size, fps) : NULL;
+        if (frames == NULL) {
+            soft_raster_destroy(raster);
+            free_quadtree(tree);
+            free_track(track);
+            return 1;
+        }
+        // The track never changes: rasterize it once and start every frame from it
+        soft_raster_begin(raster, 0.2f, 0.3f, 0.3f);
+        soft_raster_draw_track(raster, track);
+        soft_raster_end(raster);
+        soft_raster_save_background(raster);
+    }
+
+    if (trace_path && trace_start(trace_path) != 0) {
+        soft_raster_destroy(raster);
+        free_quadtree(tree);
+        free_track(track);
+        return 1;
+    }
+    trace_set_thread_name("evaluate");
+
+    Car* car = create_car(start_point, start_heading);
+    int finished = 0;
+    long total_steps = 0;
+    double start_time = now_seconds();
+
+    for (int episode = 0; episode < episodes; episode++) {
+        reset_car(car, start_point, start_heading);
+        policy_cast_rays(car, tree);
+
+        double episode_start = now_seconds();
+        uint64_t episode_trace = trace_begin();
+        PolicyStatus status = POLICY_RUNNING;
+        int steps = 0;
+        int furthest = 0;
+
+        while (status == POLICY_RUNNING && steps < max_steps) {
+            if (sigma > 0.0f) {
+                float noise[NN_OUTPUT];
+                philox_normals(seed, (uint32_t)episode, (uint32_t)steps, 0, noise, NN_OUTPUT);
+                for (int i = 0; i < NN_OUTPUT; i++) noise[i] *= sigma;
+                status = policy_step_noisy(&nn, car, track, tree, dt, noise);
+            } else {
+                status = policy_step(&nn, car, track, tree, dt);
+            }
+            steps++;
+
+            if (frames) {
+                uint64_t frame_trace = trace_begin();
+                soft_raster_begin(raster, 0.2f, 0.3f, 0.3f);
+                soft_raster_draw_cars(raster, 1, &car);
+                soft_raster_draw_rays(raster, 1, &car);
+                soft_raster_end(raster);
+                frame_writer_write(frames, soft_raster_pixels(raster));
+                trace_end("render_frame", frame_trace);
+            }
+
+            int nearest = nearest_left_segment_index(track, tree, car->position);
+            if (nearest > furthest) furthest = nearest;
+        }
+
+        trace_end("episode", episode_trace);
+        double episode_time = now_seconds() - episode_start;
+        float progress = track->total_length > 0 ? track->cumulative_length[furthest] / track->total_length : 0.0f;
+        if (status == POLICY_FINISHED) {
+            progress = 1.0f;
+            finished++;
+        }
+        total_steps += steps;
+
+        printf("{\"episode\": %d, \"outcome\": \"%s\", \"steps\": %d, \"sim_time\": %.3f, "
+               "\"distance\": %.3f, \"progress\": %.4f, \"wall_ms\": %.3f}\n",
+               episode, OUTCOME_NAMES[status], steps, car->time_alive,
+               car->total_distance_traveled, progress, episode_time * 1e3);
+    }
+
+    double elapsed = now_seconds() - start_time;
+    printf("{\"summary\": true, \"episodes\": %d, \"sigma\": %.3f, \"finished\": %d, \"success_rate\": %.4f, "
+           "\"total_steps\": %ld, \"steps_per_sec\": %.0f}\n",
+           episodes, sigma, finished, episodes > 0 ? (double)finished / episodes : 0.0,
+           total_steps, elapsed > 0 ? total_steps / elapsed : 0.0);
+
+    int exit_code = 0;
+    if (trace_path && trace_stop() != 0) {
+        fprintf(stderr, "Failed to write trace: %s\n", trace_path);
+        exit_code = 1;
+    }
+    if (frames && frame_writer_close(frames) != 0) {
+        fprintf(stderr, "Failed to write frames: %s\n", frames_path);
+        exit_code = 1;
+    }
+    soft_raster_destroy(raster);
+    destroy_car(car);
+    free_quadtree(tree);
+    free_track(track);
+    return exit_code;
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
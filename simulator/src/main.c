@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include "window.h"
 #include "shader.h"
@@ -11,65 +12,173 @@
 #include "quad_tree.h"
 #include "util.h"
 #include "track_collision.h"
+#include "track_binary.h"
 #include "nn.h"
 #include "physics_constants.h"
+#include "policy_loop.h"
+#include "sim_runner.h"
+#include "trajectory.h"
+#include "replay.h"
 
 #define DT 0.01f
 
+// Usage: ./simulator [--population n] [--sigma s] [--seed n]
+//        ./simulator --replay file.traj [--track path]
+// With a population, n cars drive the same policy with Gaussian action noise of std sigma
+// (as in a training batch) and are coloured by how far along the track they got. The noise is
+// a function of (seed, restart, step, car), so a given seed replays the same run.
+// The sim runs at a fixed DT on its own thread; keys change its speed relative to wall time:
+//   Right / Up: faster   Left / Down: slower   1: real time   Space: pause   Esc: quit
+// --replay plays back a recording made with sim_record_start (see replay.c for its keys) on the
+// track it was recorded on, unless --track names another.
+
 static const Point  START_POINT   = {.x = 12.5f, .y = 16.1f};
 static const float  START_HEADING = 0.0f;
+static const float  SPEED_STEPS[] = {1, 2, 5, 10, 20, 50, 100, 200, 500, 1000};
 static QuadTreeNode* tree;
+static SimRunner* runner;
+
+static void handle_key(int key);
+static void update_title(void);
+
+int main(int argc, char** argv) {
+    int population = 1;
+    float sigma = 0.0f;
+    uint64_t seed = 0;
+    const char* replay_path = NULL;
+    const char* track_path = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--population") == 0 && i + 1 < argc) {
+            population = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--sigma") == 0 && i + 1 < argc) {
+            sigma = strtof(argv[++i], NULL);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replay_path = argv[++i];
+        } else if (strcmp(argv[i], "--track") == 0 && i + 1 < argc) {
+            track_path = argv[++i];
+        } else {
+            fprintf(stderr, "Usage: %s [--population n] [--sigma s] [--seed n]\n"
+                            "       %s --replay file.traj [--track path]\n", argv[0], argv[0]);
+            return 1;
+        }
+    }
+    if (population < 1) population = 1;
 
-static void cast_rays(Car* car);
-static void get_state_from_car(Car* car, float* state);
+    const char* filename = "tracks/track_001.txt";
+    TrajectoryReader* reader = NULL;
+    if (replay_path != NULL) {
+        reader = trajectory_reader_open(replay_path);
+        if (reader == NULL) {
+            return 1;
+        }
+        if (trajectory_reader_step_count(reader) == 0) {
+            fprintf(stderr, "No steps recorded in %s\n", replay_path);
+            trajectory_reader_close(reader);
+            return 1;
+        }
+        const char* recorded_track = trajectory_reader_header(reader)->track_path;
+        if (recorded_track[0] != '\0') filename = recorded_track;
+        population = 1;
+    }
+    if (track_path != NULL) filename = track_path;
 
-int main(void) {
     if (window_init(WINDOW_WIDTH, WINDOW_HEIGHT, WINDOW_TITLE) == -1) {
+        trajectory_reader_close(reader);
         return 1;
     }
 
-    const char* filename = "tracks/track_001.txt";
-    Track* track = load_track(filename);
+    // Recordings store the registry's path, which may be a compiled .trk
+    Track* track;
+    if (track_is_binary(filename)) {
+        track = load_track_binary(filename, &tree);
+    } else {
+        track = load_track(filename);
+        if (track) tree = build_track_quadtree(track);
+    }
     if (track == NULL) {
         fprintf(stderr, "Failed to load track: %s\n", filename);
+        trajectory_reader_close(reader);
         window_cleanup();
         return 1;
     }
 
     if (track_renderer_init(&track->left_boundary, &track->right_boundary, &track->start_segment)) {
         fprintf(stderr, "Failed to init track renderer\n");
+        free_quadtree(tree);
         free_track(track);
+        trajectory_reader_close(reader);
         window_cleanup();
         return 1;
     }
 
-    tree = build_track_quadtree(track);
-
-    Car* car = create_car(START_POINT, START_HEADING);
+    // Interpolated copies of the sim thread's cars, refreshed every frame
+    Car* display = xalloc(population, sizeof(Car));
+    Car** cars = xalloc(population, sizeof(Car*));
+    Car** alive_cars = xalloc(population, sizeof(Car*));
+    PolicyStatus* status = xalloc(population, sizeof(PolicyStatus));
+    float* fitness = xalloc(population, sizeof(float));
+    for (int i = 0; i < population; i++) {
+        cars[i] = &display[i];
+    }
 
-    if (car_renderer_init(1)) {
+    if (car_renderer_init(population)) {
         fprintf(stderr, "Failed to init car renderer\n");
-        destroy_car(car);
+        free(display);
+        free(cars);
+        free(alive_cars);
+        free(status);
+        free(fitness);
         free_quadtree(tree);
+        free_track(track);
+        trajectory_reader_close(reader);
         track_renderer_cleanup();
         window_cleanup();
         return 1;
     }
 
-    if (ray_renderer_init()) {
+    if (ray_renderer_init(population)) {
         fprintf(stderr, "Failed to init ray renderer\n");
-        destroy_car(car);
+        free(display);
+        free(cars);
+        free(alive_cars);
+        free(status);
+        free(fitness);
         free_quadtree(tree);
+        free_track(track);
+        trajectory_reader_close(reader);
         car_renderer_cleanup();
         track_renderer_cleanup();
         window_cleanup();
         return 1;
     }
 
+    if (reader != NULL) {
+        replay_run(reader);
+        trajectory_reader_close(reader);
+        ray_renderer_cleanup();
+        car_renderer_cleanup();
+        track_renderer_cleanup();
+        free_quadtree(tree);
+        free_track(track);
+        free(display);
+        free(cars);
+        free(alive_cars);
+        free(status);
+        free(fitness);
+        window_cleanup();
+        return 0;
+    }
+
     Network nn;
     if (nn_load(&nn, "../python/weights.bin") != 0) {
         fprintf(stderr, "Failed to load neural network weights\n");
-        destroy_car(car);
+        free(display);
+        free(cars);
+        free(alive_cars);
+        free(status);
+        free(fitness);
         free_quadtree(tree);
         free_track(track);
         ray_renderer_cleanup();
@@ -79,72 +188,108 @@ int main(void) {
         return 1;
     }
 
+    SimRunnerConfig config = {
+        .nn = &nn,
+        .track = track,
+        .tree = tree,
+        .start_point = START_POINT,
+        .start_heading = START_HEADING,
+        .population = population,
+        .sigma = sigma,
+        .seed = seed,
+        .dt = DT
+    };
+    runner = sim_runner_create(&config);
+    if (runner == NULL) {
+        fprintf(stderr, "Failed to start simulation thread\n");
+        free(display);
+        free(cars);
+        free(alive_cars);
+        free(status);
+        free(fitness);
+        free_quadtree(tree);
+        free_track(track);
+        ray_renderer_cleanup();
+        car_renderer_cleanup();
+        track_renderer_cleanup();
+        window_cleanup();
+        return 1;
+    }
+    window_set_key_handler(handle_key);
+    update_title();
+
     while (!window_should_close()) {
-        Point finish_pt   = track->left_boundary.points[track->left_boundary.count - 1];
-        Point finish_prev = track->left_boundary.points[track->left_boundary.count - 2];
-        float dir_x = finish_pt.x - finish_prev.x;
-        float dir_y = finish_pt.y - finish_prev.y;
-        float to_car_x = car->position.x - finish_pt.x;
-        float to_car_y = car->position.y - finish_pt.y;
-        float len = sqrtf(dir_x * dir_x + dir_y * dir_y);
-        float norm_x = dir_x / len;
-        float norm_y = dir_y / len;
-        float forward = to_car_x * norm_x + to_car_y * norm_y;
-        float lateral = to_car_x * (-norm_y) + to_car_y * norm_x;
-        int success = forward >= 0.0f && fabsf(lateral) < 5.0f;
-        if (!car->is_alive || success) {
-            reset_car(car, START_POINT, START_HEADING);
-        }
+        sim_runner_interpolate(runner, display, status, fitness);
 
         glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT);
 
-        cast_rays(car);
+        // Only the cars that are still driving show their rays
+        int num_alive = 0;
+        for (int i = 0; i < population; i++) {
+            if (status[i] == POLICY_RUNNING) alive_cars[num_alive++] = cars[i];
+        }
 
-        car_renderer_update(1, &car);
+        car_renderer_update(population, cars, population > 1 ? fitness : NULL);
         car_renderer_draw();
 
         track_renderer_draw();
 
-        ray_renderer_update(car);
+        ray_renderer_update(num_alive, alive_cars);
         ray_renderer_draw();
 
-        float state[12];
-        get_state_from_car(car, state);
-
-        float action[2];
-        nn_forward(&nn, state, action);
-        update_car_physics(car, action[0] + car->acceleration, action[1] + car->heading, DT);
-
-        cast_rays(car);
-        check_car_collision(car, tree);
-
         window_swap_and_poll();
     }
 
+    sim_runner_destroy(runner);
     track_renderer_cleanup();
     car_renderer_cleanup();
     ray_renderer_cleanup();
     free_quadtree(tree);
     free_track(track);
-    destroy_car(car);
+    free(display);
+    free(cars);
+    free(alive_cars);
+    free(status);
+    free(fitness);
     window_cleanup();
 
     return 0;
 }
 
-static void cast_rays(Car* car) {
-    for (int j = 0; j < NUM_RAYS; j++) {
-        car->ray_distances[j] = cast_ray(
-            tree, car->position, car->heading + RAY_ANGLES[j], MAX_RAY_DISTANCE
-        ).distance;
+static void handle_key(int key) {
+    int num_steps = sizeof(SPEED_STEPS) / sizeof(SPEED_STEPS[0]);
+    float speed = sim_runner_get_speed(runner);
+    int step = 0;
+    while (step + 1 < num_steps && SPEED_STEPS[step + 1] <= speed) step++;
+
+    switch (key) {
+        case GLFW_KEY_RIGHT:
+        case GLFW_KEY_UP:
+            if (step + 1 < num_steps) sim_runner_set_speed(runner, SPEED_STEPS[step + 1]);
+            break;
+        case GLFW_KEY_LEFT:
+        case GLFW_KEY_DOWN:
+            if (step > 0) sim_runner_set_speed(runner, SPEED_STEPS[step - 1]);
+            break;
+        case GLFW_KEY_1:
+            sim_runner_set_speed(runner, 1.0f);
+            break;
+        case GLFW_KEY_SPACE:
+            sim_runner_set_paused(runner, !sim_runner_is_paused(runner));
+            break;
+        case GLFW_KEY_ESCAPE:
+            window_close();
+            return;
+        default:
+            return;
     }
+    update_title();
 }
 
-static void get_state_from_car(Car* car, float* state) {
-    for (int i = 0; i < NUM_RAYS; i++)
-        state[i] = car->ray_distances[i] / MAX_RAY_DISTANCE;
-    state[9]  = car->speed / MAX_FORWARD_SPEED;
-    state[10] = car->acceleration / MAX_ACCELERATION;
-    state[11] = car->steering_angle / MAX_STEERING_ANGLE;
+static void update_title(void) {
+    char title[128];
+    snprintf(title, sizeof(title), "%s - %gx%s", WINDOW_TITLE, sim_runner_get_speed(runner),
+             sim_runner_is_paused(runner) ? " (paused)" : "");
+    window_set_title(title);
 }
@@ -1,6 +1,19 @@
 #include "nn.h"
+#include "philox.h"
+#include "util.h"
 #include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INIT_EPISODE 0xFFFFFFFFu // Philox episode of the initial weights; trainers count from 0
+
+static void hidden_forward(const Network* nn, const float* input, float* h1, float* h2);
+static void output_forward(const Network* nn, const float* h2, float* output);
+static void layer_backward(int n, int out_dim, int in_dim, const float* w, const float* a_in, const float* a_out,
+                           float* dz, float* dw, float* db, float* da_in);
+static void backward_batch(Network* nn, const ValueHead* head, const NNBatchCache* cache, const float* dL_da3, const float* dL_dv,
+                           Network* grads, ValueHead* head_grads);
 
 int nn_load(Network* nn, const char* path) {
     FILE* f = fopen(path, "rb");
@@ -17,9 +30,114 @@ int nn_load(Network* nn, const char* path) {
     return 0;
 }
 
+int nn_save(const Network* nn, const char* path) {
+    // Same layout nn_load reads and file_save.py writes
+    FILE* f = fopen(path, "wb");
+    if (!f) return -1;
+
+    size_t written = fwrite(nn->w1, sizeof(nn->w1), 1, f) + fwrite(nn->b1, sizeof(nn->b1), 1, f) +
+                     fwrite(nn->w2, sizeof(nn->w2), 1, f) + fwrite(nn->b2, sizeof(nn->b2), 1, f) +
+                     fwrite(nn->w3, sizeof(nn->w3), 1, f) + fwrite(nn->b3, sizeof(nn->b3), 1, f);
+
+    if (fclose(f) != 0 || written != 6) return -1;
+    return 0;
+}
+
+void nn_init_random(Network* nn, uint64_t seed) {
+    // N(0, sqrt(1 / fan_in)) weights and zero biases, like NeuralNetwork in network.py
+    memset(nn, 0, sizeof(*nn));
+    struct { float* w; int count; int fan_in; } layers[] = {
+        {&nn->w1[0][0], NN_H1 * NN_INPUT, NN_INPUT},
+        {&nn->w2[0][0], NN_H2 * NN_H1, NN_H1},
+        {&nn->w3[0][0], NN_OUTPUT * NN_H2, NN_H2},
+    };
+    for (int l = 0; l < 3; l++) {
+        philox_normals(seed, INIT_EPISODE, 0, (uint32_t)l, layers[l].w, layers[l].count);
+        float scale = sqrtf(1.0f / layers[l].fan_in);
+        for (int k = 0; k < layers[l].count; k++) layers[l].w[k] *= scale;
+    }
+}
+
 void nn_forward(Network* nn, float* input, float* output) {
     float h1[NN_H1], h2[NN_H2];
+    hidden_forward(nn, input, h1, h2);
+    output_forward(nn, h2, output);
+}
+
+void nn_batch_cache_init(NNBatchCache* cache, int capacity) {
+    cache->count = 0;
+    cache->a0 = xalloc((size_t)capacity * NN_INPUT, sizeof(float));
+    cache->a1 = xalloc((size_t)capacity * NN_H1, sizeof(float));
+    cache->a2 = xalloc((size_t)capacity * NN_H2, sizeof(float));
+    cache->a3 = xalloc((size_t)capacity * NN_OUTPUT, sizeof(float));
+}
+
+void nn_batch_cache_free(NNBatchCache* cache) {
+    free(cache->a0);
+    free(cache->a1);
+    free(cache->a2);
+    free(cache->a3);
+    cache->a0 = cache->a1 = cache->a2 = cache->a3 = NULL;
+    cache->count = 0;
+}
+
+void nn_forward_cached(Network* nn, float* input, NNBatchCache* cache, int row, float* output) {
+    // Same as nn_forward, but keeps every layer's activations in row `row` of the cache
+    float* a0 = &cache->a0[row * NN_INPUT];
+    float* a1 = &cache->a1[row * NN_H1];
+    float* a2 = &cache->a2[row * NN_H2];
+    float* a3 = &cache->a3[row * NN_OUTPUT];
+
+    memcpy(a0, input, sizeof(float) * NN_INPUT);
+    hidden_forward(nn, a0, a1, a2);
+    output_forward(nn, a2, a3);
+    if (output) memcpy(output, a3, sizeof(float) * NN_OUTPUT);
+
+    if (row >= cache->count) cache->count = row + 1;
+}
+
+void nn_policy_output_grad(const NNBatchCache* cache, const float* actions, const float* returns, float sigma, float* dL_da3) {
+    // REINFORCE loss gradient at the output: dL/da3 = -G * (action - mu) / sigma^2
+    float inv_var = 1.0f / (sigma * sigma);
+    for (int t = 0; t < cache->count; t++) {
+        for (int i = 0; i < NN_OUTPUT; i++) {
+            int k = t * NN_OUTPUT + i;
+            dL_da3[k] = -returns[t] * (actions[k] - cache->a3[k]) * inv_var;
+        }
+    }
+}
+
+void nn_backward_batch(Network* nn, const NNBatchCache* cache, const float* dL_da3, Network* grads) {
+    backward_batch(nn, NULL, cache, dL_da3, NULL, grads, NULL);
+}
+
+void nn_forward_value(Network* nn, const ValueHead* head, float* input, float* output, float* value_out) {
+    float h1[NN_H1], h2[NN_H2];
+    hidden_forward(nn, input, h1, h2);
+    output_forward(nn, h2, output);
+
+    float v = head->b;
+    for (int j = 0; j < NN_H2; j++)
+        v += head->w[j] * h2[j];
+    *value_out = v;
+}
+
+void nn_forward_value_cached(Network* nn, const ValueHead* head, float* input, NNBatchCache* cache, int row, float* output, float* value_out) {
+    nn_forward_cached(nn, input, cache, row, output);
+    const float* a2 = &cache->a2[row * NN_H2];
+    float v = head->b;
+    for (int j = 0; j < NN_H2; j++)
+        v += head->w[j] * a2[j];
+    *value_out = v;
+}
+
+void nn_backward_value_batch(Network* nn, const ValueHead* head, const NNBatchCache* cache, const float* dL_da3, const float* dL_dv,
+                             Network* grads, ValueHead* head_grads) {
+    backward_batch(nn, head, cache, dL_da3, dL_dv, grads, head_grads);
+}
 
+static void hidden_forward(const Network* nn, const float* input, float* h1, float* h2) {
+    // The two tanh layers shared by the policy output and the value head
     for (int i = 0; i < NN_H1; i++) {
         float z = nn->b1[i];
         for (int j = 0; j < NN_INPUT; j++)
@@ -33,7 +151,9 @@ void nn_forward(Network* nn, float* input, float* output) {
             z += nn->w2[i][j] * h1[j];
         h2[i] = tanhf(z);
     }
+}
 
+static void output_forward(const Network* nn, const float* h2, float* output) {
     for (int i = 0; i < NN_OUTPUT; i++) {
         float z = nn->b3[i];
         for (int j = 0; j < NN_H2; j++)
@@ -41,3 +161,74 @@ void nn_forward(Network* nn, float* input, float* output) {
         output[i] = tanhf(z);
     }
 }
+
+static void backward_batch(Network* nn, const ValueHead* head, const NNBatchCache* cache, const float* dL_da3, const float* dL_dv,
+                           Network* grads, ValueHead* head_grads) {
+    // Gradients summed over every row of the cache. Per layer: dZ = dA * (1 - A^2),
+    // dW = dZ^T * A_prev, db = colsum(dZ), dA_prev = dZ * W. A value head (optional) is linear,
+    // so its gradient enters the second hidden layer's dA directly.
+    int n = cache->count;
+    memset(grads, 0, sizeof(Network));
+    if (head_grads) memset(head_grads, 0, sizeof(ValueHead));
+    if (n <= 0) return;
+
+    float* dz3 = xalloc((size_t)n * NN_OUTPUT, sizeof(float));
+    float* dz2 = xalloc((size_t)n * NN_H2, sizeof(float));
+    float* dz1 = xalloc((size_t)n * NN_H1, sizeof(float));
+    memcpy(dz3, dL_da3, sizeof(float) * n * NN_OUTPUT);
+
+    layer_backward(n, NN_OUTPUT, NN_H2, &nn->w3[0][0], cache->a2, cache->a3, dz3, &grads->w3[0][0], grads->b3, dz2);
+    if (head) {
+        for (int t = 0; t < n; t++) {
+            float g = dL_dv[t];
+            const float* a2_t = &cache->a2[t * NN_H2];
+            float* dz2_t = &dz2[t * NN_H2];
+            for (int j = 0; j < NN_H2; j++) {
+                head_grads->w[j] += g * a2_t[j];
+                dz2_t[j] += g * head->w[j];
+            }
+            head_grads->b += g;
+        }
+    }
+    layer_backward(n, NN_H2, NN_H1, &nn->w2[0][0], cache->a1, cache->a2, dz2, &grads->w2[0][0], grads->b2, dz1);
+    layer_backward(n, NN_H1, NN_INPUT, &nn->w1[0][0], cache->a0, cache->a1, dz1, &grads->w1[0][0], grads->b1, NULL);
+
+    free(dz3);
+    free(dz2);
+    free(dz1);
+}
+
+static void layer_backward(int n, int out_dim, int in_dim, const float* w, const float* a_in, const float* a_out,
+                           float* dz, float* dw, float* db, float* da_in) {
+    // dz holds dL/da_out on entry and dL/dz on return; da_in (optional) receives dL/da_in
+
+    for (int k = 0; k < n * out_dim; k++)
+        dz[k] *= 1.0f - a_out[k] * a_out[k];
+
+    for (int t = 0; t < n; t++) {
+        const float* dz_t = &dz[t * out_dim];
+        const float* a_t = &a_in[t * in_dim];
+        for (int i = 0; i < out_dim; i++) {
+            float g = dz_t[i];
+            float* dw_i = &dw[i * in_dim];
+            for (int j = 0; j < in_dim; j++)
+                dw_i[j] += g * a_t[j];
+            db[i] += g;
+        }
+    }
+
+    if (da_in == NULL) return;
+
+    for (int t = 0; t < n; t++) {
+        const float* dz_t = &dz[t * out_dim];
+        float* da_t = &da_in[t * in_dim];
+        for (int j = 0; j < in_dim; j++)
+            da_t[j] = 0.0f;
+        for (int i = 0; i < out_dim; i++) {
+            float g = dz_t[i];
+            const float* w_i = &w[i * in_dim];
+            for (int j = 0; j < in_dim; j++)
+                da_t[j] += g * w_i[j];
+        }
+    }
+}
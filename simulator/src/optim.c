@@ -0,0 +1,96 @@
+#include "optim.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "util.h"
+
+static inline float clip_gradient(float g, float clip) {
+    if (clip > 0.0f) {
+        if (g > clip) return clip;
+        if (g < -clip) return -clip;
+    }
+    return g;
+}
+
+OptimConfig optim_default_config(int kind, float lr) {
+    OptimConfig config = {.kind = kind, .lr = lr, .epsilon = 1e-8f};
+    switch (kind) {
+        case OPTIM_SGD: config.beta1 = 0.9f; break;
+        case OPTIM_RMSPROP: config.beta2 = 0.99f; break;
+        case OPTIM_ADAM: config.beta1 = 0.9f; config.beta2 = 0.999f; break;
+    }
+    return config;
+}
+
+Optimizer* optim_create(const OptimConfig* config, int n) {
+    if (n < 1 || config->kind < OPTIM_SGD || config->kind > OPTIM_ADAM) {
+        fprintf(stderr, "optim_create: bad kind %d or size %d\n", config->kind, n);
+        return NULL;
+    }
+    Optimizer* opt = xalloc(1, sizeof(Optimizer));
+    opt->config = *config;
+    opt->n = n;
+    opt->m = xalloc(n, sizeof(float));
+    opt->v = xalloc(n, sizeof(float));
+    return opt;
+}
+
+void optim_step(Optimizer* opt, float* params, const float* grads, float grad_scale) {
+    // One loop per kind, so the kind is not re-tested per parameter
+    const OptimConfig* c = &opt->config;
+    float* m = opt->m;
+    float* v = opt->v;
+    int n = opt->n;
+    opt->steps++;
+
+    switch (c->kind) {
+        case OPTIM_SGD:
+            if (c->beta1 == 0.0f) {
+                for (int k = 0; k < n; k++) {
+                    float g = clip_gradient(grads[k] * grad_scale, c->clip) + c->weight_decay * params[k];
+                    params[k] -= c->lr * g;
+                }
+            } else {
+                for (int k = 0; k < n; k++) {
+                    float g = clip_gradient(grads[k] * grad_scale, c->clip) + c->weight_decay * params[k];
+                    m[k] = c->beta1 * m[k] + g;
+                    params[k] -= c->lr * m[k];
+                }
+            }
+            break;
+
+        case OPTIM_RMSPROP:
+            for (int k = 0; k < n; k++) {
+                float g = clip_gradient(grads[k] * grad_scale, c->clip) + c->weight_decay * params[k];
+                v[k] = c->beta2 * v[k] + (1.0f - c->beta2) * g * g;
+                params[k] -= c->lr * g / (sqrtf(v[k]) + c->epsilon);
+            }
+            break;
+
+        case OPTIM_ADAM: {
+            float bias1 = 1.0f - powf(c->beta1, (float)opt->steps);
+            float bias2 = 1.0f - powf(c->beta2, (float)opt->steps);
+            for (int k = 0; k < n; k++) {
+                float g = clip_gradient(grads[k] * grad_scale, c->clip) + c->weight_decay * params[k];
+                m[k] = c->beta1 * m[k] + (1.0f - c->beta1) * g;
+                v[k] = c->beta2 * v[k] + (1.0f - c->beta2) * g * g;
+                params[k] -= c->lr * (m[k] / bias1) / (sqrtf(v[k] / bias2) + c->epsilon);
+            }
+            break;
+        }
+    }
+}
+
+void optim_reset(Optimizer* opt) {
+    memset(opt->m, 0, sizeof(float) * opt->n);
+    memset(opt->v, 0, sizeof(float) * opt->n);
+    opt->steps = 0;
+}
+
+void optim_destroy(Optimizer* opt) {
+    if (!opt) return;
+    free(opt->m);
+    free(opt->v);
+    free(opt);
+}
@@ -0,0 +1,147 @@
+#include "philox.h"
+#include <math.h>
+#include <string.h>
+
+#define PHILOX_M0 0xD2511F53u
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u
+#define PHILOX_W1 0xBB67AE85u
+#define PHILOX_ROUNDS 10
+
+#define LANES 8 // Cars generated together in philox_normals_batch
+#define LN2 0.693147180559945309f
+#define PI_OVER_4 0.785398163397448310f
+
+// Each counter block gives 4 normals: the car's n normals use blocks 0 .. (n - 1) / 4 of
+// counter {block, step, car, episode}.
+//
+// Normals come from Box-Muller with the log and sincos below instead of libm, written without
+// branches so the lane loops vectorize and the output does not depend on the libc.
+
+static inline void philox_round(uint32_t c[4], uint32_t k0, uint32_t k1) {
+    uint64_t p0 = (uint64_t)PHILOX_M0 * c[0];
+    uint64_t p1 = (uint64_t)PHILOX_M1 * c[2];
+    uint32_t c1 = c[1];
+    c[0] = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+    c[1] = (uint32_t)p1;
+    c[2] = (uint32_t)(p0 >> 32) ^ c[3] ^ k1;
+    c[3] = (uint32_t)p0;
+}
+
+void philox4x32(const uint32_t counter[4], uint64_t key, uint32_t out[4]) {
+    uint32_t c[4] = {counter[0], counter[1], counter[2], counter[3]};
+    uint32_t k0 = (uint32_t)key;
+    uint32_t k1 = (uint32_t)(key >> 32);
+    for (int r = 0; r < PHILOX_ROUNDS; r++) {
+        philox_round(c, k0, k1);
+        k0 += PHILOX_W0;
+        k1 += PHILOX_W1;
+    }
+    memcpy(out, c, sizeof(c));
+}
+
+static inline float log_uniform(uint32_t bits) {
+    // log of a uniform in (0, 1) built from the top 24 bits; 2 atanh series on the mantissa
+    float u = ((float)(bits >> 8) + 0.5f) * (1.0f / 16777216.0f);
+    uint32_t ui;
+    memcpy(&ui, &u, sizeof(ui));
+    int32_t e = (int32_t)(ui >> 23) - 127;
+    ui = (ui & 0x007FFFFFu) | 0x3F800000u;
+    float m;
+    memcpy(&m, &ui, sizeof(m));
+    int big = m > 1.41421356f;
+    m = big ? m * 0.5f : m;
+    e += big;
+    float s = (m - 1.0f) / (m + 1.0f);
+    float s2 = s * s;
+    float series = s * (2.0f + s2 * (0.666666667f + s2 * (0.4f + s2 * (0.285714286f + s2 * 0.222222222f))));
+    return (float)e * LN2 + series;
+}
+
+static inline void sincos_uniform(uint32_t bits, float* s_out, float* c_out) {
+    // sin and cos of a uniform angle: the top 2 bits pick the quadrant, the next 22 the angle in it
+    float a = ((float)((bits >> 8) & 0x3FFFFFu) + 0.5f) * (1.0f / 4194304.0f) * (2.0f * PI_OVER_4) - PI_OVER_4;
+    float a2 = a * a;
+    float s = a + a * a2 * (-1.6666654611e-1f + a2 * (8.3321608736e-3f + a2 * -1.9515295891e-4f));
+    float c = 1.0f - 0.5f * a2 + a2 * a2 * (4.166664568298827e-2f + a2 * (-1.388731625493765e-3f + a2 * 2.443315711809948e-5f));
+    uint32_t q = bits >> 30;
+    float rs = (q & 1) ? c : s;
+    float rc = (q & 1) ? -s : c;
+    *s_out = (q & 2) ? -rs : rs;
+    *c_out = (q & 2) ? -rc : rc;
+}
+
+static inline void box_muller(const uint32_t bits[4], float out[4]) {
+    for (int p = 0; p < 2; p++) {
+        float r = sqrtf(-2.0f * log_uniform(bits[2 * p]));
+        float s, c;
+        sincos_uniform(bits[2 * p + 1], &s, &c);
+        out[2 * p] = r * c;
+        out[2 * p + 1] = r * s;
+    }
+}
+
+void philox_normals(uint64_t seed, uint32_t episode, uint32_t step, uint32_t car, float* out, int n) {
+    for (int block = 0; block * 4 < n; block++) {
+        uint32_t counter[4] = {(uint32_t)block, step, car, episode};
+        uint32_t bits[4];
+        float normals[4];
+        philox4x32(counter, seed, bits);
+        box_muller(bits, normals);
+        for (int k = 0; k < 4 && block * 4 + k < n; k++) {
+            out[block * 4 + k] = normals[k];
+        }
+    }
+}
+
+void philox_normals_batch(uint64_t seed, uint32_t episode, uint32_t step, uint32_t first_car, int num_cars, int n, float* out) {
+    uint32_t k0 = (uint32_t)seed;
+    uint32_t k1 = (uint32_t)(seed >> 32);
+
+    for (int base = 0; base < num_cars; base += LANES) {
+        int lanes = num_cars - base < LANES ? num_cars - base : LANES;
+        for (int block = 0; block * 4 < n; block++) {
+            // Philox on LANES cars at once, one array per counter word
+            uint32_t c0[LANES], c1[LANES], c2[LANES], c3[LANES];
+            for (int l = 0; l < LANES; l++) {
+                c0[l] = (uint32_t)block;
+                c1[l] = step;
+                c2[l] = first_car + (uint32_t)(base + l);
+                c3[l] = episode;
+            }
+            uint32_t rk0 = k0, rk1 = k1;
+            for (int r = 0; r < PHILOX_ROUNDS; r++) {
+                for (int l = 0; l < LANES; l++) {
+                    uint64_t p0 = (uint64_t)PHILOX_M0 * c0[l];
+                    uint64_t p1 = (uint64_t)PHILOX_M1 * c2[l];
+                    uint32_t old1 = c1[l];
+                    c0[l] = (uint32_t)(p1 >> 32) ^ old1 ^ rk0;
+                    c1[l] = (uint32_t)p1;
+                    c2[l] = (uint32_t)(p0 >> 32) ^ c3[l] ^ rk1;
+                    c3[l] = (uint32_t)p0;
+                }
+                rk0 += PHILOX_W0;
+                rk1 += PHILOX_W1;
+            }
+
+            float normals[4][LANES];
+            for (int l = 0; l < LANES; l++) {
+                float r0 = sqrtf(-2.0f * log_uniform(c0[l]));
+                float r1 = sqrtf(-2.0f * log_uniform(c2[l]));
+                float s0, co0, s1, co1;
+                sincos_uniform(c1[l], &s0, &co0);
+                sincos_uniform(c3[l], &s1, &co1);
+                normals[0][l] = r0 * co0;
+                normals[1][l] = r0 * s0;
+                normals[2][l] = r1 * co1;
+                normals[3][l] = r1 * s1;
+            }
+
+            for (int l = 0; l < lanes; l++) {
+                for (int k = 0; k < 4 && block * 4 + k < n; k++) {
+                    out[(size_t)(base + l) * n + block * 4 + k] = normals[k][l];
+                }
+            }
+        }
+    }
+}
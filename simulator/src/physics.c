@@ -1,6 +1,7 @@
 #include "physics.h"
 #include "physics_constants.h"
 #include "car_internals.h"
+#include "det_math.h"
 #include <math.h>
 #include <stdio.h>
 
@@ -24,13 +25,13 @@ void update_car_physics(Car *car, float acceleration, float steering_angle, cons
     car->steering_angle = clamp(car->steering_angle + delta_steering, -MAX_STEERING_ANGLE, MAX_STEERING_ANGLE);
 
     // Velocity = Acceleration in Direction * Time Step * Drag Coefficient normalized to [min speed, max speed]
-    float accel_x = car->acceleration * cosf(car->heading);
-    float accel_y = car->acceleration * sinf(car->heading);
+    float accel_x = car->acceleration * sim_cosf(car->heading);
+    float accel_y = car->acceleration * sim_sinf(car->heading);
     car->velocity.x = (car->velocity.x + accel_x*dt) * DRAG_COEFFICIENT;
     car->velocity.y = (car->velocity.y + accel_y*dt) * DRAG_COEFFICIENT;
 
-    float fx = cosf(car->heading);
-    float fy = sinf(car->heading);
+    float fx = sim_cosf(car->heading);
+    float fy = sim_sinf(car->heading);
     float v_forward = car->velocity.x * fx + car->velocity.y * fy;
 
     // Lateral Friction
@@ -59,6 +60,55 @@ void update_car_physics(Car *car, float acceleration, float steering_angle, cons
     
 }
 
+void update_car_physics_dual(const Car *car, CarDual *state, Dual acceleration, Dual steering_angle, const float dt) {
+    // Keep in step with update_car_physics above
+    if (car == NULL || !car->is_alive) {
+        return;
+    }
+
+    Dual delta_acceleration = dual_sub(acceleration, state->acceleration);
+    delta_acceleration = dual_clamp(delta_acceleration, -MAX_DELTA_ACCELERATION, MAX_DELTA_ACCELERATION);
+
+    Dual delta_steering = dual_sub(steering_angle, state->steering_angle);
+    delta_steering = dual_clamp(delta_steering, -MAX_DELTA_STEERING, MAX_DELTA_STEERING);
+
+    state->acceleration = dual_clamp(dual_add(state->acceleration, delta_acceleration), -MAX_ACCELERATION, MAX_ACCELERATION);
+
+    state->steering_angle = dual_clamp(dual_add(state->steering_angle, delta_steering), -MAX_STEERING_ANGLE, MAX_STEERING_ANGLE);
+
+    Dual fx = dual_cos(state->heading);
+    Dual fy = dual_sin(state->heading);
+    Dual accel_x = dual_mul(state->acceleration, fx);
+    Dual accel_y = dual_mul(state->acceleration, fy);
+    state->velocity_x = dual_scale(dual_add(state->velocity_x, dual_scale(accel_x, dt)), DRAG_COEFFICIENT);
+    state->velocity_y = dual_scale(dual_add(state->velocity_y, dual_scale(accel_y, dt)), DRAG_COEFFICIENT);
+
+    Dual v_forward = dual_add(dual_mul(state->velocity_x, fx), dual_mul(state->velocity_y, fy));
+
+    // Lateral Friction
+    Dual lateral_x = dual_scale(fy, -1.0f);
+    Dual lateral_y = fx;
+    Dual v_lateral = dual_scale(dual_add(dual_mul(state->velocity_x, lateral_x), dual_mul(state->velocity_y, lateral_y)), FRICTION_COEFFICIENT);
+    state->velocity_x = dual_add(dual_mul(v_forward, fx), dual_mul(v_lateral, lateral_x));
+    state->velocity_y = dual_add(dual_mul(v_forward, fy), dual_mul(v_lateral, lateral_y));
+
+    // clamp_forward_speed
+    v_forward = dual_add(dual_mul(state->velocity_x, fx), dual_mul(state->velocity_y, fy));
+    Dual clamped = dual_clamp(v_forward, -MAX_REVERSE_SPEED, MAX_FORWARD_SPEED);
+    Dual delta = dual_sub(clamped, v_forward);
+    state->velocity_x = dual_add(state->velocity_x, dual_mul(delta, fx));
+    state->velocity_y = dual_add(state->velocity_y, dual_mul(delta, fy));
+    state->speed = clamped;
+
+    // The heading wraps to [0, 2pi) with a derivative of 1
+    Dual angular_velocity = dual_scale(dual_mul(state->steering_angle, state->speed), TURN_FACTOR);
+    state->heading = dual_add(state->heading, dual_scale(angular_velocity, dt));
+    normalize_heading(&state->heading.v);
+
+    state->x = dual_add(state->x, dual_scale(state->velocity_x, dt));
+    state->y = dual_add(state->y, dual_scale(state->velocity_y, dt));
+}
+
 float clamp(float x, float min, float max) {
     if (x > max)
         return max;
@@ -69,7 +119,7 @@ float clamp(float x, float min, float max) {
 
 void normalize_heading(float* heading) {
     float two_pi = PI * 2;
-    *heading = fmodf(*heading, two_pi);
+    *heading = sim_fmodf(*heading, two_pi);
     if (*heading < 0)
         *heading += two_pi;
 }
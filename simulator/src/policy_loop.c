@@ -0,0 +1,57 @@
+#include "policy_loop.h"
+#include <math.h>
+#include "physics.h"
+#include "physics_constants.h"
+#include "ray_cast.h"
+#include "track_collision.h"
+#include "trace.h"
+
+// One step of the trained policy driving a car: shared by the visualizer (main.c) and the
+// headless evaluator (evaluate.c) so both run exactly the same loop
+
+void policy_cast_rays(Car* car, QuadTreeNode* tree) {
+    cast_ray_fan(tree, car->position, car->heading, MAX_RAY_DISTANCE, car->ray_distances);
+}
+
+void policy_get_state(const Car* car, float* state) {
+    for (int i = 0; i < NUM_RAYS; i++)
+        state[i] = car->ray_distances[i] / MAX_RAY_DISTANCE;
+    state[9]  = car->speed / MAX_FORWARD_SPEED;
+    state[10] = car->acceleration / MAX_ACCELERATION;
+    state[11] = car->steering_angle / MAX_STEERING_ANGLE;
+}
+
+PolicyStatus policy_step(Network* nn, Car* car, const Track* track, QuadTreeNode* tree, float dt) {
+    return policy_step_noisy(nn, car, track, tree, dt, NULL);
+}
+
+PolicyStatus policy_step_noisy(Network* nn, Car* car, const Track* track, QuadTreeNode* tree, float dt, const float* noise) {
+    // Expects car->ray_distances to be current; leaves them current for the next step
+    uint64_t phase_start = trace_begin();
+    float state[NN_INPUT];
+    policy_get_state(car, state);
+
+    // Network outputs are deltas on the current controls, as in sim_step
+    float action[NN_OUTPUT];
+    nn_forward(nn, state, action);
+    if (noise) {
+        for (int i = 0; i < NN_OUTPUT; i++) {
+            action[i] = fminf(fmaxf(action[i] + noise[i], -1.0f), 1.0f);
+        }
+    }
+    trace_lap("nn_forward", &phase_start);
+    update_car_physics(car, action[0] + car->acceleration, action[1] + car->steering_angle, dt);
+    trace_lap("physics", &phase_start);
+
+    policy_cast_rays(car, tree);
+    trace_lap("rays", &phase_start);
+    int alive = check_car_collision(car, tree);
+    trace_end("collision", phase_start);
+    if (!alive) {
+        return POLICY_CRASHED;
+    }
+    if (track_reached_finish(track, car->position)) {
+        return POLICY_FINISHED;
+    }
+    return POLICY_RUNNING;
+}
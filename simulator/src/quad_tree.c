@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include <string.h>
 #include "util.h"
+#include "sim_stats.h"
 
 Bounds calculateBounds(Point* points, int count){
     Bounds b;
@@ -25,17 +26,35 @@ int segmentIntersectsBound(Bounds* bound, struct BoundarySegment* segment){
     if (pointIntersectsBound(segment->start, bound) || pointIntersectsBound(segment->end, bound))
         return 1;
 
-    // Bounding box overlap test
-    float seg_min_x = fminf(segment->start.x, segment->end.x);
-    float seg_min_y = fminf(segment->start.y, segment->end.y);
-    float seg_max_x = fmaxf(segment->start.x, segment->end.x);
-    float seg_max_y = fmaxf(segment->start.y, segment->end.y);
-
-    if (seg_max_x < bound->min_x || seg_min_x > bound->max_x)
-        return 0;
-    if (seg_max_y < bound->min_y || seg_min_y > bound->max_y)
-        return 0;
+    // Exact test (Liang-Barsky): clips the segment's parameter range [0, 1] against each slab
+    // of the box and reports whether anything is left. A bounding box overlap test would also
+    // accept diagonal segments that pass by a corner.
+    float dx = segment->end.x - segment->start.x;
+    float dy = segment->end.y - segment->start.y;
+    float p[4] = {-dx, dx, -dy, dy};
+    float q[4] = {
+        segment->start.x - bound->min_x,
+        bound->max_x - segment->start.x,
+        segment->start.y - bound->min_y,
+        bound->max_y - segment->start.y
+    };
 
+    float t0 = 0.0f, t1 = 1.0f;
+    for (int i = 0; i < 4; i++) {
+        if (p[i] == 0.0f) {
+            // Parallel to this slab: inside it or not at all
+            if (q[i] < 0.0f) return 0;
+            continue;
+        }
+        float r = q[i] / p[i];
+        if (p[i] < 0.0f) {
+            if (r > t1) return 0;
+            if (r > t0) t0 = r;
+        } else {
+            if (r < t0) return 0;
+            if (r < t1) t1 = r;
+        }
+    }
     return 1;
 }
 
@@ -46,18 +65,36 @@ int pointIntersectsBound(Point p, Bounds* bound) {
     return 0;
 }
 
+static QuadTreeNode* build_node(Bounds bounds, struct BoundarySegment* segment, int segment_count, int depth,
+                                const QuadTreeParams* params);
+
+void quadtree_default_params(QuadTreeParams* params) {
+    params->max_depth = MAX_DEPTH;
+    params->max_segments_per_node = MAX_SEGMENTS_PER_NODE;
+}
+
 QuadTreeNode* createQuadTreeNode(Bounds bounds, struct BoundarySegment* segment, int segment_count, int depth){
+    QuadTreeParams params;
+    quadtree_default_params(&params);
+    return build_node(bounds, segment, segment_count, depth, &params);
+}
+
+static QuadTreeNode* build_node(Bounds bounds, struct BoundarySegment* segment, int segment_count, int depth,
+                                const QuadTreeParams* params) {
     QuadTreeNode* node = xalloc(1, sizeof(QuadTreeNode));
     node->bounds = bounds;
     node->segment_count = 0;
     node->segments = NULL;
+    node->blocks = NULL;
+    node->block_count = 0;
     node->children[0] = node->children[1] = node->children[2] = node->children[3] = NULL;
 
     // Leaf Node
-    if (segment_count <= MAX_SEGMENTS_PER_NODE || depth >= MAX_DEPTH) {
+    if (segment_count <= params->max_segments_per_node || depth >= params->max_depth) {
         node->segments = xalloc(segment_count, sizeof(BoundarySegment));
         memcpy(node->segments, segment, segment_count * sizeof(BoundarySegment));
         node->segment_count = segment_count;
+        node->blocks = segment_blocks_build(node->segments, segment_count, &node->block_count);
         return node;
     }
 
@@ -76,14 +113,19 @@ QuadTreeNode* createQuadTreeNode(Bounds bounds, struct BoundarySegment* segment,
         struct BoundarySegment* child_segments = xalloc(segment_count, sizeof(BoundarySegment));
         int child_count = 0;
 
+        // Grown by CLIP_EPSILON so a segment running along a shared edge lands in both children despite rounding
+        Bounds clip_bounds = {
+            child_Bounds[i].min_x - CLIP_EPSILON, child_Bounds[i].min_y - CLIP_EPSILON,
+            child_Bounds[i].max_x + CLIP_EPSILON, child_Bounds[i].max_y + CLIP_EPSILON
+        };
         for (int j = 0; j < segment_count; j++) {
-            if (segmentIntersectsBound(&child_Bounds[i], &segment[j])) {
+            if (segmentIntersectsBound(&clip_bounds, &segment[j])) {
                 child_segments[child_count++] = segment[j];
             }
         }
 
         if (child_count > 0) {
-            node -> children[i] = createQuadTreeNode(child_Bounds[i], child_segments, child_count, depth + 1);
+            node -> children[i] = build_node(child_Bounds[i], child_segments, child_count, depth + 1, params);
         }
         
         free(child_segments);
@@ -100,6 +142,7 @@ void free_quadtree(QuadTreeNode* node) {
     if (node->segments) {
         free(node->segments);
     }
+    free(node->blocks);
 
     for (int i = 0; i < 4; i++) {
         free_quadtree(node->children[i]);
@@ -108,6 +151,30 @@ void free_quadtree(QuadTreeNode* node) {
     free(node);
 }
 
+static void collect_stats(const QuadTreeNode* node, QuadTreeStats* stats) {
+    stats->nodes++;
+    int is_leaf = 1;
+    for (int i = 0; i < 4; i++) {
+        if (node->children[i]) {
+            collect_stats(node->children[i], stats);
+            is_leaf = 0;
+        }
+    }
+    if (is_leaf) {
+        stats->leaves++;
+        stats->leaf_segments += node->segment_count;
+        if (node->segment_count > stats->max_leaf_segments) stats->max_leaf_segments = node->segment_count;
+    }
+}
+
+void quadtree_stats(const QuadTreeNode* tree, int unique_segments, QuadTreeStats* stats) {
+    // Duplicates are leaf entries beyond one per distinct segment
+    memset(stats, 0, sizeof(*stats));
+    if (tree) collect_stats(tree, stats);
+    stats->mean_leaf_segments = stats->leaves ? (float)stats->leaf_segments / stats->leaves : 0.0f;
+    stats->duplicates = stats->leaf_segments > unique_segments ? stats->leaf_segments - unique_segments : 0;
+}
+
 int boundIntersectsBounds(Bounds* region1, Bounds* region2){
     if (region1 == NULL || region2 == NULL){
         return 0;
@@ -130,8 +197,10 @@ void query_region(QuadTreeNode* node, Bounds* region, struct BoundarySegment* re
         return;
     }
 
+    SIM_STATS_ADD(query_nodes_visited, 1);
     if (node->segment_count > 0) {
         // Leaf Node
+        SIM_STATS_ADD(query_segment_tests, node->segment_count);
         for (int i = 0; i < node->segment_count; i++) {
             struct BoundarySegment segment = node->segments[i];
             if (segmentIntersectsBound(region, &segment)) {
@@ -169,6 +238,17 @@ void query_region(QuadTreeNode* node, Bounds* region, struct BoundarySegment* re
 }
 
 QuadTreeNode* build_track_quadtree(Track* track) {
+    return build_track_quadtree_ex(track, NULL);
+}
+
+QuadTreeNode* build_track_quadtree_ex(Track* track, const QuadTreeParams* params) {
+    // params NULL builds with the compile-time defaults
+    QuadTreeParams defaults;
+    if (params == NULL) {
+        quadtree_default_params(&defaults);
+        params = &defaults;
+    }
+
     // Combine left and right boundary segments
     int left_count = track->left_boundary.count - 1;
     int right_count = track->right_boundary.count - 1;
@@ -201,7 +281,7 @@ QuadTreeNode* build_track_quadtree(Track* track) {
     free(all_points);
     
     // Build the quad tree
-    QuadTreeNode* tree = createQuadTreeNode(bounds, all_segments, total_segments, 0);
+    QuadTreeNode* tree = build_node(bounds, all_segments, total_segments, 0, params);
     free(all_segments);
     
     return tree;
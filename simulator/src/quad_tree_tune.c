@@ -0,0 +1,180 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include "quad_tree_tune.h"
+#include "quad_tree.h"
+#include "ray_cast.h"
+#include "track_collision.h"
+#include "util.h"
+
+#define TUNE_REPEATS      3    // Best of, per candidate in the screening pass
+#define TUNE_CONFIRM_ROUNDS 31 // Interleaved timings of the defaults and the screening winner
+#define TUNE_QUERY_RADIUS 5.0f // Half size of the probe region, as in nearest_left_segment_index
+
+static const int TUNE_DEPTHS[] = {6, 8, 10, 12, 14, 16};
+static const int TUNE_LEAF_SIZES[] = {4, 8, 16, 30, 64};
+
+static volatile float sink; // Keeps the probe results alive
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static float uniform(uint32_t* state) {
+    *state = *state * 1664525u + 1013904223u;
+    return (*state >> 8) * (1.0f / 16777216.0f);
+}
+
+static void sample_poses(const Track* track, Point* positions, float* headings) {
+    // Between the boundaries, heading roughly along the track; fixed seed so runs compare
+    uint32_t state = 12345u;
+    const Boundary* left = &track->left_boundary;
+    const Boundary* right = &track->right_boundary;
+    for (int i = 0; i < QUADTREE_TUNE_POSES; i++) {
+        int k = (int)(uniform(&state) * (left->count - 1));
+        int r = (int)((long)k * (right->count - 1) / (left->count - 1));
+        float t = 0.2f + 0.6f * uniform(&state);
+        Point l = left->points[k], rp = right->points[r];
+        positions[i].x = l.x + (rp.x - l.x) * t;
+        positions[i].y = l.y + (rp.y - l.y) * t;
+        Point next = left->points[k + 1];
+        headings[i] = atan2f(next.y - l.y, next.x - l.x) + (uniform(&state) - 0.5f);
+    }
+}
+
+static double time_pass(QuadTreeNode* tree, const Point* positions, const float* headings) {
+    // Mean ns per pose over one pass of the pose set
+    // The rays go through cast_ray_fan, as in sim_env_step and policy_cast_rays
+    struct BoundarySegment results[MAX_COLLISION_CHECKS];
+    float distances[NUM_RAYS];
+    float total = 0.0f;
+    double start = now_ns();
+    for (int i = 0; i < QUADTREE_TUNE_POSES; i++) {
+        cast_ray_fan(tree, positions[i], headings[i], MAX_RAY_DISTANCE, distances);
+        for (int j = 0; j < NUM_RAYS; j++) total += distances[j];
+        Bounds region = {
+            positions[i].x - TUNE_QUERY_RADIUS, positions[i].y - TUNE_QUERY_RADIUS,
+            positions[i].x + TUNE_QUERY_RADIUS, positions[i].y + TUNE_QUERY_RADIUS
+        };
+        int count = 0;
+        query_region(tree, &region, results, &count, MAX_COLLISION_CHECKS);
+        total += count;
+    }
+    sink = total;
+    return (now_ns() - start) / QUADTREE_TUNE_POSES;
+}
+
+static double time_probes(QuadTreeNode* tree, const Point* positions, const float* headings) {
+    // Best of TUNE_REPEATS passes: cheap enough to rank the whole grid, but too noisy to trust
+    // the minimum over it (see confirm_winner)
+    double best = 0.0;
+    for (int repeat = 0; repeat < TUNE_REPEATS; repeat++) {
+        double elapsed = time_pass(tree, positions, headings);
+        if (repeat == 0 || elapsed < best) best = elapsed;
+    }
+    return best;
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static double median(double* values, int n) {
+    qsort(values, n, sizeof(double), compare_doubles);
+    return n % 2 ? values[n / 2] : 0.5 * (values[n / 2 - 1] + values[n / 2]);
+}
+
+static void confirm_winner(QuadTreeNode* defaults, QuadTreeNode* winner, const Point* positions, const float* headings,
+                           double* default_ns, double* winner_ns) {
+    // The fastest of ~30 best-of-3 timings is biased low (winner's curse), so the screening
+    // winner and the defaults are timed again, alternating which goes first, and compared by median
+    double default_times[TUNE_CONFIRM_ROUNDS], winner_times[TUNE_CONFIRM_ROUNDS];
+    for (int round = 0; round < TUNE_CONFIRM_ROUNDS; round++) {
+        if (round % 2) {
+            winner_times[round] = time_pass(winner, positions, headings);
+            default_times[round] = time_pass(defaults, positions, headings);
+        } else {
+            default_times[round] = time_pass(defaults, positions, headings);
+            winner_times[round] = time_pass(winner, positions, headings);
+        }
+    }
+    *default_ns = median(default_times, TUNE_CONFIRM_ROUNDS);
+    *winner_ns = median(winner_times, TUNE_CONFIRM_ROUNDS);
+}
+
+QuadTreeNode* build_track_quadtree_tuned(Track* track, QuadTreeParams* params_out, QuadTreeTuneReport* report) {
+    Point* positions = xalloc(QUADTREE_TUNE_POSES, sizeof(Point));
+    float* headings = xalloc(QUADTREE_TUNE_POSES, sizeof(float));
+    sample_poses(track, positions, headings);
+
+    QuadTreeParams defaults;
+    quadtree_default_params(&defaults);
+    QuadTreeNode* default_tree = build_track_quadtree_ex(track, &defaults);
+    double screen_default_ns = time_probes(default_tree, positions, headings);
+    QuadTreeNode* leader_tree = NULL;
+    QuadTreeParams leader = defaults;
+    double leader_ns = screen_default_ns;
+    int candidates = 1;
+
+    // Screening: the fastest candidate by best-of-TUNE_REPEATS
+    int num_depths = sizeof(TUNE_DEPTHS) / sizeof(TUNE_DEPTHS[0]);
+    int num_leaf_sizes = sizeof(TUNE_LEAF_SIZES) / sizeof(TUNE_LEAF_SIZES[0]);
+    for (int d = 0; d < num_depths; d++) {
+        for (int l = 0; l < num_leaf_sizes; l++) {
+            QuadTreeParams params = {.max_depth = TUNE_DEPTHS[d], .max_segments_per_node = TUNE_LEAF_SIZES[l]};
+            if (params.max_depth == defaults.max_depth && params.max_segments_per_node == defaults.max_segments_per_node) {
+                continue;
+            }
+
+            QuadTreeNode* tree = build_track_quadtree_ex(track, &params);
+            double ns = time_probes(tree, positions, headings);
+            candidates++;
+
+            if (ns < leader_ns) {
+                free_quadtree(leader_tree);
+                leader_tree = tree;
+                leader = params;
+                leader_ns = ns;
+            } else {
+                free_quadtree(tree);
+            }
+        }
+    }
+
+    // Confirmation: the leader replaces the defaults only if its median clears the margin
+    QuadTreeNode* best_tree = default_tree;
+    QuadTreeParams best = defaults;
+    double default_ns = screen_default_ns;
+    double best_ns = screen_default_ns;
+    if (leader_tree) {
+        double confirmed_ns;
+        confirm_winner(default_tree, leader_tree, positions, headings, &default_ns, &confirmed_ns);
+        if (confirmed_ns < default_ns * (1.0 - QUADTREE_TUNE_MIN_GAIN)) {
+            free_quadtree(default_tree);
+            best_tree = leader_tree;
+            best = leader;
+            best_ns = confirmed_ns;
+        } else {
+            free_quadtree(leader_tree);
+            best_ns = default_ns;
+        }
+    }
+
+    free(positions);
+    free(headings);
+
+    *params_out = best;
+    if (report) {
+        report->params = best;
+        report->default_ns = default_ns;
+        report->best_ns = best_ns;
+        report->candidates = candidates;
+    }
+    return best_tree;
+}
@@ -1,10 +1,12 @@
 #include "ray_cast.h"
 #include "quad_tree.h"
+#include "det_math.h"
+#include "sim_stats.h"
+#include "segment_block.h"
 #include <float.h>
 #include <math.h>
 #include <stdlib.h>
 
-RayHit ray_segment_intersection(Point origin, float direction, struct BoundarySegment* segment);
 int ray_intersects_bounds(Point origin, float direction, Bounds* bounds, float max_distance);
 RayHit cast_ray(QuadTreeNode* node, Point origin, float direction, float max_distance);
 
@@ -14,8 +16,8 @@ RayHit ray_segment_intersection(Point origin, float direction, struct BoundarySe
     RayHit result = {.hit = 0, .distance = FLT_MAX};
 
     // convert direction from radians to x, y
-    float dx = cosf(direction);
-    float dy = sinf(direction);
+    float dx = sim_cosf(direction);
+    float dy = sim_sinf(direction);
 
     // get eqaution of line of segment
     float sx = segment->end.x - segment->start.x;
@@ -51,8 +53,8 @@ int ray_intersects_bounds(Point origin, float direction, Bounds* bounds, float m
     float tmin = 0.0f; //Valid distance of the ray
     float tmax = max_distance;
 
-    float dx = cosf(direction);
-    float dy = sinf(direction); 
+    float dx = sim_cosf(direction);
+    float dy = sim_sinf(direction); 
 
     // X axis
     if (fabsf(dx) > 1e-10f){
@@ -88,17 +90,23 @@ int ray_intersects_bounds(Point origin, float direction, Bounds* bounds, float m
 
 RayHit cast_ray(QuadTreeNode* node, Point origin, float direction, float max_distance) {
     RayHit result = {.hit = 0, .distance = max_distance};
+    if (node) SIM_STATS_ADD(ray_aabb_tests, 1);
     if (!node || !ray_intersects_bounds(origin, direction, &node->bounds, max_distance)) {
         return result;
     }
 
+    SIM_STATS_ADD(ray_nodes_visited, 1);
     if (node->segment_count > 0) {
-        // Leaf Node
-        for (int i = 0; i < node->segment_count; i++) {
-            RayHit hit = ray_segment_intersection(origin, direction, &node->segments[i]);
-            if (hit.hit && hit.distance < result.distance) {
-                result = hit;
-            }
+        // Leaf Node: all its segments at once, same distances as ray_segment_intersection
+        SIM_STATS_ADD(ray_segment_tests, node->segment_count);
+        float dx = sim_cosf(direction);
+        float dy = sim_sinf(direction);
+        float t = segment_blocks_nearest(node->blocks, node->block_count, origin, dx, dy, result.distance);
+        if (t < result.distance) {
+            result.hit = 1;
+            result.distance = t;
+            result.point.x = origin.x + t * dx;
+            result.point.y = origin.y + t * dy;
         }
     } else {
         // Branch Node, Recurse into children
@@ -113,4 +121,119 @@ RayHit cast_ray(QuadTreeNode* node, Point origin, float direction, float max_dis
     }
 
     return result;
-}
\ No newline at end of file
+}
+
+// Candidate segments near the car, packed as they are found
+typedef struct {
+    SegmentBlock blocks[RAY_FAN_MAX_CANDIDATES / SEGMENT_BLOCK_SIZE];
+    int count;
+} FanCandidates;
+
+static int gather_candidates(QuadTreeNode* node, Bounds* region, FanCandidates* out) {
+    // Like query_region but keeps copies of straddling segments (a duplicate only costs one more
+    // test) instead of searching the list for them. Returns 0 when the list overflows.
+    if (node == NULL || node->bounds.max_x < region->min_x || region->max_x < node->bounds.min_x ||
+        node->bounds.max_y < region->min_y || region->max_y < node->bounds.min_y) {
+        return 1;
+    }
+
+    SIM_STATS_ADD(ray_nodes_visited, 1);
+    if (node->segment_count > 0) {
+        for (int i = 0; i < node->segment_count; i++) {
+            struct BoundarySegment* segment = &node->segments[i];
+            if (!segmentIntersectsBound(region, segment)) continue;
+            if (out->count >= RAY_FAN_MAX_CANDIDATES) return 0;
+            SegmentBlock* block = &out->blocks[out->count / SEGMENT_BLOCK_SIZE];
+            int lane = out->count % SEGMENT_BLOCK_SIZE;
+            block->start_x[lane] = segment->start.x;
+            block->start_y[lane] = segment->start.y;
+            block->delta_x[lane] = segment->end.x - segment->start.x;
+            block->delta_y[lane] = segment->end.y - segment->start.y;
+            out->count++;
+        }
+        return 1;
+    }
+
+    for (int i = 0; i < 4; i++) {
+        if (!gather_candidates(node->children[i], region, out)) return 0;
+    }
+    return 1;
+}
+
+void cast_ray_fan(QuadTreeNode* node, Point origin, float heading, float max_distance, float distances[NUM_RAYS]) {
+    // Any hit closer than max_distance lies inside the square of that half size around origin,
+    // so its segment crosses the square; the slack covers rounding at the square's edge
+    static _Thread_local FanCandidates candidates;
+    float reach = max_distance * 1.001f;
+    Bounds region = {origin.x - reach, origin.y - reach, origin.x + reach, origin.y + reach};
+    candidates.count = 0;
+    if (!gather_candidates(node, &region, &candidates)) {
+        for (int j = 0; j < NUM_RAYS; j++) {
+            distances[j] = cast_ray(node, origin, heading + RAY_ANGLES[j], max_distance).distance;
+        }
+        return;
+    }
+
+    // Zero-length segments in the last block's unused lanes never hit
+    int count = candidates.count;
+    int block_count = (count + SEGMENT_BLOCK_SIZE - 1) / SEGMENT_BLOCK_SIZE;
+    for (int i = count; i < block_count * SEGMENT_BLOCK_SIZE; i++) {
+        SegmentBlock* block = &candidates.blocks[i / SEGMENT_BLOCK_SIZE];
+        int lane = i % SEGMENT_BLOCK_SIZE;
+        block->start_x[lane] = block->start_y[lane] = 0.0f;
+        block->delta_x[lane] = block->delta_y[lane] = 0.0f;
+    }
+    SIM_STATS_ADD(ray_segment_tests, (uint64_t)count * NUM_RAYS);
+
+    for (int j = 0; j < NUM_RAYS; j++) {
+        float direction = heading + RAY_ANGLES[j];
+        distances[j] = segment_blocks_nearest(candidates.blocks, block_count, origin,
+                                              sim_cosf(direction), sim_sinf(direction), max_distance);
+    }
+}
+
+static void nearest_segment(QuadTreeNode* node, Point origin, float direction, RayHit* best, struct BoundarySegment** segment) {
+    // cast_ray's descent with the scalar test, remembering which segment was hit
+    if (!node || !ray_intersects_bounds(origin, direction, &node->bounds, best->distance)) {
+        return;
+    }
+    if (node->segment_count > 0) {
+        for (int i = 0; i < node->segment_count; i++) {
+            RayHit hit = ray_segment_intersection(origin, direction, &node->segments[i]);
+            if (hit.hit && hit.distance < best->distance) {
+                *best = hit;
+                *segment = &node->segments[i];
+            }
+        }
+        return;
+    }
+    for (int i = 0; i < 4; i++) {
+        nearest_segment(node->children[i], origin, direction, best, segment);
+    }
+}
+
+void ray_fan_gradients(QuadTreeNode* node, Point origin, float heading, float max_distance,
+                       const float distances[NUM_RAYS], float gradients[NUM_RAYS][3]) {
+    for (int j = 0; j < NUM_RAYS; j++) {
+        gradients[j][0] = gradients[j][1] = gradients[j][2] = 0.0f;
+        if (!(distances[j] < max_distance)) continue; // Nothing in range: constant max_distance
+
+        float direction = heading + RAY_ANGLES[j];
+        RayHit best = {.hit = 0, .distance = max_distance};
+        struct BoundarySegment* segment = NULL;
+        nearest_segment(node, origin, direction, &best, &segment);
+        if (segment == NULL) continue;
+
+        // The hit lies on the segment's line, t (d x s) = (start - origin) x s with s = end - start,
+        // so dt/dorigin = (-s.y, s.x) / (d x s) and, as dd/dheading = (-d.y, d.x),
+        // dt/dheading = t (d . s) / (d x s)
+        float dx = sim_cosf(direction);
+        float dy = sim_sinf(direction);
+        float sx = segment->end.x - segment->start.x;
+        float sy = segment->end.y - segment->start.y;
+        float determinant = dx * sy - dy * sx;
+        gradients[j][0] = -sy / determinant;
+        gradients[j][1] = sx / determinant;
+        gradients[j][2] = best.distance * (dx * sx + dy * sy) / determinant;
+    }
+}
@@ -0,0 +1,142 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "replay.h"
+#include <stdio.h>
+#include <time.h>
+#include "window.h"
+#include "track_renderer.h"
+#include "car_renderer.h"
+#include "ray_renderer.h"
+#include "car_internals.h"
+
+// Keys: Space pause   Up / Down: playback speed   Left / Right: one step back / forward (pauses)
+//       Page Up / Page Down: 1000 steps   Home / End: first / last step   Esc: quit
+
+#define REPLAY_STEPS_PER_SECOND 30.0 // Playback rate at 1x; sim_lib steps are a whole second of sim time
+#define REPLAY_JUMP_STEPS       1000
+
+static const double SPEED_STEPS[] = {0.25, 0.5, 1, 2, 5, 10, 20, 50, 100};
+static const int    NUM_SPEED_STEPS = sizeof(SPEED_STEPS) / sizeof(SPEED_STEPS[0]);
+
+static TrajectoryReader* reader;
+static double playhead = 0.0; // Fractional step index
+static int speed_step = 2;    // 1x
+static int paused = 0;
+
+static void handle_key(int key);
+static void seek(double step);
+static void update_title(const TrajectoryStep* step);
+static double now_seconds(void);
+
+void replay_run(TrajectoryReader* trajectory) {
+    reader = trajectory;
+    playhead = 0.0;
+    window_set_key_handler(handle_key);
+
+    Car car = {0};
+    Car* cars[1] = {&car};
+    uint64_t shown = UINT64_MAX;
+    double last = now_seconds();
+
+    while (!window_should_close()) {
+        double now = now_seconds();
+        if (!paused) {
+            seek(playhead + (now - last) * REPLAY_STEPS_PER_SECOND * SPEED_STEPS[speed_step]);
+        }
+        last = now;
+
+        TrajectoryStep step;
+        uint64_t index = (uint64_t)playhead;
+        if (trajectory_reader_get(reader, index, &step) == 0) {
+            car.position = step.position;
+            car.heading = step.heading;
+            car.speed = step.speed;
+            car.acceleration = step.acceleration;
+            car.steering_angle = step.steering_angle;
+            for (int j = 0; j < NUM_RAYS; j++) {
+                car.ray_distances[j] = step.ray_distances[j];
+            }
+            car.is_alive = (step.flags & TRAJECTORY_FLAG_ALIVE) != 0;
+            if (index != shown) {
+                update_title(&step);
+                shown = index;
+            }
+        }
+
+        glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        car_renderer_update(1, cars, NULL);
+        car_renderer_draw();
+
+        track_renderer_draw();
+
+        ray_renderer_update(car.is_alive ? 1 : 0, cars);
+        ray_renderer_draw();
+
+        window_swap_and_poll();
+    }
+}
+
+static void handle_key(int key) {
+    switch (key) {
+        case GLFW_KEY_SPACE:
+            paused = !paused;
+            break;
+        case GLFW_KEY_UP:
+            if (speed_step + 1 < NUM_SPEED_STEPS) speed_step++;
+            break;
+        case GLFW_KEY_DOWN:
+            if (speed_step > 0) speed_step--;
+            break;
+        case GLFW_KEY_RIGHT:
+            paused = 1;
+            seek((uint64_t)playhead + 1);
+            break;
+        case GLFW_KEY_LEFT:
+            paused = 1;
+            seek((double)(uint64_t)playhead - 1);
+            break;
+        case GLFW_KEY_PAGE_DOWN:
+            seek(playhead + REPLAY_JUMP_STEPS);
+            break;
+        case GLFW_KEY_PAGE_UP:
+            seek(playhead - REPLAY_JUMP_STEPS);
+            break;
+        case GLFW_KEY_HOME:
+            seek(0);
+            break;
+        case GLFW_KEY_END:
+            seek((double)trajectory_reader_step_count(reader) - 1);
+            break;
+        case GLFW_KEY_ESCAPE:
+            window_close();
+            break;
+        default:
+            break;
+    }
+}
+
+static void seek(double step) {
+    // Clamps to the recording; playback stops at the last step
+    double last = (double)trajectory_reader_step_count(reader) - 1;
+    if (step > last) step = last;
+    if (step < 0) step = 0;
+    playhead = step;
+}
+
+static void update_title(const TrajectoryStep* step) {
+    char title[160];
+    snprintf(title, sizeof(title), "%s - replay step %llu / %llu - %gx%s - reward %.3f%s%s",
+             WINDOW_TITLE, (unsigned long long)playhead, (unsigned long long)trajectory_reader_step_count(reader),
+             SPEED_STEPS[speed_step], paused ? " (paused)" : "", step->reward,
+             (step->flags & TRAJECTORY_FLAG_ALIVE) ? "" : " - crashed",
+             (step->flags & TRAJECTORY_FLAG_SUCCESS) ? " - finished" : "");
+    window_set_title(title);
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
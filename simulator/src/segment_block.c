@@ -0,0 +1,205 @@
+#include "segment_block.h"
+#include <math.h>
+#include <stdlib.h>
+#include "util.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#define PARALLEL_EPSILON 1e-10f // |determinant| below this counts as parallel, as in ray_segment_intersection
+
+SegmentBlock* segment_blocks_build(const struct BoundarySegment* segments, int count, int* block_count) {
+    *block_count = (count + SEGMENT_BLOCK_SIZE - 1) / SEGMENT_BLOCK_SIZE;
+    if (*block_count == 0) {
+        return NULL;
+    }
+
+    // xalloc zeroes, so the padding lanes are already zero-length segments
+    SegmentBlock* blocks = xalloc(*block_count, sizeof(SegmentBlock));
+    for (int i = 0; i < count; i++) {
+        SegmentBlock* block = &blocks[i / SEGMENT_BLOCK_SIZE];
+        int lane = i % SEGMENT_BLOCK_SIZE;
+        block->start_x[lane] = segments[i].start.x;
+        block->start_y[lane] = segments[i].start.y;
+        block->delta_x[lane] = segments[i].end.x - segments[i].start.x;
+        block->delta_y[lane] = segments[i].end.y - segments[i].start.y;
+    }
+    return blocks;
+}
+
+float segment_blocks_nearest_scalar(const SegmentBlock* blocks, int block_count, Point origin, float dx, float dy, float nearest) {
+    // Reference for the vector paths: t = t_num / det and s = s_num / det must land in t >= 0
+    // and 0 <= s <= 1. With the signs of both numerators flipped to make det positive, that is
+    // t_num >= 0 and 0 <= s_num <= |det|, which needs no division and rounds the same way.
+    for (int b = 0; b < block_count; b++) {
+        const SegmentBlock* block = &blocks[b];
+        for (int l = 0; l < SEGMENT_BLOCK_SIZE; l++) {
+            float sx = block->delta_x[l];
+            float sy = block->delta_y[l];
+            float ox = block->start_x[l] - origin.x;
+            float oy = block->start_y[l] - origin.y;
+            float determinant = dx * sy - dy * sx;
+            float t_num = ox * sy - oy * sx;
+            float s_num = ox * dy - oy * dx;
+            if (determinant < 0.0f) {
+                determinant = -determinant;
+                t_num = -t_num;
+                s_num = -s_num;
+            }
+            if (!(determinant >= PARALLEL_EPSILON && t_num >= 0 && s_num >= 0 && s_num <= determinant)) continue;
+
+            float t = t_num / determinant;
+            if (t < nearest) nearest = t;
+        }
+    }
+    return nearest;
+}
+
+#if defined(__AVX2__)
+
+float segment_blocks_nearest(const SegmentBlock* blocks, int block_count, Point origin, float dx, float dy, float nearest) {
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 epsilon = _mm256_set1_ps(PARALLEL_EPSILON);
+    const __m256 vdx = _mm256_set1_ps(dx), vdy = _mm256_set1_ps(dy);
+    const __m256 vox = _mm256_set1_ps(origin.x), voy = _mm256_set1_ps(origin.y);
+    __m256 best = _mm256_set1_ps(nearest);
+
+    for (int b = 0; b < block_count; b++) {
+        const SegmentBlock* block = &blocks[b];
+        __m256 sx = _mm256_loadu_ps(block->delta_x);
+        __m256 sy = _mm256_loadu_ps(block->delta_y);
+        __m256 ox = _mm256_sub_ps(_mm256_loadu_ps(block->start_x), vox);
+        __m256 oy = _mm256_sub_ps(_mm256_loadu_ps(block->start_y), voy);
+        __m256 det = _mm256_sub_ps(_mm256_mul_ps(vdx, sy), _mm256_mul_ps(vdy, sx));
+        __m256 t_num = _mm256_sub_ps(_mm256_mul_ps(ox, sy), _mm256_mul_ps(oy, sx));
+        __m256 s_num = _mm256_sub_ps(_mm256_mul_ps(ox, vdy), _mm256_mul_ps(oy, vdx));
+
+        __m256 det_sign = _mm256_and_ps(det, sign);
+        __m256 abs_det = _mm256_andnot_ps(sign, det);
+        t_num = _mm256_xor_ps(t_num, det_sign);
+        s_num = _mm256_xor_ps(s_num, det_sign);
+
+        __m256 valid = _mm256_and_ps(_mm256_cmp_ps(abs_det, epsilon, _CMP_GE_OQ), _mm256_cmp_ps(t_num, zero, _CMP_GE_OQ));
+        valid = _mm256_and_ps(valid, _mm256_cmp_ps(s_num, zero, _CMP_GE_OQ));
+        valid = _mm256_and_ps(valid, _mm256_cmp_ps(s_num, abs_det, _CMP_LE_OQ));
+
+        __m256 t = _mm256_div_ps(t_num, abs_det);
+        valid = _mm256_and_ps(valid, _mm256_cmp_ps(t, best, _CMP_LT_OQ));
+        best = _mm256_blendv_ps(best, t, valid);
+    }
+
+    float lanes[SEGMENT_BLOCK_SIZE];
+    _mm256_storeu_ps(lanes, best);
+    for (int l = 0; l < SEGMENT_BLOCK_SIZE; l++) {
+        if (lanes[l] < nearest) nearest = lanes[l];
+    }
+    return nearest;
+}
+
+#elif defined(__SSE2__)
+
+float segment_blocks_nearest(const SegmentBlock* blocks, int block_count, Point origin, float dx, float dy, float nearest) {
+    // Two 4-lane halves per block
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 epsilon = _mm_set1_ps(PARALLEL_EPSILON);
+    const __m128 vdx = _mm_set1_ps(dx), vdy = _mm_set1_ps(dy);
+    const __m128 vox = _mm_set1_ps(origin.x), voy = _mm_set1_ps(origin.y);
+    __m128 best[2] = {_mm_set1_ps(nearest), _mm_set1_ps(nearest)};
+
+    for (int b = 0; b < block_count; b++) {
+        const SegmentBlock* block = &blocks[b];
+        for (int h = 0; h < 2; h++) {
+            int o = h * 4;
+            __m128 sx = _mm_loadu_ps(block->delta_x + o);
+            __m128 sy = _mm_loadu_ps(block->delta_y + o);
+            __m128 ox = _mm_sub_ps(_mm_loadu_ps(block->start_x + o), vox);
+            __m128 oy = _mm_sub_ps(_mm_loadu_ps(block->start_y + o), voy);
+            __m128 det = _mm_sub_ps(_mm_mul_ps(vdx, sy), _mm_mul_ps(vdy, sx));
+            __m128 t_num = _mm_sub_ps(_mm_mul_ps(ox, sy), _mm_mul_ps(oy, sx));
+            __m128 s_num = _mm_sub_ps(_mm_mul_ps(ox, vdy), _mm_mul_ps(oy, vdx));
+
+            __m128 det_sign = _mm_and_ps(det, sign);
+            __m128 abs_det = _mm_andnot_ps(sign, det);
+            t_num = _mm_xor_ps(t_num, det_sign);
+            s_num = _mm_xor_ps(s_num, det_sign);
+
+            __m128 valid = _mm_and_ps(_mm_cmpge_ps(abs_det, epsilon), _mm_cmpge_ps(t_num, zero));
+            valid = _mm_and_ps(valid, _mm_cmpge_ps(s_num, zero));
+            valid = _mm_and_ps(valid, _mm_cmple_ps(s_num, abs_det));
+
+            __m128 t = _mm_div_ps(t_num, abs_det);
+            valid = _mm_and_ps(valid, _mm_cmplt_ps(t, best[h]));
+            best[h] = _mm_or_ps(_mm_and_ps(valid, t), _mm_andnot_ps(valid, best[h]));
+        }
+    }
+
+    float lanes[SEGMENT_BLOCK_SIZE];
+    _mm_storeu_ps(lanes, best[0]);
+    _mm_storeu_ps(lanes + 4, best[1]);
+    for (int l = 0; l < SEGMENT_BLOCK_SIZE; l++) {
+        if (lanes[l] < nearest) nearest = lanes[l];
+    }
+    return nearest;
+}
+
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+
+float segment_blocks_nearest(const SegmentBlock* blocks, int block_count, Point origin, float dx, float dy, float nearest) {
+    // Separate multiplies and subtracts (no vfms): fused ops would round differently from the scalar code
+    const uint32x4_t sign = vdupq_n_u32(0x80000000u);
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+    const float32x4_t epsilon = vdupq_n_f32(PARALLEL_EPSILON);
+    const float32x4_t vdx = vdupq_n_f32(dx), vdy = vdupq_n_f32(dy);
+    const float32x4_t vox = vdupq_n_f32(origin.x), voy = vdupq_n_f32(origin.y);
+    float32x4_t best[2] = {vdupq_n_f32(nearest), vdupq_n_f32(nearest)};
+
+    for (int b = 0; b < block_count; b++) {
+        const SegmentBlock* block = &blocks[b];
+        for (int h = 0; h < 2; h++) {
+            int o = h * 4;
+            float32x4_t sx = vld1q_f32(block->delta_x + o);
+            float32x4_t sy = vld1q_f32(block->delta_y + o);
+            float32x4_t ox = vsubq_f32(vld1q_f32(block->start_x + o), vox);
+            float32x4_t oy = vsubq_f32(vld1q_f32(block->start_y + o), voy);
+            float32x4_t det = vsubq_f32(vmulq_f32(vdx, sy), vmulq_f32(vdy, sx));
+            float32x4_t t_num = vsubq_f32(vmulq_f32(ox, sy), vmulq_f32(oy, sx));
+            float32x4_t s_num = vsubq_f32(vmulq_f32(ox, vdy), vmulq_f32(oy, vdx));
+
+            uint32x4_t det_sign = vandq_u32(vreinterpretq_u32_f32(det), sign);
+            float32x4_t abs_det = vabsq_f32(det);
+            t_num = vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(t_num), det_sign));
+            s_num = vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(s_num), det_sign));
+
+            uint32x4_t valid = vandq_u32(vcgeq_f32(abs_det, epsilon), vcgeq_f32(t_num, zero));
+            valid = vandq_u32(valid, vcgeq_f32(s_num, zero));
+            valid = vandq_u32(valid, vcleq_f32(s_num, abs_det));
+
+            float32x4_t t = vdivq_f32(t_num, abs_det);
+            valid = vandq_u32(valid, vcltq_f32(t, best[h]));
+            best[h] = vbslq_f32(valid, t, best[h]);
+        }
+    }
+
+    float lanes[SEGMENT_BLOCK_SIZE];
+    vst1q_f32(lanes, best[0]);
+    vst1q_f32(lanes + 4, best[1]);
+    for (int l = 0; l < SEGMENT_BLOCK_SIZE; l++) {
+        if (lanes[l] < nearest) nearest = lanes[l];
+    }
+    return nearest;
+}
+
+#else
+
+float segment_blocks_nearest(const SegmentBlock* blocks, int block_count, Point origin, float dx, float dy, float nearest) {
+    return segment_blocks_nearest_scalar(blocks, block_count, origin, dx, dy, nearest);
+}
+
+#endif
@@ -0,0 +1,167 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "sim_lib.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "trace.h"
+#include "util.h"
+
+#define CHUNK_ENVS 8 // Envs (items) claimed by a thread at a time
+
+// Each env is stepped by sim_env_step exactly as in a scalar loop and envs share nothing but
+// read-only track data, so the results are the same for any thread count or chunk order.
+
+struct SimBatch {
+    // Workers run chunks alongside the calling thread in sim_batch_for
+    int num_workers;
+    pthread_t* workers;
+    pthread_mutex_t lock;
+    pthread_cond_t work_ready;
+    pthread_cond_t work_done;
+    int generation;
+    int busy_workers;
+    int shutdown;
+    atomic_int next_chunk;
+
+    // Arguments of the current sim_batch_for
+    void (*fn)(void* ctx, int begin, int end);
+    void* ctx;
+    int num_items;
+};
+
+// Arguments of sim_batch_step, passed to step_range as ctx
+typedef struct {
+    SimEnv** envs;
+    const float* actions;
+    float* state_out;
+    float* reward_out;
+    int* alive_out;
+    int* success_out;
+} StepArgs;
+
+static void* worker_main(void* arg);
+static void run_chunks(SimBatch* batch);
+static void step_range(void* ctx, int begin, int end);
+
+SimBatch* sim_batch_create(int num_threads) {
+    if (num_threads <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        num_threads = cpus > 0 ? (int)cpus : 1;
+    }
+
+    SimBatch* batch = xalloc(1, sizeof(SimBatch));
+    pthread_mutex_init(&batch->lock, NULL);
+    pthread_cond_init(&batch->work_ready, NULL);
+    pthread_cond_init(&batch->work_done, NULL);
+
+    batch->workers = xalloc(num_threads, sizeof(pthread_t));
+    for (int i = 0; i < num_threads - 1; i++) {
+        if (pthread_create(&batch->workers[i], NULL, worker_main, batch) != 0) {
+            break; // Step with however many workers started
+        }
+        batch->num_workers++;
+    }
+    return batch;
+}
+
+void sim_batch_step(SimBatch* batch, SimEnv** envs, int num_envs, const float* actions,
+                    float* state_out, float* reward_out, int* alive_out, int* success_out) {
+    StepArgs args = {envs, actions, state_out, reward_out, alive_out, success_out};
+    uint64_t start = trace_begin();
+    sim_batch_for(batch, num_envs, step_range, &args);
+    trace_end("batch_step", start);
+}
+
+void sim_batch_for(SimBatch* batch, int num_items, void (*fn)(void* ctx, int begin, int end), void* ctx) {
+    batch->fn = fn;
+    batch->ctx = ctx;
+    batch->num_items = num_items;
+    atomic_store(&batch->next_chunk, 0);
+
+    // Small batches are not worth waking the workers for
+    if (batch->num_workers == 0 || num_items <= CHUNK_ENVS) {
+        run_chunks(batch);
+        return;
+    }
+
+    pthread_mutex_lock(&batch->lock);
+    batch->busy_workers = batch->num_workers;
+    batch->generation++;
+    pthread_cond_broadcast(&batch->work_ready);
+    pthread_mutex_unlock(&batch->lock);
+
+    run_chunks(batch);
+
+    pthread_mutex_lock(&batch->lock);
+    while (batch->busy_workers > 0) {
+        pthread_cond_wait(&batch->work_done, &batch->lock);
+    }
+    pthread_mutex_unlock(&batch->lock);
+}
+
+void sim_batch_destroy(SimBatch* batch) {
+    if (batch == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&batch->lock);
+    batch->shutdown = 1;
+    pthread_cond_broadcast(&batch->work_ready);
+    pthread_mutex_unlock(&batch->lock);
+    for (int i = 0; i < batch->num_workers; i++) {
+        pthread_join(batch->workers[i], NULL);
+    }
+
+    pthread_cond_destroy(&batch->work_done);
+    pthread_cond_destroy(&batch->work_ready);
+    pthread_mutex_destroy(&batch->lock);
+    free(batch->workers);
+    free(batch);
+}
+
+static void* worker_main(void* arg) {
+    SimBatch* batch = arg;
+    int seen_generation = 0;
+    trace_set_thread_name("sim_batch worker");
+
+    pthread_mutex_lock(&batch->lock);
+    while (1) {
+        while (!batch->shutdown && batch->generation == seen_generation) {
+            pthread_cond_wait(&batch->work_ready, &batch->lock);
+        }
+        if (batch->shutdown) {
+            break;
+        }
+        seen_generation = batch->generation;
+        pthread_mutex_unlock(&batch->lock);
+
+        run_chunks(batch);
+
+        pthread_mutex_lock(&batch->lock);
+        if (--batch->busy_workers == 0) {
+            pthread_cond_signal(&batch->work_done);
+        }
+    }
+    pthread_mutex_unlock(&batch->lock);
+    return NULL;
+}
+
+static void run_chunks(SimBatch* batch) {
+    int num_chunks = (batch->num_items + CHUNK_ENVS - 1) / CHUNK_ENVS;
+    int chunk;
+    while ((chunk = atomic_fetch_add(&batch->next_chunk, 1)) < num_chunks) {
+        uint64_t start = trace_begin();
+        int end = (chunk + 1) * CHUNK_ENVS < batch->num_items ? (chunk + 1) * CHUNK_ENVS : batch->num_items;
+        batch->fn(batch->ctx, chunk * CHUNK_ENVS, end);
+        trace_end("batch_chunk", start);
+    }
+}
+
+static void step_range(void* ctx, int begin, int end) {
+    StepArgs* args = ctx;
+    for (int i = begin; i < end; i++) {
+        sim_env_step(args->envs[i], args->actions[2 * i], args->actions[2 * i + 1],
+                     &args->state_out[12 * i], &args->reward_out[i], &args->alive_out[i], &args->success_out[i]);
+    }
+}
@@ -4,96 +4,463 @@
 #include "ray_cast.h"
 #include "quad_tree.h"
 #include "util.h"
+#include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 #include "track_collision.h"
 #include "car.h"
 #include "car_internals.h"
 #include "physics_constants.h"
 #include "track_internals.h"
+#include "track_registry.h"
+#include "trajectory.h"
+#include "philox.h"
+#include "sim_stats.h"
+#include "trace.h"
 
 #define MAX_SIM_STEPS 1000
 #define STEP_PENALTY 1e-9f
+#define SNAPSHOT_MAGIC 0x50414E53u // "SNAP"
+#define SNAPSHOT_VERSION 2u
 
-static Track* track = NULL;
-static QuadTreeNode* tree = NULL;
-static Car* car = NULL;
-static Point start_point;
-static float start_heading;
-static float prev_distance_traveled;
-static int prev_furthest_point_index = 0;
-static int sim_num = 0;
+struct SimEnv {
+    TrackEntry entry; // Holds a reference on entry.shared
+    int track_id;
+    Car* car;
+    float prev_distance_traveled;
+    int prev_furthest_point_index;
+    int sim_num;
+    TrajectoryWriter* recorder; // NULL unless recording
+    int episode_start;          // Next recorded step is the first after a reset
+    SimStats stats;             // Only counted in SIM_STATS builds
+};
 
-static void cast_rays();
-static void update_furthest_point_index();
+// Everything a step depends on besides the shared track; the layout of the snapshot blob
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t track_fingerprint; // SharedTrack.fingerprint: track ids are only valid in one process
+    int32_t track_id;
+    int32_t sim_num;
+    float prev_distance_traveled;
+    int32_t prev_furthest_point_index;
+    Car car;
+} SimSnapshot;
 
-int sim_init(const char* track_filename, float car_start_x, float car_start_y, float car_start_heading) {
-    track = load_track(track_filename);
-    if (track == NULL) {
-        return 1;
-    }
+_Static_assert(sizeof(SimSnapshot) <= SIM_SNAPSHOT_SIZE, "SIM_SNAPSHOT_SIZE too small for SimSnapshot");
 
-    tree = build_track_quadtree(track);
+// Environment behind the single-instance API (sim_init / sim_step / ...)
+static SimEnv* default_env = NULL;
+static int default_track_id = -1;
 
-    start_point.x = car_start_x;
-    start_point.y = car_start_y;
-    start_heading = car_start_heading;
+static void cast_rays(SimEnv* env);
+static void update_furthest_point_index(SimEnv* env);
+static void write_state(const SimEnv* env, float* state_out);
+static void record_step(SimEnv* env, float delta_accel, float delta_steering, float reward, int alive, int success);
+static int  recording_blocks_switch(const SimEnv* env, const TrackEntry* entry);
 
-    car = create_car(start_point, start_heading);
-    cast_rays();
-    prev_distance_traveled = 0;
-    prev_furthest_point_index = 0;
-    return 0;
+int sim_register_track(const char* track_filename, float car_start_x, float car_start_y, float car_start_heading) {
+    Point start_point = {car_start_x, car_start_y};
+    return track_registry_add(track_filename, start_point, car_start_heading);
 }
 
-void sim_reset(float* state_out) {
-    reset_car(car, start_point, start_heading);
-    cast_rays();
-    prev_distance_traveled = 0;
-    prev_furthest_point_index = 0;
-    sim_num = 0;
-    for (int i = 0; i < 9; i++) {
-        state_out[i] = car->ray_distances[i] / MAX_RAY_DISTANCE;
+int sim_unregister_track(int track_id) {
+    return track_registry_remove(track_id);
+}
+
+SimEnv* sim_env_create(int track_id) {
+    SimEnv* env = xalloc(1, sizeof(SimEnv));
+    if (track_registry_acquire(track_id, &env->entry) != 0) {
+        free(env);
+        return NULL;
     }
-    state_out[9] = car->speed / MAX_FORWARD_SPEED;
-    state_out[10] = car->acceleration / MAX_ACCELERATION;
-    state_out[11] = car->steering_angle / MAX_STEERING_ANGLE;
+    env->track_id = track_id;
+
+    env->car = create_car(env->entry.start_point, env->entry.start_heading);
+    cast_rays(env);
+    env->prev_distance_traveled = 0;
+    env->prev_furthest_point_index = 0;
+    env->sim_num = 0;
+    env->episode_start = 1;
+    return env;
 }
 
-void sim_step(float delta_accel, float delta_steering, float* state_out, float* reward_out, int* alive_out, int* success_out) {
-    sim_num++;
-    update_car_physics(car, delta_accel + car->acceleration, delta_steering + car->steering_angle, 1.0f);
-    cast_rays();
-    check_car_collision(car, tree);
-    update_furthest_point_index();
+int sim_env_reset(SimEnv* env, int track_id, float* state_out) {
+    // Moves the env onto track_id (or keeps its current track when track_id < 0) and resets
+    // the car to that track's start pose. Nothing is reallocated. Returns 1 for an unknown id,
+    // or for another track while recording.
+    if (track_id >= 0) {
+        TrackEntry entry;
+        if (track_registry_acquire(track_id, &entry) != 0) {
+            return 1;
+        }
+        if (recording_blocks_switch(env, &entry)) {
+            track_registry_release(entry.shared);
+            return 1;
+        }
+        track_registry_release(env->entry.shared);
+        env->entry = entry;
+        env->track_id = track_id;
+    }
 
-    for (int i = 0; i < 9; i++) {
-        state_out[i] = car->ray_distances[i] / MAX_RAY_DISTANCE;
+    reset_car(env->car, env->entry.start_point, env->entry.start_heading);
+    cast_rays(env);
+    env->prev_distance_traveled = 0;
+    env->prev_furthest_point_index = 0;
+    env->sim_num = 0;
+    env->episode_start = 1;
+    if (state_out) {
+        write_state(env, state_out);
     }
-    state_out[9] = car->speed / MAX_FORWARD_SPEED;
-    state_out[10] = car->acceleration / MAX_ACCELERATION;
-    state_out[11] = car->steering_angle / MAX_STEERING_ANGLE;
+    return 0;
+}
+
+void sim_env_step(SimEnv* env, float delta_accel, float delta_steering, float* state_out, float* reward_out, int* alive_out, int* success_out) {
+    Car* car = env->car;
+    const Track* track = env->entry.shared->track;
+
+#ifdef SIM_STATS
+    SimStats* outer_stats = sim_stats_current;
+    sim_stats_current = &env->stats;
+    env->stats.steps++;
+#endif
+    SIM_STATS_TIMER(timer);
+    uint64_t step_start = trace_begin();
+    uint64_t phase_start = step_start;
+
+    env->sim_num++;
+    update_car_physics(car, delta_accel + car->acceleration, delta_steering + car->steering_angle, 1.0f);
+    SIM_STATS_LAP(timer, ticks_physics);
+    trace_lap("physics", &phase_start);
+    cast_rays(env);
+    SIM_STATS_LAP(timer, ticks_rays);
+    trace_lap("rays", &phase_start);
+    check_car_collision(car, env->entry.shared->tree);
+    SIM_STATS_LAP(timer, ticks_collision);
+    trace_lap("collision", &phase_start);
+    update_furthest_point_index(env);
+    SIM_STATS_LAP(timer, ticks_progress);
+    trace_end("progress", phase_start);
+
+    write_state(env, state_out);
 
-    *reward_out = track->cumulative_length[car->furthest_point_index] - track->cumulative_length[prev_furthest_point_index] - (sim_num * STEP_PENALTY);
-    prev_distance_traveled = car->total_distance_traveled;
-    if (sim_num >= MAX_SIM_STEPS) {
+    *reward_out = track->cumulative_length[car->furthest_point_index] - track->cumulative_length[env->prev_furthest_point_index] - (env->sim_num * STEP_PENALTY);
+    env->prev_distance_traveled = car->total_distance_traveled;
+    if (env->sim_num >= MAX_SIM_STEPS) {
         car->is_alive = false;
     }
     *alive_out = car->is_alive;
-    Point finish_pt   = track->left_boundary.points[track->left_boundary.count - 1];
-    Point finish_prev = track->left_boundary.points[track->left_boundary.count - 2];
-    float dir_x = finish_pt.x - finish_prev.x;
-    float dir_y = finish_pt.y - finish_prev.y;
-    float to_car_x = car->position.x - finish_pt.x;
-    float to_car_y = car->position.y - finish_pt.y;
-    float len = sqrtf(dir_x * dir_x + dir_y * dir_y);
-    float norm_x = dir_x / len;
-    float norm_y = dir_y / len;
-    float forward = to_car_x * norm_x + to_car_y * norm_y;
-    float lateral = to_car_x * (-norm_y) + to_car_y * norm_x;
-    *success_out = forward >= 0.0f && fabsf(lateral) < 5.0f;
+    *success_out = track_reached_finish(track, car->position);
+
+    if (env->recorder) {
+        record_step(env, delta_accel, delta_steering, *reward_out, *alive_out, *success_out);
+    }
+    trace_end("sim_step", step_start);
+#ifdef SIM_STATS
+    sim_stats_current = outer_stats;
+#endif
+}
+
+void sim_env_get_state(SimEnv* env, float* state_out) {
+    write_state(env, state_out);
+}
+
+void sim_env_step_with_jacobian(SimEnv* env, float delta_accel, float delta_steering, float* state_out, float* reward_out,
+                                int* alive_out, int* success_out, SimJacobian* jacobian_out) {
+    // The physics runs twice: once in forward mode on the seeded pre-step state for the
+    // derivatives, then for real through sim_env_step, so the step is exactly the plain one
+    Car* car = env->car;
+    float before[SIM_CAR_STATE];
+    sim_env_get_car_state(env, before);
+    CarDual dual;
+    Dual* inputs[SIM_CAR_STATE] = {&dual.x, &dual.y, &dual.velocity_x, &dual.velocity_y,
+                                   &dual.acceleration, &dual.steering_angle, &dual.heading};
+    for (int i = 0; i < SIM_CAR_STATE; i++) {
+        *inputs[i] = dual_var(before[i], i);
+    }
+    dual.speed = dual_const(car->speed);
+    Dual acceleration = dual_add(dual_var(delta_accel, SIM_CAR_STATE), dual.acceleration);
+    Dual steering_angle = dual_add(dual_var(delta_steering, SIM_CAR_STATE + 1), dual.steering_angle);
+    update_car_physics_dual(car, &dual, acceleration, steering_angle, 1.0f);
+
+    sim_env_step(env, delta_accel, delta_steering, state_out, reward_out, alive_out, success_out);
+
+    SimJacobian* jac = jacobian_out;
+    for (int i = 0; i < SIM_CAR_STATE; i++) {
+        for (int k = 0; k < SIM_JAC_INPUTS; k++) {
+            jac->car_state[i][k] = inputs[i]->d[k];
+        }
+    }
+
+    // Rays move with the new position and heading
+    float gradients[NUM_RAYS][3];
+    ray_fan_gradients(env->entry.shared->tree, car->position, car->heading, MAX_RAY_DISTANCE, car->ray_distances, gradients);
+    for (int j = 0; j < NUM_RAYS; j++) {
+        for (int k = 0; k < SIM_JAC_INPUTS; k++) {
+            jac->state[j][k] = (gradients[j][0] * dual.x.d[k] + gradients[j][1] * dual.y.d[k] +
+                                gradients[j][2] * dual.heading.d[k]) / MAX_RAY_DISTANCE;
+        }
+    }
+    for (int k = 0; k < SIM_JAC_INPUTS; k++) {
+        jac->state[9][k] = dual.speed.d[k] / MAX_FORWARD_SPEED;
+        jac->state[10][k] = dual.acceleration.d[k] / MAX_ACCELERATION;
+        jac->state[11][k] = dual.steering_angle.d[k] / MAX_STEERING_ANGLE;
+    }
+
+    // The reward counts whole boundary points passed, so its exact derivative is zero almost
+    // everywhere. Instead it is differentiated as the arc length of the car's projection onto the
+    // nearest left boundary segment: moving along that segment's direction at or beyond the
+    // furthest point reached so far gains reward one for one.
+    const Track* track = env->entry.shared->track;
+    int nearest = nearest_left_segment_index(track, env->entry.shared->tree, car->position);
+    for (int k = 0; k < SIM_JAC_INPUTS; k++) {
+        jac->reward[k] = 0.0f;
+    }
+    if (nearest >= 0 && nearest >= env->prev_furthest_point_index) {
+        const struct BoundarySegment* segment = &track->left_boundary_segments[nearest];
+        float tangent_x = (segment->end.x - segment->start.x) / segment->length;
+        float tangent_y = (segment->end.y - segment->start.y) / segment->length;
+        for (int k = 0; k < SIM_JAC_INPUTS; k++) {
+            jac->reward[k] = tangent_x * dual.x.d[k] + tangent_y * dual.y.d[k];
+        }
+    }
+}
+
+void sim_env_get_car_state(const SimEnv* env, float* car_state_out) {
+    const Car* car = env->car;
+    car_state_out[0] = car->position.x;
+    car_state_out[1] = car->position.y;
+    car_state_out[2] = car->velocity.x;
+    car_state_out[3] = car->velocity.y;
+    car_state_out[4] = car->acceleration;
+    car_state_out[5] = car->steering_angle;
+    car_state_out[6] = car->heading;
+}
+
+void sim_env_set_car_state(SimEnv* env, const float* car_state) {
+    // For perturbation studies and finite-difference checks; episode progress is left alone.
+    // speed is derived, as the step leaves it: the velocity along the heading.
+    Car* car = env->car;
+    car->position.x = car_state[0];
+    car->position.y = car_state[1];
+    car->velocity.x = car_state[2];
+    car->velocity.y = car_state[3];
+    car->acceleration = car_state[4];
+    car->steering_angle = car_state[5];
+    car->heading = car_state[6];
+    car->speed = car->velocity.x * sim_cosf(car->heading) + car->velocity.y * sim_sinf(car->heading);
+    cast_rays(env);
+}
+
+int sim_env_record_start(SimEnv* env, const char* path) {
+    // Starts (or restarts) logging every step of this env to a trajectory file
+    sim_env_record_stop(env);
+    env->recorder = trajectory_writer_open(path, env->entry.shared->path, env->entry.start_point, env->entry.start_heading);
+    return env->recorder == NULL;
+}
+
+int sim_env_record_stop(SimEnv* env) {
+    if (env->recorder == NULL) {
+        return 0;
+    }
+    int result = trajectory_writer_close(env->recorder);
+    env->recorder = NULL;
+    return result;
+}
+
+void sim_env_snapshot(const SimEnv* env, void* snapshot_out) {
+    SimSnapshot snapshot;
+    memset(&snapshot, 0, sizeof(snapshot));
+    snapshot.magic = SNAPSHOT_MAGIC;
+    snapshot.version = SNAPSHOT_VERSION;
+    snapshot.track_fingerprint = env->entry.shared->fingerprint;
+    snapshot.track_id = env->track_id;
+    snapshot.sim_num = env->sim_num;
+    snapshot.prev_distance_traveled = env->prev_distance_traveled;
+    snapshot.prev_furthest_point_index = env->prev_furthest_point_index;
+    snapshot.car = *env->car;
+
+    memset(snapshot_out, 0, SIM_SNAPSHOT_SIZE);
+    memcpy(snapshot_out, &snapshot, sizeof(snapshot));
+}
+
+static int snapshot_indices_valid(const SimSnapshot* snapshot, const Track* track) {
+    // The progress indices address the left boundary, so a corrupt or edited blob must not
+    // point past it
+    int count = track->left_boundary.count;
+    return snapshot->car.furthest_point_index >= 0 && snapshot->car.furthest_point_index < count &&
+           snapshot->prev_furthest_point_index >= 0 && snapshot->prev_furthest_point_index < count;
+}
+
+int sim_env_restore(SimEnv* env, const void* snapshot_in) {
+    // Puts the env back in the snapshotted state, moving it to the snapshot's track if needed.
+    // The buffer may come from any env, or from another process built from the same sources.
+    // Track ids are per process, so the track is checked by fingerprint: the snapshot's id is
+    // used if it names the same track here, else the env stays on its own track if that one
+    // matches, else the snapshot is rejected.
+    SimSnapshot snapshot;
+    memcpy(&snapshot, snapshot_in, sizeof(snapshot));
+    if (snapshot.magic != SNAPSHOT_MAGIC || snapshot.version != SNAPSHOT_VERSION) {
+        return 1;
+    }
+
+    int own_track = env->entry.shared->fingerprint == snapshot.track_fingerprint;
+    if (snapshot.track_id != env->track_id || !own_track) {
+        TrackEntry entry;
+        int found = track_registry_acquire(snapshot.track_id, &entry) == 0;
+        if (found && entry.shared->fingerprint != snapshot.track_fingerprint) {
+            track_registry_release(entry.shared);
+            found = 0;
+        }
+        if (found) {
+            if (!snapshot_indices_valid(&snapshot, entry.shared->track) || recording_blocks_switch(env, &entry)) {
+                track_registry_release(entry.shared);
+                return 1;
+            }
+            track_registry_release(env->entry.shared);
+            env->entry = entry;
+            env->track_id = snapshot.track_id;
+        } else if (!own_track) {
+            return 1;
+        }
+    }
+    if (!snapshot_indices_valid(&snapshot, env->entry.shared->track)) {
+        return 1;
+    }
+
+    *env->car = snapshot.car;
+    env->sim_num = snapshot.sim_num;
+    env->prev_distance_traveled = snapshot.prev_distance_traveled;
+    env->prev_furthest_point_index = snapshot.prev_furthest_point_index;
+    env->episode_start = 1; // A recording jumps here, so mark it like a reset
+    return 0;
+}
+
+int sim_env_get_stats(const SimEnv* env, SimStats* stats_out) {
+    *stats_out = env->stats;
+    return sim_stats_enabled();
+}
+
+void sim_env_reset_stats(SimEnv* env) {
+    memset(&env->stats, 0, sizeof(env->stats));
+}
+
+int sim_stats_enabled(void) {
+#ifdef SIM_STATS
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+void sim_env_destroy(SimEnv* env) {
+    if (env == NULL) {
+        return;
+    }
+    sim_env_record_stop(env);
+    track_registry_release(env->entry.shared);
+    destroy_car(env->car);
+    free(env);
+}
+
+int sim_init(const char* track_filename, float car_start_x, float car_start_y, float car_start_heading) {
+    default_track_id = sim_register_track(track_filename, car_start_x, car_start_y, car_start_heading);
+    if (default_track_id < 0) {
+        return 1;
+    }
+
+    default_env = sim_env_create(default_track_id);
+    if (default_env == NULL) {
+        sim_unregister_track(default_track_id);
+        return 1;
+    }
+    return 0;
+}
+
+void sim_reset(float* state_out) {
+    sim_env_reset(default_env, -1, state_out);
+}
+
+void sim_step(float delta_accel, float delta_steering, float* state_out, float* reward_out, int* alive_out, int* success_out) {
+    sim_env_step(default_env, delta_accel, delta_steering, state_out, reward_out, alive_out, success_out);
 }
 
 void sim_get_state(float* state_out) {
+    sim_env_get_state(default_env, state_out);
+}
+
+void sim_step_with_jacobian(float delta_accel, float delta_steering, float* state_out, float* reward_out, int* alive_out, int* success_out, SimJacobian* jacobian_out) {
+    sim_env_step_with_jacobian(default_env, delta_accel, delta_steering, state_out, reward_out, alive_out, success_out, jacobian_out);
+}
+
+void sim_get_car_state(float* car_state_out) {
+    sim_env_get_car_state(default_env, car_state_out);
+}
+
+void sim_set_car_state(const float* car_state) {
+    sim_env_set_car_state(default_env, car_state);
+}
+
+int sim_record_start(const char* path) {
+    return sim_env_record_start(default_env, path);
+}
+
+int sim_record_stop(void) {
+    return sim_env_record_stop(default_env);
+}
+
+void sim_snapshot(void* snapshot_out) {
+    sim_env_snapshot(default_env, snapshot_out);
+}
+
+int sim_restore(const void* snapshot) {
+    return sim_env_restore(default_env, snapshot);
+}
+
+int sim_snapshot_size(void) {
+    return SIM_SNAPSHOT_SIZE;
+}
+
+int sim_get_stats(SimStats* stats_out) {
+    return sim_env_get_stats(default_env, stats_out);
+}
+
+void sim_reset_stats(void) {
+    sim_env_reset_stats(default_env);
+}
+
+int sim_trace_start(const char* path) {
+    return trace_start(path);
+}
+
+int sim_trace_stop(void) {
+    return trace_stop();
+}
+
+unsigned long long sim_trace_begin(void) {
+    return trace_begin();
+}
+
+void sim_trace_end(const char* name, unsigned long long start) {
+    if (start != 0) {
+        trace_end(trace_intern(name), start);
+    }
+}
+
+void sim_rng_normals(unsigned long long seed, unsigned int episode, unsigned int step, unsigned int car, float* out, int n) {
+    philox_normals(seed, episode, step, car, out, n);
+}
+
+void sim_close(void) {
+    sim_env_destroy(default_env);
+    sim_unregister_track(default_track_id);
+    default_env = NULL;
+    default_track_id = -1;
+}
+
+static void write_state(const SimEnv* env, float* state_out) {
+    const Car* car = env->car;
     for (int i = 0; i < 9; i++) {
         state_out[i] = car->ray_distances[i] / MAX_RAY_DISTANCE;
     }
@@ -102,64 +469,48 @@ void sim_get_state(float* state_out) {
     state_out[11] = car->steering_angle / MAX_STEERING_ANGLE;
 }
 
-void sim_close(void) {
-    free_quadtree(tree);
-    free_track(track);
-    destroy_car(car);
+static void cast_rays(SimEnv* env) {
+    Car* car = env->car;
+    SIM_STATS_ADD(rays, NUM_RAYS);
+    cast_ray_fan(env->entry.shared->tree, car->position, car->heading, MAX_RAY_DISTANCE, car->ray_distances);
 }
 
-static void cast_rays() {
-    for (int j = 0; j < NUM_RAYS; j++) {
-        car->ray_distances[j] = cast_ray(tree, car->position,car->heading + RAY_ANGLES[j], MAX_RAY_DISTANCE).distance;
-    }
-}
-
-static void update_furthest_point_index() {
-    prev_furthest_point_index = car->furthest_point_index;
-    float padding = 5.0f;
-    Bounds query_bounds = {
-        car->position.x - padding,
-        car->position.y - padding,
-        car->position.x + padding,
-        car->position.y + padding
-    };
-
-    struct BoundarySegment results[MAX_COLLISION_CHECKS];
-    int count = 0;
-    query_region(tree, &query_bounds, results, &count, MAX_COLLISION_CHECKS);
-
-    float min_dist = 1e30f;
-    struct BoundarySegment* nearest = NULL;
-
-    for (int i = 0; i < count; i++) {
-        if (results[i].type != BOUNDARY_LEFT) continue;
-        float seg_dx = results[i].end.x - results[i].start.x;
-        float seg_dy = results[i].end.y - results[i].start.y;
-        float to_x = car->position.x - results[i].start.x;
-        float to_y = car->position.y - results[i].start.y;
-        float t = (to_x * seg_dx + to_y * seg_dy) / (results[i].length * results[i].length);
-        if (t < 0.0f) t = 0.0f;
-        if (t > 1.0f) t = 1.0f;
-        float cx = results[i].start.x + t * seg_dx;
-        float cy = results[i].start.y + t * seg_dy;
-        float dx = car->position.x - cx;
-        float dy = car->position.y - cy;
-        float d = dx * dx + dy * dy;
-        if (d < min_dist) {
-            min_dist = d;
-            nearest = &results[i];
-        }
+static void update_furthest_point_index(SimEnv* env) {
+    Car* car = env->car;
+
+    env->prev_furthest_point_index = car->furthest_point_index;
+    int nearest = nearest_left_segment_index(env->entry.shared->track, env->entry.shared->tree, car->position);
+    if (nearest > car->furthest_point_index) {
+        car->furthest_point_index = nearest;
     }
+}
 
-    if (nearest == NULL) return;
+static void record_step(SimEnv* env, float delta_accel, float delta_steering, float reward, int alive, int success) {
+    const Car* car = env->car;
+    TrajectoryStep step;
+    step.position = car->position;
+    step.heading = car->heading;
+    step.speed = car->speed;
+    step.acceleration = car->acceleration;
+    step.steering_angle = car->steering_angle;
+    step.action[0] = delta_accel;
+    step.action[1] = delta_steering;
+    for (int i = 0; i < NUM_RAYS; i++) {
+        step.ray_distances[i] = car->ray_distances[i];
+    }
+    step.reward = reward;
+    step.flags = (alive ? TRAJECTORY_FLAG_ALIVE : 0) | (success ? TRAJECTORY_FLAG_SUCCESS : 0) |
+                 (env->episode_start ? TRAJECTORY_FLAG_EPISODE_START : 0);
+    env->episode_start = 0;
+    trajectory_writer_append(env->recorder, &step);
+}
 
-    for (int i = 0; i < track->left_boundary.count - 1; i++) {
-        if (track->left_boundary_segments[i].start.x == nearest->start.x &&
-            track->left_boundary_segments[i].start.y == nearest->start.y) {
-            if (i > car->furthest_point_index) {
-                car->furthest_point_index = i;
-            }
-            break;
-        }
+static int recording_blocks_switch(const SimEnv* env, const TrackEntry* entry) {
+    // A trajectory file names one track in its header, so a recording env stays on that track
+    if (env->recorder == NULL || entry->shared == env->entry.shared) {
+        return 0;
     }
+    fprintf(stderr, "Env is recording on %s; stop the recording before moving it to %s\n",
+            env->entry.shared->path, entry->shared->path);
+    return 1;
 }
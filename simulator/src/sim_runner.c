@@ -0,0 +1,294 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "sim_runner.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "philox.h"
+#include "physics_constants.h"
+#include "trace.h"
+#include "track_collision.h"
+#include "util.h"
+
+#define MAX_BACKLOG_STEPS 1000  // Sim time the accumulator may owe before it drops the rest
+#define PUBLISH_INTERVAL  0.004 // Longest stretch of wall time between two published states (s)
+
+typedef struct {
+    Car* prev;              // State one step before curr
+    Car* curr;
+    PolicyStatus* status;
+    float* fitness;
+    double alpha;           // Fraction of a step the sim clock was past curr when published
+    double wall_time;       // When it was published
+} SimFrame;
+
+struct SimRunner {
+    SimRunnerConfig config;
+
+    // Owned by the sim thread
+    Car* cars;
+    Car* prev_cars;
+    PolicyStatus* status;
+    float* fitness;
+    float* noise;      // [population][NN_OUTPUT] for the current step
+    uint32_t episode;  // Restarts of the population so far
+    uint32_t step;     // Steps since the last restart
+    int running;
+
+    // Shared with the render thread under lock
+    pthread_mutex_t lock;
+    SimFrame published;
+    float speed;
+    int paused;
+    int stop;
+
+    pthread_t thread;
+};
+
+static void* sim_thread_main(void* arg);
+static void reset_population(SimRunner* runner);
+static void step_population(SimRunner* runner);
+static void publish(SimRunner* runner, double alpha, double wall_time);
+static float lerp_angle(float a, float b, float t);
+static double now_seconds(void);
+
+SimRunner* sim_runner_create(const SimRunnerConfig* config) {
+    int n = config->population;
+    SimRunner* runner = xalloc(1, sizeof(SimRunner));
+    runner->config = *config;
+    runner->cars = xalloc(n, sizeof(Car));
+    runner->prev_cars = xalloc(n, sizeof(Car));
+    runner->status = xalloc(n, sizeof(PolicyStatus));
+    runner->fitness = xalloc(n, sizeof(float));
+    runner->noise = xalloc((size_t)n * NN_OUTPUT, sizeof(float));
+    runner->published.prev = xalloc(n, sizeof(Car));
+    runner->published.curr = xalloc(n, sizeof(Car));
+    runner->published.status = xalloc(n, sizeof(PolicyStatus));
+    runner->published.fitness = xalloc(n, sizeof(float));
+    runner->speed = SIM_RUNNER_MIN_SPEED;
+    pthread_mutex_init(&runner->lock, NULL);
+
+    reset_population(runner);
+    publish(runner, 0.0, now_seconds());
+
+    if (pthread_create(&runner->thread, NULL, sim_thread_main, runner) != 0) {
+        pthread_mutex_destroy(&runner->lock);
+        free(runner->published.fitness);
+        free(runner->published.status);
+        free(runner->published.curr);
+        free(runner->published.prev);
+        free(runner->noise);
+        free(runner->fitness);
+        free(runner->status);
+        free(runner->prev_cars);
+        free(runner->cars);
+        free(runner);
+        return NULL;
+    }
+    return runner;
+}
+
+void sim_runner_destroy(SimRunner* runner) {
+    if (runner == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&runner->lock);
+    runner->stop = 1;
+    pthread_mutex_unlock(&runner->lock);
+    pthread_join(runner->thread, NULL);
+
+    pthread_mutex_destroy(&runner->lock);
+    free(runner->published.fitness);
+    free(runner->published.status);
+    free(runner->published.curr);
+    free(runner->published.prev);
+    free(runner->noise);
+    free(runner->fitness);
+    free(runner->status);
+    free(runner->prev_cars);
+    free(runner->cars);
+    free(runner);
+}
+
+void sim_runner_set_speed(SimRunner* runner, float speed) {
+    speed = fminf(fmaxf(speed, SIM_RUNNER_MIN_SPEED), SIM_RUNNER_MAX_SPEED);
+    pthread_mutex_lock(&runner->lock);
+    runner->speed = speed;
+    pthread_mutex_unlock(&runner->lock);
+}
+
+float sim_runner_get_speed(SimRunner* runner) {
+    pthread_mutex_lock(&runner->lock);
+    float speed = runner->speed;
+    pthread_mutex_unlock(&runner->lock);
+    return speed;
+}
+
+void sim_runner_set_paused(SimRunner* runner, int paused) {
+    pthread_mutex_lock(&runner->lock);
+    runner->paused = paused;
+    pthread_mutex_unlock(&runner->lock);
+}
+
+int sim_runner_is_paused(SimRunner* runner) {
+    pthread_mutex_lock(&runner->lock);
+    int paused = runner->paused;
+    pthread_mutex_unlock(&runner->lock);
+    return paused;
+}
+
+void sim_runner_interpolate(SimRunner* runner, Car* cars, PolicyStatus* status, float* fitness) {
+    int n = runner->config.population;
+
+    pthread_mutex_lock(&runner->lock);
+    const SimFrame* frame = &runner->published;
+    // Extrapolate how far the sim clock has moved past curr since it was published
+    double alpha = frame->alpha;
+    if (!runner->paused) {
+        alpha += (now_seconds() - frame->wall_time) * runner->speed / runner->config.dt;
+    }
+    float t = alpha < 1.0 ? (float)alpha : 1.0f;
+
+    for (int i = 0; i < n; i++) {
+        const Car* a = &frame->prev[i];
+        const Car* b = &frame->curr[i];
+        cars[i] = *b;
+        cars[i].position.x = a->position.x + (b->position.x - a->position.x) * t;
+        cars[i].position.y = a->position.y + (b->position.y - a->position.y) * t;
+        cars[i].heading = lerp_angle(a->heading, b->heading, t);
+        for (int j = 0; j < NUM_RAYS; j++) {
+            cars[i].ray_distances[j] = a->ray_distances[j] + (b->ray_distances[j] - a->ray_distances[j]) * t;
+        }
+    }
+    memcpy(status, frame->status, sizeof(PolicyStatus) * n);
+    memcpy(fitness, frame->fitness, sizeof(float) * n);
+    pthread_mutex_unlock(&runner->lock);
+}
+
+static void* sim_thread_main(void* arg) {
+    SimRunner* runner = arg;
+    double dt = runner->config.dt;
+    double accumulator = 0.0;
+    double last = now_seconds();
+    trace_set_thread_name("sim_runner");
+
+    while (1) {
+        pthread_mutex_lock(&runner->lock);
+        int stop = runner->stop;
+        int paused = runner->paused;
+        double speed = runner->speed;
+        pthread_mutex_unlock(&runner->lock);
+        if (stop) {
+            break;
+        }
+
+        double tick_start = now_seconds();
+        accumulator += paused ? 0.0 : (tick_start - last) * speed;
+        last = tick_start;
+        if (accumulator > MAX_BACKLOG_STEPS * dt) {
+            // The CPU cannot keep up with this speed: run flat out instead of piling up debt
+            accumulator = MAX_BACKLOG_STEPS * dt;
+        }
+
+        int stepped = 0;
+        while (accumulator >= dt && now_seconds() - tick_start < PUBLISH_INTERVAL) {
+            step_population(runner);
+            accumulator -= dt;
+            stepped = 1;
+        }
+        if (stepped) {
+            publish(runner, accumulator / dt, now_seconds());
+        }
+
+        // Sleep until the next step is due (at most 1 ms so speed changes apply promptly)
+        double wait = paused ? 1e-3 : (dt - accumulator) / speed;
+        if (wait > 1e-3) wait = 1e-3;
+        if (wait > 0.0) {
+            struct timespec ts = {0, (long)(wait * 1e9)};
+            nanosleep(&ts, NULL);
+        }
+    }
+    return NULL;
+}
+
+static void reset_population(SimRunner* runner) {
+    const SimRunnerConfig* config = &runner->config;
+    for (int i = 0; i < config->population; i++) {
+        Car* car = &runner->cars[i];
+        reset_car(car, config->start_point, config->start_heading);
+        policy_cast_rays(car, config->tree);
+        runner->status[i] = POLICY_RUNNING;
+        runner->fitness[i] = 0.0f;
+    }
+    // No interpolation across a restart
+    memcpy(runner->prev_cars, runner->cars, sizeof(Car) * config->population);
+    runner->running = config->population;
+    runner->step = 0;
+}
+
+static void step_population(SimRunner* runner) {
+    const SimRunnerConfig* config = &runner->config;
+    const Track* track = config->track;
+
+    if (runner->running == 0) {
+        runner->episode++;
+        reset_population(runner);
+        return;
+    }
+
+    uint64_t start = trace_begin();
+    memcpy(runner->prev_cars, runner->cars, sizeof(Car) * config->population);
+    if (config->sigma > 0.0f) {
+        philox_normals_batch(config->seed, runner->episode, runner->step, 0, config->population, NN_OUTPUT, runner->noise);
+    }
+    runner->step++;
+    runner->running = 0;
+    for (int i = 0; i < config->population; i++) {
+        if (runner->status[i] != POLICY_RUNNING) continue;
+
+        Car* car = &runner->cars[i];
+        float noise[NN_OUTPUT];
+        for (int k = 0; k < NN_OUTPUT; k++) {
+            noise[k] = config->sigma * runner->noise[i * NN_OUTPUT + k];
+        }
+        runner->status[i] = policy_step_noisy(config->nn, car, track, config->tree, config->dt,
+                                              config->sigma > 0.0f ? noise : NULL);
+
+        int nearest = nearest_left_segment_index(track, config->tree, car->position);
+        if (nearest > car->furthest_point_index) {
+            car->furthest_point_index = nearest;
+        }
+        runner->fitness[i] = runner->status[i] == POLICY_FINISHED
+            ? 1.0f : track->cumulative_length[car->furthest_point_index] / track->total_length;
+        if (runner->status[i] == POLICY_RUNNING) runner->running++;
+    }
+    trace_end("population_step", start);
+}
+
+static void publish(SimRunner* runner, double alpha, double wall_time) {
+    int n = runner->config.population;
+    pthread_mutex_lock(&runner->lock);
+    memcpy(runner->published.prev, runner->prev_cars, sizeof(Car) * n);
+    memcpy(runner->published.curr, runner->cars, sizeof(Car) * n);
+    memcpy(runner->published.status, runner->status, sizeof(PolicyStatus) * n);
+    memcpy(runner->published.fitness, runner->fitness, sizeof(float) * n);
+    runner->published.alpha = alpha;
+    runner->published.wall_time = wall_time;
+    pthread_mutex_unlock(&runner->lock);
+}
+
+static float lerp_angle(float a, float b, float t) {
+    // Along the shorter way round
+    float diff = fmodf(b - a, 2.0f * PI);
+    if (diff > PI) diff -= 2.0f * PI;
+    if (diff < -PI) diff += 2.0f * PI;
+    return a + diff * t;
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
@@ -0,0 +1,5 @@
+#include "sim_stats.h"
+
+#ifdef SIM_STATS
+_Thread_local SimStats* sim_stats_current = NULL; // Stats of the env being stepped on this thread
+#endif
@@ -0,0 +1,131 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "sim_lib.h"
+
+// Hashes 1M sim steps (NUM_ENVS envs x NUM_TEST_STEPS) stepped one by one and through SimBatch
+// with several thread counts; all hashes must match. Built with DETERMINISTIC=1 the hash must
+// also equal GOLDEN_HASH, which is the same on every machine.
+//   make DETERMINISTIC=1 test_determinism && ./test_determinism
+
+#define NUM_STATE 12
+#define NUM_ENVS 64
+#define NUM_TEST_STEPS 15625
+#define TRACK "tracks/test.txt"
+#define GOLDEN_HASH 0x6b7004a2fbfb1b4eull
+
+static uint64_t hash_bytes(uint64_t hash, const void* data, size_t size) {
+    // FNV-1a
+    const uint8_t* bytes = data;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static float action(int env, int step, int k) {
+    // Smooth pseudo-random action in [-0.125, 0.125] from integer ops only
+    uint32_t x = (uint32_t)env * 0x9E3779B1u ^ (uint32_t)(step / 16) * 0x85EBCA77u ^ (uint32_t)k * 0xC2B2AE3Du;
+    x ^= x >> 15;
+    x *= 0x2C1B3C6Du;
+    x ^= x >> 12;
+    return ((int32_t)(x >> 8) - (1 << 23)) * (1.0f / (1 << 26));
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Steps every env NUM_TEST_STEPS times (through batch unless NULL), resetting finished episodes
+static uint64_t run(SimEnv** envs, SimBatch* batch) {
+    static float actions[NUM_ENVS * 2];
+    static float state[NUM_ENVS * NUM_STATE];
+    static float reward[NUM_ENVS];
+    static int alive[NUM_ENVS];
+    static int success[NUM_ENVS];
+    uint64_t hash = 0xcbf29ce484222325ull;
+
+    for (int i = 0; i < NUM_ENVS; i++) {
+        sim_env_reset(envs[i], -1, &state[NUM_STATE * i]);
+    }
+    for (int step = 0; step < NUM_TEST_STEPS; step++) {
+        for (int i = 0; i < NUM_ENVS; i++) {
+            actions[2 * i] = action(i, step, 0) + 0.03f;
+            actions[2 * i + 1] = action(i, step, 1);
+        }
+        if (batch) {
+            sim_batch_step(batch, envs, NUM_ENVS, actions, state, reward, alive, success);
+        } else {
+            for (int i = 0; i < NUM_ENVS; i++) {
+                sim_env_step(envs[i], actions[2 * i], actions[2 * i + 1], &state[NUM_STATE * i], &reward[i], &alive[i], &success[i]);
+            }
+        }
+        hash = hash_bytes(hash, state, sizeof(state));
+        hash = hash_bytes(hash, reward, sizeof(reward));
+        hash = hash_bytes(hash, alive, sizeof(alive));
+        hash = hash_bytes(hash, success, sizeof(success));
+        for (int i = 0; i < NUM_ENVS; i++) {
+            if (!alive[i] || success[i]) {
+                sim_env_reset(envs[i], -1, &state[NUM_STATE * i]);
+            }
+        }
+    }
+    return hash;
+}
+
+int main(void) {
+    int track_id = sim_register_track(TRACK, 22.0f, 19.9f, 0.0f);
+    if (track_id < 0) {
+        printf("FAIL: could not load %s\n", TRACK);
+        return 1;
+    }
+    SimEnv* envs[NUM_ENVS];
+    for (int i = 0; i < NUM_ENVS; i++) {
+        envs[i] = sim_env_create(track_id);
+    }
+
+    int failures = 0;
+    printf("=== scalar ===\n");
+    double start = now_seconds();
+    uint64_t expected = run(envs, NULL);
+    printf("  hash %016llx  (%.0f steps/s)\n", (unsigned long long)expected, NUM_ENVS * NUM_TEST_STEPS / (now_seconds() - start));
+
+#ifdef SIM_DETERMINISTIC
+    if (expected == GOLDEN_HASH) {
+        printf("PASS: matches golden hash\n");
+    } else {
+        printf("FAIL: golden hash is %016llx\n", GOLDEN_HASH);
+        failures++;
+    }
+#else
+    printf("(not a DETERMINISTIC=1 build, golden hash not checked)\n");
+#endif
+
+    const int thread_counts[] = {1, 2, 3, 8};
+    for (int t = 0; t < 4; t++) {
+        printf("\n=== batch, %d threads ===\n", thread_counts[t]);
+        SimBatch* batch = sim_batch_create(thread_counts[t]);
+        start = now_seconds();
+        uint64_t hash = run(envs, batch);
+        printf("  hash %016llx  (%.0f steps/s)\n", (unsigned long long)hash, NUM_ENVS * NUM_TEST_STEPS / (now_seconds() - start));
+        sim_batch_destroy(batch);
+        if (hash == expected) {
+            printf("PASS: matches scalar\n");
+        } else {
+            printf("FAIL: differs from scalar\n");
+            failures++;
+        }
+    }
+
+    for (int i = 0; i < NUM_ENVS; i++) {
+        sim_env_destroy(envs[i]);
+    }
+    sim_unregister_track(track_id);
+    return failures != 0;
+}
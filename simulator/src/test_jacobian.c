@@ -0,0 +1,137 @@
+#include <math.h>
+#include <stdio.h>
+#include "sim_lib.h"
+
+// Checks sim_env_step_with_jacobian against central finite differences of sim_env_step from a
+// spread of poses on the start straight: every car state and state_out derivative with respect
+// to the pre-step car state and the actions. The reward is piecewise constant, so its derivative
+// is not checked here.
+//   make test_jacobian && ./test_jacobian
+
+#define NUM_STATE 12
+#define TRACK "tracks/test.txt"
+#define NUM_POSES 32
+#define EPSILON 1e-2f
+#define TOLERANCE 2e-2f
+#define KINK_TOLERANCE 0.25f // One-sided differences this far apart: a kink, not curvature
+
+typedef struct {
+    float car_state[SIM_CAR_STATE];
+    float state[NUM_STATE];
+} Outputs;
+
+static void pose_at(int pose, float* car_state, float* delta_accel, float* delta_steering) {
+    // Inside the start straight, away from the clamps, with the side rays hitting the walls
+    float phase = pose * 0.7f;
+    float heading = 0.15f * sinf(phase);
+    float speed = 0.5f + 0.03f * pose;
+    car_state[0] = 23.0f + 0.3f * pose;
+    car_state[1] = 19.9f + 0.6f * cosf(phase * 1.3f);
+    car_state[2] = speed * cosf(heading) - 0.05f * sinf(heading);
+    car_state[3] = speed * sinf(heading) + 0.05f * cosf(heading);
+    car_state[4] = 0.4f * cosf(phase);
+    car_state[5] = 0.2f * sinf(phase * 0.9f);
+    car_state[6] = heading < 0.0f ? heading + 6.2831853f : heading;
+    *delta_accel = 0.05f * cosf(phase * 1.7f);
+    *delta_steering = 0.05f * sinf(phase * 2.3f);
+}
+
+static Outputs perturbed_step(SimEnv* env, const unsigned char* snapshot, int input, float offset, float delta_accel, float delta_steering) {
+    float car_state[SIM_CAR_STATE];
+    sim_env_restore(env, snapshot);
+    sim_env_get_car_state(env, car_state);
+    if (input < SIM_CAR_STATE) {
+        car_state[input] += offset;
+    } else if (input == SIM_CAR_STATE) {
+        delta_accel += offset;
+    } else {
+        delta_steering += offset;
+    }
+    sim_env_set_car_state(env, car_state);
+
+    Outputs out;
+    float reward;
+    int alive, success;
+    sim_env_step(env, delta_accel, delta_steering, out.state, &reward, &alive, &success);
+    sim_env_get_car_state(env, out.car_state);
+    return out;
+}
+
+static float compare(const char* name, int row, int input, float analytic, float numeric, int* failures) {
+    float error = fabsf(analytic - numeric);
+    if (error > TOLERANCE * fmaxf(1.0f, fabsf(numeric))) {
+        if (*failures < 10) {
+            printf("FAIL: d %s[%d] / d input %d: jacobian %g, finite difference %g\n", name, row, input, analytic, numeric);
+        }
+        (*failures)++;
+    }
+    return error;
+}
+
+int main(void) {
+    int track_id = sim_register_track(TRACK, 22.0f, 19.9f, 0.0f);
+    if (track_id < 0) {
+        printf("FAIL: could not load %s\n", TRACK);
+        return 1;
+    }
+    SimEnv* env = sim_env_create(track_id);
+    unsigned char snapshot[SIM_SNAPSHOT_SIZE];
+    int failures = 0;
+    int checked = 0;
+    int kinks = 0;
+    float max_error = 0.0f;
+
+    printf("=== jacobian vs. finite differences (%d poses) ===\n", NUM_POSES);
+    for (int pose = 0; pose < NUM_POSES; pose++) {
+        float car_state[SIM_CAR_STATE];
+        float delta_accel, delta_steering;
+        pose_at(pose, car_state, &delta_accel, &delta_steering);
+        sim_env_reset(env, -1, NULL);
+        sim_env_set_car_state(env, car_state);
+        sim_env_snapshot(env, snapshot);
+
+        SimJacobian jac;
+        float state[NUM_STATE];
+        float reward;
+        int alive, success;
+        sim_env_step_with_jacobian(env, delta_accel, delta_steering, state, &reward, &alive, &success, &jac);
+        if (!alive) {
+            printf("FAIL: pose %d crashed\n", pose);
+            failures++;
+            continue;
+        }
+
+        for (int k = 0; k < SIM_JAC_INPUTS; k++) {
+            Outputs plus = perturbed_step(env, snapshot, k, EPSILON, delta_accel, delta_steering);
+            Outputs minus = perturbed_step(env, snapshot, k, -EPSILON, delta_accel, delta_steering);
+            for (int i = 0; i < SIM_CAR_STATE; i++) {
+                float difference = plus.car_state[i] - minus.car_state[i];
+                if (i == SIM_CAR_STATE - 1) {
+                    difference = remainderf(difference, 6.2831853f); // Heading wraps at 2pi
+                }
+                max_error = fmaxf(max_error, compare("car_state", i, k, jac.car_state[i][k], difference / (2 * EPSILON), &failures));
+            }
+            for (int i = 0; i < NUM_STATE; i++) {
+                // A ray that starts or stops hitting, or moves onto the next segment, within the
+                // perturbation has a kink there; its one-sided differences disagree, so skip it
+                float forward = (plus.state[i] - state[i]) / EPSILON;
+                float backward = (state[i] - minus.state[i]) / EPSILON;
+                if (fabsf(forward - backward) > KINK_TOLERANCE * fmaxf(1.0f, fmaxf(fabsf(forward), fabsf(backward)))) {
+                    kinks++;
+                    continue;
+                }
+                float numeric = (plus.state[i] - minus.state[i]) / (2 * EPSILON);
+                max_error = fmaxf(max_error, compare("state", i, k, jac.state[i][k], numeric, &failures));
+                checked++;
+            }
+            checked += SIM_CAR_STATE;
+        }
+    }
+
+    printf("%s: %d of %d derivatives outside tolerance (max abs error %g), %d skipped at kinks\n",
+           failures ? "FAIL" : "PASS", failures, checked, max_error, kinks);
+
+    sim_env_destroy(env);
+    sim_unregister_track(track_id);
+    return failures ? 1 : 0;
+}
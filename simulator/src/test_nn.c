@@ -0,0 +1,108 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "nn.h"
+#include "philox.h"
+
+// Checks the batched REINFORCE gradient (nn_policy_output_grad + nn_backward_batch) against
+// the per-step loop it replaces (one row at a time, summed) and against central differences
+// of the loss sum_t G_t * |a_t - mu_t|^2 / (2 sigma^2).
+//   make test_nn && ./test_nn
+
+#define NUM_PARAMS ((int)(sizeof(Network) / sizeof(float)))
+#define STEPS 16
+#define SIGMA 0.5f
+#define EPSILON 1e-3f
+#define LOOP_TOLERANCE 1e-5f // Same sums in a different order
+#define FD_TOLERANCE 2e-2f   // Relative, for float central differences
+
+typedef struct {
+    float inputs[STEPS][NN_INPUT];
+    float actions[STEPS][NN_OUTPUT];
+    float returns[STEPS];
+} Episode;
+
+static void make_episode(Network* nn, Episode* ep) {
+    // Random weights and inputs at the scale of the real ones; actions around the outputs
+    float* params = (float*)nn;
+    philox_normals(3, 0, 0, 0, params, NUM_PARAMS);
+    for (int k = 0; k < NUM_PARAMS; k++) params[k] *= 0.3f;
+    for (int t = 0; t < STEPS; t++) {
+        float noise[NN_OUTPUT], output[NN_OUTPUT];
+        philox_normals(3, 1, (uint32_t)t, 0, ep->inputs[t], NN_INPUT);
+        philox_normals(3, 2, (uint32_t)t, 0, noise, NN_OUTPUT);
+        philox_normals(3, 3, (uint32_t)t, 0, &ep->returns[t], 1);
+        nn_forward(nn, ep->inputs[t], output);
+        for (int i = 0; i < NN_OUTPUT; i++) ep->actions[t][i] = output[i] + SIGMA * noise[i];
+    }
+}
+
+static void batch_gradient(Network* nn, const Episode* ep, int first, int count, Network* grads) {
+    NNBatchCache cache;
+    float dL_da3[STEPS * NN_OUTPUT];
+    nn_batch_cache_init(&cache, count);
+    for (int t = 0; t < count; t++) {
+        nn_forward_cached(nn, (float*)ep->inputs[first + t], &cache, t, NULL);
+    }
+    nn_policy_output_grad(&cache, &ep->actions[first][0], &ep->returns[first], SIGMA, dL_da3);
+    nn_backward_batch(nn, &cache, dL_da3, grads);
+    nn_batch_cache_free(&cache);
+}
+
+static double loss(Network* nn, const Episode* ep) {
+    double total = 0.0;
+    for (int t = 0; t < STEPS; t++) {
+        float mu[NN_OUTPUT];
+        nn_forward(nn, (float*)ep->inputs[t], mu);
+        for (int i = 0; i < NN_OUTPUT; i++) {
+            double d = ep->actions[t][i] - mu[i];
+            total += ep->returns[t] * d * d / (2.0 * SIGMA * SIGMA);
+        }
+    }
+    return total;
+}
+
+int main(void) {
+    static Network nn, batched, looped, row;
+    static Episode ep;
+    make_episode(&nn, &ep);
+    batch_gradient(&nn, &ep, 0, STEPS, &batched);
+
+    float* b = (float*)&batched;
+    float* l = (float*)&looped;
+    float* r = (float*)&row;
+    memset(&looped, 0, sizeof(looped));
+    for (int t = 0; t < STEPS; t++) {
+        batch_gradient(&nn, &ep, t, 1, &row);
+        for (int k = 0; k < NUM_PARAMS; k++) l[k] += r[k];
+    }
+    float loop_error = 0.0f;
+    for (int k = 0; k < NUM_PARAMS; k++) loop_error = fmaxf(loop_error, fabsf(b[k] - l[k]));
+    int loop_ok = loop_error <= LOOP_TOLERANCE;
+    printf("%s: batched vs. per-step loop, max abs error %g over %d parameters\n", loop_ok ? "PASS" : "FAIL", loop_error, NUM_PARAMS);
+
+    float* params = (float*)&nn;
+    int fd_failures = 0;
+    float fd_error = 0.0f;
+    for (int k = 0; k < NUM_PARAMS; k++) {
+        float saved = params[k];
+        params[k] = saved + EPSILON;
+        double plus = loss(&nn, &ep);
+        params[k] = saved - EPSILON;
+        double minus = loss(&nn, &ep);
+        params[k] = saved;
+        float numeric = (float)((plus - minus) / (2.0 * EPSILON));
+        float error = fabsf(numeric - b[k]) / fmaxf(1.0f, fabsf(numeric));
+        fd_error = fmaxf(fd_error, error);
+        if (error > FD_TOLERANCE) {
+            if (fd_failures < 10) printf("FAIL: parameter %d: batched %g, finite difference %g\n", k, b[k], numeric);
+            fd_failures++;
+        }
+    }
+    printf("%s: batched vs. central differences, %d of %d outside tolerance (max relative error %g)\n",
+           fd_failures ? "FAIL" : "PASS", fd_failures, NUM_PARAMS, fd_error);
+
+    int ok = loop_ok && fd_failures == 0;
+    printf("%s\n", ok ? "ALL PASSED" : "SOME FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,91 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "optim.h"
+
+// Checks each fused optim_step against a reference written as separate passes over the buffer
+// (scale, clip, decay, moments, step), over several steps with clipping and weight decay on.
+//   make test_optim && ./test_optim
+
+#define N 1000
+#define STEPS 20
+#define TOLERANCE 1e-6f
+
+static void reference_step(const OptimConfig* c, int step, float* params, const float* grads, float grad_scale, float* m, float* v) {
+    float g[N];
+    for (int k = 0; k < N; k++) g[k] = grads[k] * grad_scale;
+    if (c->clip > 0.0f) {
+        for (int k = 0; k < N; k++) g[k] = fminf(fmaxf(g[k], -c->clip), c->clip);
+    }
+    for (int k = 0; k < N; k++) g[k] += c->weight_decay * params[k];
+
+    if (c->kind == OPTIM_SGD) {
+        for (int k = 0; k < N; k++) m[k] = c->beta1 * m[k] + g[k];
+        for (int k = 0; k < N; k++) params[k] -= c->lr * m[k];
+    } else if (c->kind == OPTIM_RMSPROP) {
+        for (int k = 0; k < N; k++) v[k] = c->beta2 * v[k] + (1.0f - c->beta2) * g[k] * g[k];
+        for (int k = 0; k < N; k++) params[k] -= c->lr * g[k] / (sqrtf(v[k]) + c->epsilon);
+    } else {
+        for (int k = 0; k < N; k++) m[k] = c->beta1 * m[k] + (1.0f - c->beta1) * g[k];
+        for (int k = 0; k < N; k++) v[k] = c->beta2 * v[k] + (1.0f - c->beta2) * g[k] * g[k];
+        float bias1 = 1.0f - powf(c->beta1, (float)step);
+        float bias2 = 1.0f - powf(c->beta2, (float)step);
+        for (int k = 0; k < N; k++) params[k] -= c->lr * (m[k] / bias1) / (sqrtf(v[k] / bias2) + c->epsilon);
+    }
+}
+
+static int check(const char* name, OptimConfig config) {
+    static float params[N], expected[N], grads[N], m[N], v[N];
+    srand(7);
+    for (int k = 0; k < N; k++) params[k] = expected[k] = (float)rand() / RAND_MAX - 0.5f;
+    memset(m, 0, sizeof(m));
+    memset(v, 0, sizeof(v));
+
+    Optimizer* opt = optim_create(&config, N);
+    float max_error = 0.0f;
+    for (int step = 1; step <= STEPS; step++) {
+        for (int k = 0; k < N; k++) grads[k] = 4.0f * ((float)rand() / RAND_MAX - 0.5f);
+        float grad_scale = step % 2 ? 0.5f : -1.5f;
+        optim_step(opt, params, grads, grad_scale);
+        reference_step(&config, step, expected, grads, grad_scale, m, v);
+        for (int k = 0; k < N; k++) max_error = fmaxf(max_error, fabsf(params[k] - expected[k]));
+    }
+    optim_destroy(opt);
+
+    int ok = max_error <= TOLERANCE;
+    printf("%s: %s (max abs error %g over %d steps)\n", ok ? "PASS" : "FAIL", name, max_error, STEPS);
+    return ok;
+}
+
+int main(void) {
+    int ok = 1;
+    OptimConfig config;
+
+    config = optim_default_config(OPTIM_SGD, 0.01f);
+    config.beta1 = 0.0f;
+    config.clip = 1.0f;
+    ok &= check("sgd, clipped", config);
+
+    config = optim_default_config(OPTIM_SGD, 0.01f);
+    config.weight_decay = 0.01f;
+    ok &= check("sgd with momentum, weight decay", config);
+
+    config = optim_default_config(OPTIM_RMSPROP, 1e-3f);
+    config.clip = 0.8f;
+    ok &= check("rmsprop, clipped", config);
+
+    config = optim_default_config(OPTIM_ADAM, 1e-3f);
+    config.clip = 1.0f;
+    config.weight_decay = 0.005f;
+    ok &= check("adam, clipped, weight decay", config);
+
+    config = optim_default_config(7, 1e-3f);
+    if (optim_create(&config, N) != NULL) {
+        printf("FAIL: optim_create accepted an unknown kind\n");
+        ok = 0;
+    }
+
+    printf("%s\n", ok ? "ALL PASSED" : "SOME FAILED");
+    return ok ? 0 : 1;
+}
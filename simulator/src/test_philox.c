@@ -0,0 +1,91 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "philox.h"
+
+// Checks philox4x32 against the Random123 known-answer vectors for Philox4x32-10,
+// philox_normals_batch against the per-car philox_normals (bit for bit, on a car count that is
+// not a multiple of the batch width), and the mean and variance of 8M normals.
+//   make test_philox && ./test_philox
+
+#define MOMENT_CARS   4096
+#define MOMENT_STEPS  512
+#define MOMENT_N      4 // Normals per car per step: 8M in total
+#define MEAN_BOUND    2e-3 // About 5.5 standard errors at 8M draws
+#define VARIANCE_BOUND 3e-3 // About 6 standard errors
+
+typedef struct {
+    const char* name;
+    uint32_t counter[4];
+    uint64_t key; // Random123 key {k0, k1} is k0 | k1 << 32
+    uint32_t expected[4];
+} KnownAnswer;
+
+static const KnownAnswer KNOWN_ANSWERS[] = {
+    {"zero", {0, 0, 0, 0}, 0, {0x6627e8d5u, 0xe169c58du, 0xbc57ac4cu, 0x9b00dbd8u}},
+    {"all ones", {0xffffffffu, 0xffffffffu, 0xffffffffu, 0xffffffffu}, 0xffffffffffffffffull,
+     {0x408f276du, 0x41c83b0eu, 0xa20bc7c6u, 0x6d5451fdu}},
+    {"pi digits", {0x243f6a88u, 0x85a308d3u, 0x13198a2eu, 0x03707344u}, 0x299f31d0a4093822ull,
+     {0xd16cfe09u, 0x94fdccebu, 0x5001e420u, 0x24126ea1u}},
+};
+
+static int check_known_answers(void) {
+    int ok = 1;
+    for (size_t i = 0; i < sizeof(KNOWN_ANSWERS) / sizeof(KNOWN_ANSWERS[0]); i++) {
+        const KnownAnswer* k = &KNOWN_ANSWERS[i];
+        uint32_t out[4];
+        philox4x32(k->counter, k->key, out);
+        int match = memcmp(out, k->expected, sizeof(out)) == 0;
+        printf("%s: known answer, %s\n", match ? "PASS" : "FAIL", k->name);
+        if (!match) {
+            printf("  got %08x %08x %08x %08x\n", out[0], out[1], out[2], out[3]);
+            ok = 0;
+        }
+    }
+    return ok;
+}
+
+static int check_batch(void) {
+    // 13 cars from car 3: one full batch of eight and a partial one; 6 normals: a partial block
+    enum { FIRST_CAR = 3, NUM_CARS = 13, N = 6 };
+    float batch[NUM_CARS * N];
+    int mismatches = 0;
+    for (uint32_t step = 0; step < 50; step++) {
+        philox_normals_batch(16, 7, step, FIRST_CAR, NUM_CARS, N, batch);
+        for (int car = 0; car < NUM_CARS; car++) {
+            float single[N];
+            philox_normals(16, 7, step, FIRST_CAR + car, single, N);
+            if (memcmp(single, &batch[car * N], sizeof(single)) != 0) mismatches++;
+        }
+    }
+    printf("%s: philox_normals_batch matches philox_normals bit for bit (%d of %d cars differ)\n",
+           mismatches ? "FAIL" : "PASS", mismatches, 50 * NUM_CARS);
+    return mismatches == 0;
+}
+
+static int check_moments(void) {
+    static float out[MOMENT_CARS * MOMENT_N];
+    double sum = 0.0, sum_sq = 0.0;
+    long long count = 0;
+    for (uint32_t step = 0; step < MOMENT_STEPS; step++) {
+        philox_normals_batch(1, 0, step, 0, MOMENT_CARS, MOMENT_N, out);
+        for (int i = 0; i < MOMENT_CARS * MOMENT_N; i++) {
+            sum += out[i];
+            sum_sq += (double)out[i] * out[i];
+        }
+        count += MOMENT_CARS * MOMENT_N;
+    }
+    double mean = sum / count;
+    double variance = sum_sq / count - mean * mean;
+    int ok = fabs(mean) < MEAN_BOUND && fabs(variance - 1.0) < VARIANCE_BOUND;
+    printf("%s: %lld normals, mean %.5f, variance %.5f\n", ok ? "PASS" : "FAIL", count, mean, variance);
+    return ok;
+}
+
+int main(void) {
+    int ok = check_known_answers();
+    ok &= check_batch();
+    ok &= check_moments();
+    printf("%s\n", ok ? "ALL PASSED" : "SOME FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,112 @@
+#include <float.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "det_math.h"
+#include "ray_cast.h"
+#include "segment_block.h"
+#include "track_internals.h"
+
+// Checks the SegmentBlock ray kernels (the vector path this build compiled, and the scalar
+// reference) against ray_segment_intersection: hand-picked parallel, grazing and degenerate
+// cases first, then random rays against random blocks. Distances must match exactly.
+//   make test_segment_block && ./test_segment_block
+
+#define NUM_RANDOM_BLOCKS 200000
+
+typedef struct {
+    const char* name;
+    Point origin;
+    float direction;
+    Point start;
+    Point end;
+} EdgeCase;
+
+static const EdgeCase EDGE_CASES[] = {
+    {"perpendicular hit",         {0, 0}, 0.0f,        {5, -1},  {5, 1}},
+    {"parallel, offset",          {0, 0}, 0.0f,        {1, 1},   {4, 1}},
+    {"collinear, ahead",          {0, 0}, 0.0f,        {2, 0},   {6, 0}},
+    {"nearly parallel",           {0, 0}, 0.0f,        {1, 0.5f}, {9, 0.5000001f}},
+    {"grazing the start point",   {0, 0}, 0.0f,        {5, 0},   {5, 3}},
+    {"grazing the end point",     {0, 0}, 0.0f,        {5, -3},  {5, 0}},
+    {"through a shared vertex a", {0, 0}, 0.7853982f,  {3, 1},   {2, 2}},
+    {"through a shared vertex b", {0, 0}, 0.7853982f,  {2, 2},   {1, 3}},
+    {"just past the end",         {0, 0}, 0.0f,        {5, -3},  {5, -0.000001f}},
+    {"origin on the segment",     {5, 0}, 0.0f,        {5, -1},  {5, 1}},
+    {"segment behind the ray",    {0, 0}, 0.0f,        {-5, -1}, {-5, 1}},
+    {"zero-length segment",       {0, 0}, 0.0f,        {5, 0},   {5, 0}},
+    {"reversed winding",          {0, 0}, 1.3089969f,  {3, 9},   {-1, 6}},
+    {"steep ray, far hit",        {0, 0}, -1.5707963f, {-50, -900}, {50, -900}},
+};
+
+static float uniform(uint32_t* state) {
+    *state = *state * 1664525u + 1013904223u;
+    return (*state >> 8) * (1.0f / 16777216.0f);
+}
+
+static float scalar_nearest(Point origin, float direction, struct BoundarySegment* segments, int count) {
+    float nearest = FLT_MAX;
+    for (int i = 0; i < count; i++) {
+        RayHit hit = ray_segment_intersection(origin, direction, &segments[i]);
+        if (hit.hit && hit.distance < nearest) nearest = hit.distance;
+    }
+    return nearest;
+}
+
+static int check(const char* name, Point origin, float direction, struct BoundarySegment* segments, int count, int verbose) {
+    int block_count;
+    SegmentBlock* blocks = segment_blocks_build(segments, count, &block_count);
+    float dx = sim_cosf(direction);
+    float dy = sim_sinf(direction);
+    float expected = scalar_nearest(origin, direction, segments, count);
+    float vector = segment_blocks_nearest(blocks, block_count, origin, dx, dy, FLT_MAX);
+    float scalar = segment_blocks_nearest_scalar(blocks, block_count, origin, dx, dy, FLT_MAX);
+    free(blocks);
+
+    int ok = vector == expected && scalar == expected;
+    if (!ok || verbose) {
+        printf("%s: %-26s expected %g, vector %g, scalar %g\n", ok ? "PASS" : "FAIL", name, expected, vector, scalar);
+    }
+    return ok;
+}
+
+int main(void) {
+    int failures = 0;
+
+    printf("=== edge cases ===\n");
+    for (size_t i = 0; i < sizeof(EDGE_CASES) / sizeof(EDGE_CASES[0]); i++) {
+        const EdgeCase* c = &EDGE_CASES[i];
+        struct BoundarySegment segment = {.start = c->start, .end = c->end};
+        failures += !check(c->name, c->origin, c->direction, &segment, 1, 1);
+    }
+
+    printf("\n=== %d random blocks ===\n", NUM_RANDOM_BLOCKS);
+    // Segments from short to long around the origin, some snapped to the ray's axis so exact
+    // zeros and endpoint hits come up; blocks of 1 to 8 segments exercise the padding lanes
+    uint32_t state = 2024u;
+    int random_failures = 0;
+    for (int b = 0; b < NUM_RANDOM_BLOCKS; b++) {
+        struct BoundarySegment segments[SEGMENT_BLOCK_SIZE];
+        int count = 1 + (int)(uniform(&state) * SEGMENT_BLOCK_SIZE);
+        for (int i = 0; i < count; i++) {
+            float scale = uniform(&state) < 0.5f ? 2.0f : 20.0f;
+            segments[i].start.x = (uniform(&state) - 0.5f) * scale;
+            segments[i].start.y = (uniform(&state) - 0.5f) * scale;
+            segments[i].end.x = (uniform(&state) - 0.5f) * scale;
+            segments[i].end.y = (uniform(&state) - 0.5f) * scale;
+            if (uniform(&state) < 0.1f) segments[i].start.y = 0.0f;
+            if (uniform(&state) < 0.1f) segments[i].end = segments[i].start;
+        }
+        Point origin = {(uniform(&state) - 0.5f) * 2.0f, 0.0f};
+        float direction = uniform(&state) < 0.2f ? 0.0f : (uniform(&state) - 0.5f) * 6.2831853f;
+
+        if (!check("random block", origin, direction, segments, count, 0)) {
+            if (++random_failures >= 10) break;
+        }
+    }
+    printf("%s: %d mismatches\n", random_failures ? "FAIL" : "PASS", random_failures);
+    failures += random_failures;
+
+    printf("\n%s\n", failures ? "FAILED" : "ALL PASSED");
+    return failures ? 1 : 0;
+}
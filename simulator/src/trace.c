@@ -0,0 +1,298 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "trace.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "util.h"
+
+#define RING_EVENTS    16384 // Per thread; events beyond a full ring are dropped and counted
+#define FLUSH_INTERVAL 20    // ms between drains of the rings by the writer thread
+#define INTERN_BUCKETS 256
+
+typedef struct {
+    const char* name;
+    uint64_t start; // ns, CLOCK_MONOTONIC
+    uint64_t duration;
+} TraceEvent;
+
+// Single producer (its thread) / single consumer (the writer) ring
+typedef struct TraceRing {
+    TraceEvent events[RING_EVENTS];
+    _Atomic uint64_t head; // Next slot the producer writes
+    _Atomic uint64_t tail; // Next slot the writer reads
+    _Atomic uint64_t dropped;
+    _Atomic int in_use;    // Cleared when the owning thread exits, so a new thread can take it
+    int tid;
+    char thread_name[32];
+    int name_written;      // thread_name metadata event emitted in the current trace
+    struct TraceRing* next;
+} TraceRing;
+
+static atomic_int enabled;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER; // Guards everything below
+static TraceRing* rings;     // Every ring ever created; never freed, producers may still hold one
+static int next_tid = 1;
+static FILE* file;
+static int first_event;
+static uint64_t origin;      // Timestamps in the file are relative to trace_start
+static pthread_t writer;
+static int stop_writer;
+static pthread_cond_t writer_wake = PTHREAD_COND_INITIALIZER;
+
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t ring_key;
+static _Thread_local TraceRing* thread_ring;
+
+// Interned names have their own lock, which the writer never takes: trace_intern runs on
+// every Python span and must not wait for the writer's file I/O
+typedef struct InternedName {
+    struct InternedName* next;
+    char name[];
+} InternedName;
+static pthread_mutex_t intern_lock = PTHREAD_MUTEX_INITIALIZER;
+static InternedName* interned[INTERN_BUCKETS];
+
+static void* writer_main(void* arg);
+static void drain_rings(void);
+static TraceRing* acquire_ring(void);
+static void release_ring(void* ring);
+static void make_key(void);
+static uint64_t now_ns(void);
+
+int trace_start(const char* path) {
+    if (trace_enabled()) {
+        trace_stop();
+    }
+    FILE* out = fopen(path, "w");
+    if (out == NULL) {
+        fprintf(stderr, "Failed to open trace file: %s\n", path);
+        return 1;
+    }
+
+    pthread_mutex_lock(&lock);
+    file = out;
+    fputs("{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n", file);
+    first_event = 1;
+    origin = now_ns();
+    // Discard anything left in the rings from an earlier trace
+    for (TraceRing* ring = rings; ring; ring = ring->next) {
+        atomic_store(&ring->tail, atomic_load(&ring->head));
+        atomic_store(&ring->dropped, 0);
+        ring->name_written = 0;
+    }
+    stop_writer = 0;
+    pthread_mutex_unlock(&lock);
+
+    if (pthread_create(&writer, NULL, writer_main, NULL) != 0) {
+        pthread_mutex_lock(&lock);
+        fclose(file);
+        file = NULL;
+        pthread_mutex_unlock(&lock);
+        return 1;
+    }
+    atomic_store(&enabled, 1);
+    return 0;
+}
+
+int trace_stop(void) {
+    if (!trace_enabled()) {
+        return 0;
+    }
+    atomic_store(&enabled, 0);
+
+    pthread_mutex_lock(&lock);
+    stop_writer = 1;
+    pthread_cond_signal(&writer_wake);
+    pthread_mutex_unlock(&lock);
+    pthread_join(writer, NULL);
+
+    // Events still being recorded by other threads after this point are dropped with the ring
+    pthread_mutex_lock(&lock);
+    drain_rings();
+    uint64_t dropped = 0;
+    for (TraceRing* ring = rings; ring; ring = ring->next) {
+        dropped += atomic_load(&ring->dropped);
+    }
+    fputs("\n]}\n", file);
+    int result = ferror(file) ? 1 : 0;
+    if (fclose(file) != 0) result = 1;
+    file = NULL;
+    pthread_mutex_unlock(&lock);
+
+    if (dropped > 0) {
+        fprintf(stderr, "Trace dropped %llu events (ring full)\n", (unsigned long long)dropped);
+    }
+    return result;
+}
+
+int trace_enabled(void) {
+    return atomic_load_explicit(&enabled, memory_order_relaxed);
+}
+
+uint64_t trace_begin(void) {
+    if (!atomic_load_explicit(&enabled, memory_order_relaxed)) {
+        return 0;
+    }
+    return now_ns();
+}
+
+void trace_end(const char* name, uint64_t start) {
+    if (start == 0) {
+        return; // Tracing was off at trace_begin
+    }
+    uint64_t end = now_ns();
+    TraceRing* ring = thread_ring ? thread_ring : acquire_ring();
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&ring->tail, memory_order_acquire) >= RING_EVENTS) {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return;
+    }
+    TraceEvent* event = &ring->events[head % RING_EVENTS];
+    event->name = name;
+    event->start = start;
+    event->duration = end - start;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+void trace_lap(const char* name, uint64_t* start) {
+    if (*start == 0) {
+        return;
+    }
+    trace_end(name, *start);
+    *start = now_ns();
+}
+
+void trace_set_thread_name(const char* name) {
+    TraceRing* ring = thread_ring ? thread_ring : acquire_ring();
+    pthread_mutex_lock(&lock);
+    snprintf(ring->thread_name, sizeof(ring->thread_name), "%s", name);
+    ring->name_written = 0;
+    pthread_mutex_unlock(&lock);
+}
+
+const char* trace_intern(const char* name) {
+    uint32_t hash = 2166136261u; // FNV-1a
+    for (const char* c = name; *c; c++) hash = (hash ^ (unsigned char)*c) * 16777619u;
+    InternedName** bucket = &interned[hash % INTERN_BUCKETS];
+
+    pthread_mutex_lock(&intern_lock);
+    for (InternedName* n = *bucket; n; n = n->next) {
+        if (strcmp(n->name, name) == 0) {
+            pthread_mutex_unlock(&intern_lock);
+            return n->name;
+        }
+    }
+    size_t length = strlen(name);
+    InternedName* n = xalloc(1, sizeof(InternedName) + length + 1);
+    memcpy(n->name, name, length + 1);
+    n->next = *bucket;
+    *bucket = n;
+    pthread_mutex_unlock(&intern_lock);
+    return n->name;
+}
+
+static void* writer_main(void* arg) {
+    (void)arg;
+    pthread_mutex_lock(&lock);
+    while (!stop_writer) {
+        struct timespec wake;
+        clock_gettime(CLOCK_REALTIME, &wake);
+        wake.tv_nsec += FLUSH_INTERVAL * 1000000L;
+        if (wake.tv_nsec >= 1000000000L) {
+            wake.tv_sec++;
+            wake.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&writer_wake, &lock, &wake);
+        drain_rings();
+    }
+    pthread_mutex_unlock(&lock);
+    return NULL;
+}
+
+static void write_json_string(const char* text) {
+    // Names come from callers (e.g. Python), so quotes, backslashes and control characters are escaped
+    fputc('"', file);
+    for (const unsigned char* c = (const unsigned char*)text; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            fputc('\\', file);
+            fputc(*c, file);
+        } else if (*c < 0x20) {
+            fprintf(file, "\\u%04x", *c);
+        } else {
+            fputc(*c, file);
+        }
+    }
+    fputc('"', file);
+}
+
+static void drain_rings(void) {
+    // Called with lock held
+    for (TraceRing* ring = rings; ring; ring = ring->next) {
+        if (!ring->name_written && ring->thread_name[0] != '\0') {
+            fprintf(file, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": ",
+                    first_event ? "" : ",\n", ring->tid);
+            write_json_string(ring->thread_name);
+            fputs("}}", file);
+            first_event = 0;
+            ring->name_written = 1;
+        }
+
+        uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        for (; tail < head; tail++) {
+            const TraceEvent* event = &ring->events[tail % RING_EVENTS];
+            if (event->start < origin) continue; // Recorded before this trace started
+            fprintf(file, "%s{\"name\": ", first_event ? "" : ",\n");
+            write_json_string(event->name);
+            fprintf(file, ", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}",
+                    ring->tid, (event->start - origin) / 1e3, event->duration / 1e3);
+            first_event = 0;
+        }
+        atomic_store_explicit(&ring->tail, tail, memory_order_release);
+    }
+}
+
+static TraceRing* acquire_ring(void) {
+    // First event of this thread: reuse the ring of an exited thread or make a new one
+    pthread_once(&key_once, make_key);
+    pthread_mutex_lock(&lock);
+    TraceRing* ring = NULL;
+    for (TraceRing* r = rings; r; r = r->next) {
+        if (!atomic_load(&r->in_use) && atomic_load(&r->head) == atomic_load(&r->tail)) {
+            ring = r;
+            break;
+        }
+    }
+    if (ring == NULL) {
+        ring = xalloc(1, sizeof(TraceRing));
+        ring->next = rings;
+        rings = ring;
+    }
+    ring->tid = next_tid++;
+    ring->thread_name[0] = '\0';
+    ring->name_written = 0;
+    atomic_store(&ring->in_use, 1);
+    pthread_mutex_unlock(&lock);
+
+    thread_ring = ring;
+    pthread_setspecific(ring_key, ring);
+    return ring;
+}
+
+static void release_ring(void* ring) {
+    atomic_store(&((TraceRing*)ring)->in_use, 0);
+}
+
+static void make_key(void) {
+    pthread_key_create(&ring_key, release_ring);
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
@@ -0,0 +1,158 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "track_bezier.h"
+#include "track_internals.h"
+#include "util.h"
+
+#define TESSELLATION_MAX_DEPTH 16
+
+typedef struct {
+    float t;
+    Point center;
+    Vector2d tangent; // Unit length
+    Point left;
+    Point right;
+} BezierSample;
+
+typedef struct {
+    Point *points;
+    int count;
+    int capacity;
+} PointList;
+
+static BezierSample sample_at(const BezierSegment *segment, float t, float half_width);
+static void subdivide(const BezierSegment *segment, float half_width, const TessellationParams *params,
+                      const BezierSample *s0, const BezierSample *s1, int depth, PointList *left, PointList *right);
+static int needs_split(const BezierSample *s0, const BezierSample *sm, const BezierSample *s1, const TessellationParams *params);
+static void push_point(PointList *list, Point p);
+
+void tessellation_default_params(TessellationParams *params) {
+    params->tolerance = 0.01f;
+    params->max_angle = 0.0523599f; // 3 degrees in radians
+    params->max_length = 2.0f;
+}
+
+void bezier_evaluate(const BezierSegment *segment, float t, Point *point, Vector2d *tangent) {
+    // Bernstein form of the cubic and its derivative
+    const Point *p = segment->p;
+    float u = 1.0f - t;
+
+    if (point) {
+        float b0 = u * u * u, b1 = 3.0f * u * u * t, b2 = 3.0f * u * t * t, b3 = t * t * t;
+        point->x = b0 * p[0].x + b1 * p[1].x + b2 * p[2].x + b3 * p[3].x;
+        point->y = b0 * p[0].y + b1 * p[1].y + b2 * p[2].y + b3 * p[3].y;
+    }
+
+    if (tangent) {
+        float d0 = 3.0f * u * u, d1 = 6.0f * u * t, d2 = 3.0f * t * t;
+        tangent->x = d0 * (p[1].x - p[0].x) + d1 * (p[2].x - p[1].x) + d2 * (p[3].x - p[2].x);
+        tangent->y = d0 * (p[1].y - p[0].y) + d1 * (p[2].y - p[1].y) + d2 * (p[3].y - p[2].y);
+    }
+}
+
+void tessellate_boundaries(const BezierSegment *segments, int count, float width, const TessellationParams *params,
+                           Boundary *left, Boundary *right) {
+    // Offsets the centerline by width / 2 on each side, the same construction as track_drawer/boundary.py,
+    // but splits each curve recursively until every boundary chord is within tolerance of the curve.
+    // Consecutive segments share their joining point, so it is only emitted once.
+    float half_width = width * 0.5f;
+    PointList left_list = {0}, right_list = {0};
+
+    for (int i = 0; i < count; i++) {
+        BezierSample s0 = sample_at(&segments[i], 0.0f, half_width);
+        BezierSample s1 = sample_at(&segments[i], 1.0f, half_width);
+
+        if (i == 0) {
+            push_point(&left_list, s0.left);
+            push_point(&right_list, s0.right);
+        }
+        subdivide(&segments[i], half_width, params, &s0, &s1, 0, &left_list, &right_list);
+    }
+
+    left->count = left_list.count;
+    left->points = left_list.points;
+    right->count = right_list.count;
+    right->points = right_list.points;
+}
+
+static BezierSample sample_at(const BezierSegment *segment, float t, float half_width) {
+    BezierSample s;
+    s.t = t;
+    bezier_evaluate(segment, t, &s.center, &s.tangent);
+
+    float len = sqrtf(s.tangent.x * s.tangent.x + s.tangent.y * s.tangent.y);
+    if (len < 1e-6f) {
+        // Control point on top of an endpoint: take the direction from a nearby point on the curve
+        float h = t < 0.5f ? 1e-3f : -1e-3f;
+        Point near;
+        bezier_evaluate(segment, t + h, &near, NULL);
+        s.tangent.x = (near.x - s.center.x) * (h > 0 ? 1.0f : -1.0f);
+        s.tangent.y = (near.y - s.center.y) * (h > 0 ? 1.0f : -1.0f);
+        len = sqrtf(s.tangent.x * s.tangent.x + s.tangent.y * s.tangent.y);
+    }
+
+    if (len > 0.0f) {
+        s.tangent.x /= len;
+        s.tangent.y /= len;
+    }
+
+    // Left normal of the direction of travel
+    s.left.x = s.center.x - s.tangent.y * half_width;
+    s.left.y = s.center.y + s.tangent.x * half_width;
+    s.right.x = s.center.x + s.tangent.y * half_width;
+    s.right.y = s.center.y - s.tangent.x * half_width;
+    return s;
+}
+
+static void subdivide(const BezierSegment *segment, float half_width, const TessellationParams *params,
+                      const BezierSample *s0, const BezierSample *s1, int depth, PointList *left, PointList *right) {
+    BezierSample sm = sample_at(segment, 0.5f * (s0->t + s1->t), half_width);
+
+    if (depth < TESSELLATION_MAX_DEPTH && needs_split(s0, &sm, s1, params)) {
+        subdivide(segment, half_width, params, s0, &sm, depth + 1, left, right);
+        subdivide(segment, half_width, params, &sm, s1, depth + 1, left, right);
+        return;
+    }
+
+    push_point(left, s1->left);
+    push_point(right, s1->right);
+}
+
+static int needs_split(const BezierSample *s0, const BezierSample *sm, const BezierSample *s1, const TessellationParams *params) {
+    // Centerline chord too long
+    float cx = s1->center.x - s0->center.x;
+    float cy = s1->center.y - s0->center.y;
+    if (cx * cx + cy * cy > params->max_length * params->max_length) return 1;
+
+    // Heading turns too much on either half (checking both halves catches S-bends)
+    float cos_max = cosf(params->max_angle);
+    if (s0->tangent.x * sm->tangent.x + s0->tangent.y * sm->tangent.y < cos_max) return 1;
+    if (sm->tangent.x * s1->tangent.x + sm->tangent.y * s1->tangent.y < cos_max) return 1;
+
+    // Offset curves bulge away from their chords
+    float tol_sq = params->tolerance * params->tolerance;
+    float lx = sm->left.x - 0.5f * (s0->left.x + s1->left.x);
+    float ly = sm->left.y - 0.5f * (s0->left.y + s1->left.y);
+    if (lx * lx + ly * ly > tol_sq) return 1;
+    float rx = sm->right.x - 0.5f * (s0->right.x + s1->right.x);
+    float ry = sm->right.y - 0.5f * (s0->right.y + s1->right.y);
+    if (rx * rx + ry * ry > tol_sq) return 1;
+
+    return 0;
+}
+
+static void push_point(PointList *list, Point p) {
+    if (list->count == list->capacity) {
+        int capacity = list->capacity ? list->capacity * 2 : 64;
+        Point *grown = xalloc(capacity, sizeof(Point));
+        if (list->count > 0) {
+            memcpy(grown, list->points, sizeof(Point) * list->count);
+        }
+        free(list->points);
+        list->points = grown;
+        list->capacity = capacity;
+    }
+    list->points[list->count++] = p;
+}
@@ -0,0 +1,310 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "track_binary.h"
+#include "track_internals.h"
+#include "quad_tree.h"
+#include "util.h"
+
+#define TRACK_BINARY_MAX_DEPTH 64 // Far beyond any tuned quad tree; bounds rebuild_node's recursion
+
+static int count_nodes(const QuadTreeNode *node, int *segment_total);
+static int flatten_node(const QuadTreeNode *node, TrackBinaryNode *nodes, int *node_index,
+                        struct BoundarySegment *pool, int *pool_index);
+static QuadTreeNode *rebuild_node(const TrackBinaryNode *nodes, int index, const struct BoundarySegment *pool);
+static int validate_header(const TrackBinaryHeader *header, size_t file_size);
+static int validate_subtree(const TrackBinaryNode *nodes, int node_count, int index, int depth, int max_depth, int *next);
+static uint64_t align_offset(uint64_t offset);
+static int section_fits(uint64_t offset, uint64_t count, uint64_t size, uint64_t file_size);
+
+int track_is_binary(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return 0;
+    }
+
+    uint32_t magic = 0;
+    size_t read = fread(&magic, sizeof(magic), 1, file);
+    fclose(file);
+
+    return read == 1 && magic == TRACK_BINARY_MAGIC;
+}
+
+int save_track_binary(const Track *track, const QuadTreeNode *tree, const QuadTreeParams *params, const char *path) {
+    // Layout: header, then each array at an 8-byte aligned offset so the loader can use it in place
+    int leaf_segment_count = 0;
+    int node_count = count_nodes(tree, &leaf_segment_count);
+
+    TrackBinaryHeader header = {0};
+    header.magic = TRACK_BINARY_MAGIC;
+    header.version = TRACK_BINARY_VERSION;
+    header.segment_size = sizeof(struct BoundarySegment);
+    header.node_size = sizeof(TrackBinaryNode);
+    header.width = track->width;
+    header.total_length = track->total_length;
+    header.left_count = track->left_boundary.count;
+    header.right_count = track->right_boundary.count;
+    header.node_count = node_count;
+    header.leaf_segment_count = leaf_segment_count;
+
+    // Recorded so a tuned track keeps its parameters (params NULL: the defaults)
+    QuadTreeParams defaults;
+    if (params == NULL) {
+        quadtree_default_params(&defaults);
+        params = &defaults;
+    }
+    header.quadtree_max_depth = params->max_depth;
+    header.quadtree_max_segments_per_node = params->max_segments_per_node;
+
+    int left_segs = track->left_boundary.count - 1;
+    int right_segs = track->right_boundary.count - 1;
+
+    uint64_t offset = align_offset(sizeof(TrackBinaryHeader));
+    header.left_points_offset = offset;
+    offset = align_offset(offset + sizeof(Point) * (uint64_t)header.left_count);
+    header.right_points_offset = offset;
+    offset = align_offset(offset + sizeof(Point) * (uint64_t)header.right_count);
+    header.left_segments_offset = offset;
+    offset = align_offset(offset + sizeof(struct BoundarySegment) * (uint64_t)left_segs);
+    header.right_segments_offset = offset;
+    offset = align_offset(offset + sizeof(struct BoundarySegment) * (uint64_t)right_segs);
+    header.start_segment_offset = offset;
+    offset = align_offset(offset + sizeof(struct BoundarySegment));
+    header.cumulative_length_offset = offset;
+    offset = align_offset(offset + sizeof(float) * (uint64_t)header.left_count);
+    header.nodes_offset = offset;
+    offset = align_offset(offset + sizeof(TrackBinaryNode) * (uint64_t)node_count);
+    header.leaf_segments_offset = offset;
+    offset = align_offset(offset + sizeof(struct BoundarySegment) * (uint64_t)leaf_segment_count);
+    header.file_size = offset;
+
+    unsigned char *buffer = xalloc(header.file_size, 1);
+    memcpy(buffer, &header, sizeof(header));
+    memcpy(buffer + header.left_points_offset, track->left_boundary.points, sizeof(Point) * header.left_count);
+    memcpy(buffer + header.right_points_offset, track->right_boundary.points, sizeof(Point) * header.right_count);
+    memcpy(buffer + header.left_segments_offset, track->left_boundary_segments, sizeof(struct BoundarySegment) * left_segs);
+    memcpy(buffer + header.right_segments_offset, track->right_boundary_segments, sizeof(struct BoundarySegment) * right_segs);
+    memcpy(buffer + header.start_segment_offset, &track->start_segment, sizeof(struct BoundarySegment));
+    memcpy(buffer + header.cumulative_length_offset, track->cumulative_length, sizeof(float) * header.left_count);
+
+    int node_index = 0;
+    int pool_index = 0;
+    if (tree != NULL) {
+        flatten_node(tree, (TrackBinaryNode *)(buffer + header.nodes_offset), &node_index,
+                     (struct BoundarySegment *)(buffer + header.leaf_segments_offset), &pool_index);
+    }
+
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        fprintf(stderr, "Error: Unable to open %s for writing.\n", path);
+        free(buffer);
+        return 1;
+    }
+
+    size_t written = fwrite(buffer, 1, header.file_size, file);
+    int close_failed = fclose(file);
+    free(buffer);
+
+    if (written != header.file_size || close_failed) {
+        fprintf(stderr, "Error: Failed writing binary track %s.\n", path);
+        return 1;
+    }
+
+    return 0;
+}
+
+Track *load_track_binary(const char *path, QuadTreeNode **tree_out) {
+    // Maps the file read-only; the Track arrays point straight into the mapping, so no text is
+    // parsed. The quad tree is rebuilt from the flattened nodes: each node is allocated, its leaf
+    // segments copied out of the pool and its SegmentBlocks packed again.
+    if (tree_out) {
+        *tree_out = NULL;
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Error: Unable to open binary track %s.\n", path);
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(TrackBinaryHeader)) {
+        fprintf(stderr, "Error: Binary track %s is truncated.\n", path);
+        close(fd);
+        return NULL;
+    }
+
+    size_t file_size = (size_t)st.st_size;
+    void *data = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "Error: Unable to map binary track %s.\n", path);
+        return NULL;
+    }
+
+    const unsigned char *base = data;
+    const TrackBinaryHeader *header = data;
+    if (!validate_header(header, file_size)) {
+        fprintf(stderr, "Error: %s is not a valid binary track (version %u expected).\n", path, TRACK_BINARY_VERSION);
+        munmap(data, file_size);
+        return NULL;
+    }
+
+    Track *track = xalloc(1, sizeof(Track));
+    track->width = header->width;
+    track->total_length = header->total_length;
+    track->left_boundary.count = header->left_count;
+    track->left_boundary.points = (Point *)(base + header->left_points_offset);
+    track->right_boundary.count = header->right_count;
+    track->right_boundary.points = (Point *)(base + header->right_points_offset);
+    track->num_boundary_segments = (header->left_count - 1) + (header->right_count - 1);
+    track->left_boundary_segments = (struct BoundarySegment *)(base + header->left_segments_offset);
+    track->right_boundary_segments = (struct BoundarySegment *)(base + header->right_segments_offset);
+    track->start_segment = *(const struct BoundarySegment *)(base + header->start_segment_offset);
+    track->cumulative_length = (float *)(base + header->cumulative_length_offset);
+    track->mapped_data = data;
+    track->mapped_size = file_size;
+
+    if (tree_out && header->node_count > 0) {
+        *tree_out = rebuild_node((const TrackBinaryNode *)(base + header->nodes_offset), 0,
+                                 (const struct BoundarySegment *)(base + header->leaf_segments_offset));
+    }
+
+    return track;
+}
+
+int track_binary_params(const char *path, QuadTreeParams *params_out) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "Error: Unable to open binary track %s.\n", path);
+        return 1;
+    }
+
+    TrackBinaryHeader header;
+    size_t read = fread(&header, sizeof(header), 1, file);
+    fclose(file);
+    if (read != 1 || header.magic != TRACK_BINARY_MAGIC || header.version != TRACK_BINARY_VERSION) {
+        fprintf(stderr, "Error: %s is not a valid binary track (version %u expected).\n", path, TRACK_BINARY_VERSION);
+        return 1;
+    }
+
+    params_out->max_depth = header.quadtree_max_depth;
+    params_out->max_segments_per_node = header.quadtree_max_segments_per_node;
+    return 0;
+}
+
+static int count_nodes(const QuadTreeNode *node, int *segment_total) {
+    if (node == NULL) {
+        return 0;
+    }
+
+    int count = 1;
+    *segment_total += node->segment_count;
+    for (int i = 0; i < 4; i++) {
+        count += count_nodes(node->children[i], segment_total);
+    }
+    return count;
+}
+
+static int flatten_node(const QuadTreeNode *node, TrackBinaryNode *nodes, int *node_index,
+                        struct BoundarySegment *pool, int *pool_index) {
+    int index = (*node_index)++;
+    TrackBinaryNode *out = &nodes[index];
+
+    out->bounds = node->bounds;
+    out->first_segment = *pool_index;
+    out->segment_count = node->segment_count;
+    if (node->segment_count > 0) {
+        memcpy(&pool[*pool_index], node->segments, sizeof(struct BoundarySegment) * node->segment_count);
+        *pool_index += node->segment_count;
+    }
+
+    for (int i = 0; i < 4; i++) {
+        out->children[i] = node->children[i] ? flatten_node(node->children[i], nodes, node_index, pool, pool_index) : -1;
+    }
+
+    return index;
+}
+
+static QuadTreeNode *rebuild_node(const TrackBinaryNode *nodes, int index, const struct BoundarySegment *pool) {
+    const TrackBinaryNode *in = &nodes[index];
+    QuadTreeNode *node = xalloc(1, sizeof(QuadTreeNode));
+    node->bounds = in->bounds;
+    node->segment_count = in->segment_count;
+    node->segments = NULL;
+    node->blocks = NULL;
+    node->block_count = 0;
+
+    if (in->segment_count > 0) {
+        node->segments = xalloc(in->segment_count, sizeof(struct BoundarySegment));
+        memcpy(node->segments, &pool[in->first_segment], sizeof(struct BoundarySegment) * in->segment_count);
+        node->blocks = segment_blocks_build(node->segments, in->segment_count, &node->block_count);
+    }
+
+    for (int i = 0; i < 4; i++) {
+        node->children[i] = in->children[i] >= 0 ? rebuild_node(nodes, in->children[i], pool) : NULL;
+    }
+
+    return node;
+}
+
+static int validate_header(const TrackBinaryHeader *header, size_t file_size) {
+    if (header->magic != TRACK_BINARY_MAGIC || header->version != TRACK_BINARY_VERSION) return 0;
+    if (header->segment_size != sizeof(struct BoundarySegment) || header->node_size != sizeof(TrackBinaryNode)) return 0;
+    if (header->file_size != file_size) return 0;
+    if (header->left_count < 2 || header->right_count < 2) return 0;
+    if (header->node_count < 0 || header->leaf_segment_count < 0) return 0;
+    if (header->quadtree_max_depth < 0 || header->quadtree_max_depth > TRACK_BINARY_MAX_DEPTH) return 0;
+    if (header->quadtree_max_segments_per_node < 1) return 0;
+
+    uint64_t seg = sizeof(struct BoundarySegment);
+    if (!section_fits(header->left_points_offset, header->left_count, sizeof(Point), file_size)) return 0;
+    if (!section_fits(header->right_points_offset, header->right_count, sizeof(Point), file_size)) return 0;
+    if (!section_fits(header->left_segments_offset, header->left_count - 1, seg, file_size)) return 0;
+    if (!section_fits(header->right_segments_offset, header->right_count - 1, seg, file_size)) return 0;
+    if (!section_fits(header->start_segment_offset, 1, seg, file_size)) return 0;
+    if (!section_fits(header->cumulative_length_offset, header->left_count, sizeof(float), file_size)) return 0;
+    if (!section_fits(header->nodes_offset, header->node_count, sizeof(TrackBinaryNode), file_size)) return 0;
+    if (!section_fits(header->leaf_segments_offset, header->leaf_segment_count, seg, file_size)) return 0;
+
+    // Leaf ranges must stay inside the pool
+    const TrackBinaryNode *nodes = (const TrackBinaryNode *)((const unsigned char *)header + header->nodes_offset);
+    for (int i = 0; i < header->node_count; i++) {
+        if (nodes[i].segment_count < 0 || nodes[i].first_segment < 0) return 0;
+        if ((int64_t)nodes[i].first_segment + nodes[i].segment_count > header->leaf_segment_count) return 0;
+    }
+
+    // The nodes must form the pre-order tree flatten_node writes: every node but the root is
+    // the child of exactly one lane, so rebuild_node allocates each node once
+    if (header->node_count == 0) return 1;
+    int next = 1;
+    if (!validate_subtree(nodes, header->node_count, 0, 0, header->quadtree_max_depth, &next)) return 0;
+    return next == header->node_count;
+}
+
+static int validate_subtree(const TrackBinaryNode *nodes, int node_count, int index, int depth, int max_depth, int *next) {
+    // Each child must be the next unvisited index, i.e. follow the previous sibling's subtree
+    for (int c = 0; c < 4; c++) {
+        int child = nodes[index].children[c];
+        if (child == -1) continue;
+        if (child != *next || child >= node_count || depth >= max_depth) return 0;
+        (*next)++;
+        if (!validate_subtree(nodes, node_count, child, depth + 1, max_depth, next)) return 0;
+    }
+    return 1;
+}
+
+static uint64_t align_offset(uint64_t offset) {
+    return (offset + 7u) & ~(uint64_t)7u;
+}
+
+static int section_fits(uint64_t offset, uint64_t count, uint64_t size, uint64_t file_size) {
+    return offset % 8 == 0 && offset <= file_size && count <= (file_size - offset) / size;
+}
@@ -3,6 +3,8 @@
 #include "car.h"
 #include "car_internals.h"
 #include "quad_tree.h"
+#include "det_math.h"
+#include "sim_stats.h"
 #include <math.h>
 #include <stdlib.h>
 
@@ -13,8 +15,8 @@ static inline int corner_is_on_wrong_side(Point corner, const struct BoundarySeg
 
 void get_corners(Car* car, Point* corners) {
     // Returns the corners in the order of Front Right (FR), Back Right (BR), Back Left (BL), Front Left (FL)
-    const float c = cosf(car->heading);
-    const float s = sinf(car->heading);
+    const float c = sim_cosf(car->heading);
+    const float s = sim_sinf(car->heading);
 
     const float dx[4] = { +CAR_HALF_WIDTH, +CAR_HALF_WIDTH, -CAR_HALF_WIDTH, -CAR_HALF_WIDTH };
     const float dy[4] = { +CAR_HALF_LENGTH, -CAR_HALF_LENGTH, -CAR_HALF_LENGTH, +CAR_HALF_LENGTH };
@@ -47,6 +49,7 @@ int check_car_collision(Car* car, QuadTreeNode* node) {
     struct BoundarySegment results[MAX_COLLISION_CHECKS];
     int count = 0;
     query_region(node, &query_bounds, &results[0], &count, MAX_COLLISION_CHECKS);
+    SIM_STATS_QUERY(count, MAX_COLLISION_CHECKS);
 
     // Finds nearest segment to each car corner
     struct BoundarySegment *lFR = NULL, *lBR = NULL, *lBL = NULL, *lFL = NULL;
@@ -128,6 +131,72 @@ int check_car_collision(Car* car, QuadTreeNode* node) {
     return 1;
 }
 
+int nearest_left_segment_index(const Track* track, QuadTreeNode* node, Point position) {
+    // Index into track->left_boundary_segments of the left segment closest to position, or -1
+    // when no left segment lies within the search padding
+    float padding = 5.0f;
+    Bounds query_bounds = {
+        position.x - padding,
+        position.y - padding,
+        position.x + padding,
+        position.y + padding
+    };
+
+    struct BoundarySegment results[MAX_COLLISION_CHECKS];
+    int count = 0;
+    query_region(node, &query_bounds, results, &count, MAX_COLLISION_CHECKS);
+    SIM_STATS_QUERY(count, MAX_COLLISION_CHECKS);
+
+    float min_dist = 1e30f;
+    struct BoundarySegment* nearest = NULL;
+
+    for (int i = 0; i < count; i++) {
+        if (results[i].type != BOUNDARY_LEFT) continue;
+        float seg_dx = results[i].end.x - results[i].start.x;
+        float seg_dy = results[i].end.y - results[i].start.y;
+        float to_x = position.x - results[i].start.x;
+        float to_y = position.y - results[i].start.y;
+        float t = (to_x * seg_dx + to_y * seg_dy) / (results[i].length * results[i].length);
+        if (t < 0.0f) t = 0.0f;
+        if (t > 1.0f) t = 1.0f;
+        float cx = results[i].start.x + t * seg_dx;
+        float cy = results[i].start.y + t * seg_dy;
+        float dx = position.x - cx;
+        float dy = position.y - cy;
+        float d = dx * dx + dy * dy;
+        if (d < min_dist) {
+            min_dist = d;
+            nearest = &results[i];
+        }
+    }
+
+    if (nearest == NULL) return -1;
+
+    for (int i = 0; i < track->left_boundary.count - 1; i++) {
+        if (track->left_boundary_segments[i].start.x == nearest->start.x &&
+            track->left_boundary_segments[i].start.y == nearest->start.y) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int track_reached_finish(const Track* track, Point position) {
+    // Past the last left boundary point along the final segment, within 5 units laterally
+    Point finish_pt   = track->left_boundary.points[track->left_boundary.count - 1];
+    Point finish_prev = track->left_boundary.points[track->left_boundary.count - 2];
+    float dir_x = finish_pt.x - finish_prev.x;
+    float dir_y = finish_pt.y - finish_prev.y;
+    float to_car_x = position.x - finish_pt.x;
+    float to_car_y = position.y - finish_pt.y;
+    float len = sqrtf(dir_x * dir_x + dir_y * dir_y);
+    float norm_x = dir_x / len;
+    float norm_y = dir_y / len;
+    float forward = to_car_x * norm_x + to_car_y * norm_y;
+    float lateral = to_car_x * (-norm_y) + to_car_y * norm_x;
+    return forward >= 0.0f && fabsf(lateral) < 5.0f;
+}
+
 static inline float distance_to_point_segment_sq(float seg_dx, float seg_dy, Point corner, struct BoundarySegment* seg) {
     // Returns the perpendicular distance to point squared
 
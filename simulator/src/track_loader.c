@@ -1,87 +1,458 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 #include "types.h"
 #include "track_loader.h"
 #include "track_internals.h"
+#include "track_bezier.h"
 #include "util.h"
 
+#define READ_CHUNK_SIZE (1 << 20)
+
+typedef struct {
+    int fd;
+    char *buffer;
+    size_t capacity;
+    size_t start; // First unconsumed byte
+    size_t end;   // One past the last byte read
+    int eof;
+    int line_number;
+    char *unread_line; // Set by reader_unread, returned by the next next_nonempty_line
+    size_t unread_length;
+} LineReader;
+
+static int reader_open(LineReader *reader, const char *path);
+static void reader_close(LineReader *reader);
+static int reader_next_line(LineReader *reader, char **line, size_t *length);
+static int next_nonempty_line(LineReader *reader, char **line, size_t *length);
+static void reader_unread(LineReader *reader, char *line, size_t length);
+static const char *skip_spaces(const char *p, const char *end);
+static const char *parse_float(const char *p, const char *end, float *out);
+static const char *parse_int(const char *p, const char *end, int *out);
+static int parse_keyword_int(LineReader *reader, const char *keyword, int *value, int required, TrackLoadError *error);
+static int parse_points(LineReader *reader, const char *block, Point *points, int count, TrackLoadError *error);
+static int set_error(TrackLoadError *error, TrackErrorCode code, int line, const char *format, ...);
 static void track_create_segments(Track *track);
 static void track_calculate_lengths(Track *track);
+static void track_free_boundaries(Track *track);
 void free_track(Track *track);
 void *xalloc(size_t num, size_t size);
 
 Track* load_track(const char *filename) {
-    Track *track = xalloc(1, sizeof(Track));
+    TrackLoadError error;
+    Track *track = load_track_ex(filename, &error);
+    if (track == NULL) {
+        fprintf(stderr, "Error: %s:%d: %s\n", filename, error.line, error.message);
+    }
+    return track;
+}
 
-    FILE *file = fopen(filename, "r");
+Track* load_track_ex(const char *filename, TrackLoadError *error) {
+    // Streams the file in large chunks and validates every block count against the lines
+    // actually present. Returns NULL and fills error (when non-NULL) on any failure.
+    // When the LEFT_BOUNDARY / RIGHT_BOUNDARY blocks are omitted, the boundaries are
+    // tessellated from the cubic SEGMENT blocks instead.
+    TrackLoadError local_error;
+    if (error == NULL) {
+        error = &local_error;
+    }
+    set_error(error, TRACK_OK, 0, "ok");
 
-    char line[64];
-    float track_width;
+    LineReader reader;
+    if (reader_open(&reader, filename) != 0) {
+        set_error(error, TRACK_ERR_OPEN, 0, "unable to open track file");
+        return NULL;
+    }
 
-    fgets(line, sizeof(line), file); // Read track width
-    sscanf(line, "WIDTH %f", &track_width);
+    Track *track = xalloc(1, sizeof(Track));
+    char *line;
+    size_t length;
 
-    track->width = track_width;
+    // WIDTH <float>
+    if (!next_nonempty_line(&reader, &line, &length) || length < 5 || strncmp(line, "WIDTH", 5) != 0) {
+        set_error(error, TRACK_ERR_SYNTAX, reader.line_number, "expected 'WIDTH <float>'");
+        goto fail;
+    }
+    const char *cursor = parse_float(skip_spaces(line + 5, line + length), line + length, &track->width);
+    if (cursor == NULL || skip_spaces(cursor, line + length) != line + length || track->width <= 0.0f) {
+        set_error(error, TRACK_ERR_SYNTAX, reader.line_number, "invalid track width");
+        goto fail;
+    }
 
+    // SEGMENTS <int>, then one SEGMENT / CONTROL_POINTS block per segment
     int segments;
-    fgets(line, sizeof(line), file); // Read number of segments
-    sscanf(line, "SEGMENTS %d", &segments);
+    if (!parse_keyword_int(&reader, "SEGMENTS", &segments, 1, error)) goto fail;
+    if (segments < 0) {
+        set_error(error, TRACK_ERR_COUNT, reader.line_number, "negative segment count %d", segments);
+        goto fail;
+    }
 
-    fgets(line, sizeof(line), file); // Read Empty line
+    track->bezier_segments = xalloc(segments > 0 ? segments : 1, sizeof(BezierSegment));
+    int all_cubic = 1;
 
     for (int i = 0; i < segments; i++) {
-        fgets(line, sizeof(line), file); // SEGMENT
-        strncmp(line, "SEGMENT", 7);
+        int index;
+        if (!parse_keyword_int(&reader, "SEGMENT", &index, 0, error)) goto fail;
 
-        fgets(line, sizeof(line), file); // CONTROL_POINTS
         int count;
-        sscanf(line, "CONTROL_POINTS %d", &count);
+        if (!parse_keyword_int(&reader, "CONTROL_POINTS", &count, 1, error)) goto fail;
+        if (count < 0) {
+            set_error(error, TRACK_ERR_COUNT, reader.line_number, "negative control point count %d", count);
+            goto fail;
+        }
 
-        for (int j = 0; j < count; j++) {
-            fgets(line, sizeof(line), file);
-            float x, y;
-            sscanf(line, "%f %f", &x, &y);
+        Point *control_points = xalloc(count > 0 ? count : 1, sizeof(Point));
+        int parsed = parse_points(&reader, "CONTROL_POINTS", control_points, count, error);
+        if (parsed && count == 4) {
+            memcpy(track->bezier_segments[i].p, control_points, sizeof(Point) * 4);
+        } else {
+            all_cubic = 0;
         }
+        free(control_points);
+        if (!parsed) goto fail;
+    }
+    track->num_bezier_segments = all_cubic ? segments : 0;
+
+    if (!next_nonempty_line(&reader, &line, &length)) {
+        // No boundary blocks: build them from the centerline
+        if (track->num_bezier_segments == 0) {
+            set_error(error, TRACK_ERR_COUNT, reader.line_number,
+                      "boundaries omitted but no SEGMENT blocks with 4 control points to tessellate");
+            goto fail;
+        }
+        reader_close(&reader);
 
-        fgets(line, sizeof(line), file); // Read Empty line
+        TessellationParams params;
+        tessellation_default_params(&params);
+        track_tessellate(track, &params);
+        return track;
     }
+    reader_unread(&reader, line, length);
 
+    // LEFT_BOUNDARY <int> and RIGHT_BOUNDARY <int>, each followed by that many points
     int left_boundary_points, right_boundary_points;
-
-    fgets(line, sizeof(line), file); // LEFT_BOUNDARY
-    sscanf(line, "LEFT_BOUNDARY %d", &left_boundary_points);
-
+    if (!parse_keyword_int(&reader, "LEFT_BOUNDARY", &left_boundary_points, 1, error)) goto fail;
+    if (left_boundary_points < 2) {
+        set_error(error, TRACK_ERR_COUNT, reader.line_number, "LEFT_BOUNDARY needs at least 2 points, got %d", left_boundary_points);
+        goto fail;
+    }
     track->left_boundary.count = left_boundary_points;
     track->left_boundary.points = xalloc(left_boundary_points, sizeof(Point));
+    if (!parse_points(&reader, "LEFT_BOUNDARY", track->left_boundary.points, left_boundary_points, error)) goto fail;
 
-    for (int i = 0; i < left_boundary_points; i++) { // Read left boundary points
-        fgets(line, sizeof(line), file);
-        sscanf(line, "%f %f", &track->left_boundary.points[i].x, &track->left_boundary.points[i].y);
+    if (!parse_keyword_int(&reader, "RIGHT_BOUNDARY", &right_boundary_points, 1, error)) goto fail;
+    if (right_boundary_points != left_boundary_points) {
+        set_error(error, TRACK_ERR_COUNT, reader.line_number, "RIGHT_BOUNDARY has %d points but LEFT_BOUNDARY has %d",
+                  right_boundary_points, left_boundary_points);
+        goto fail;
     }
+    track->right_boundary.count = right_boundary_points;
+    track->right_boundary.points = xalloc(right_boundary_points, sizeof(Point));
+    if (!parse_points(&reader, "RIGHT_BOUNDARY", track->right_boundary.points, right_boundary_points, error)) goto fail;
 
-    fgets(line, sizeof(line), file); // Read Empty line
+    if (next_nonempty_line(&reader, &line, &length)) {
+        set_error(error, TRACK_ERR_COUNT, reader.line_number, "unexpected content after RIGHT_BOUNDARY block");
+        goto fail;
+    }
+    if (reader.fd < 0) {
+        set_error(error, TRACK_ERR_OPEN, reader.line_number, "read error");
+        goto fail;
+    }
 
+    reader_close(&reader);
 
-    fgets(line, sizeof(line), file); // RIGHT_BOUNDARY
-    sscanf(line, "RIGHT_BOUNDARY %d", &right_boundary_points);
+    track_create_segments(track);
+    track_calculate_lengths(track);
 
-    track->right_boundary.count = right_boundary_points;
-    track->right_boundary.points = xalloc(right_boundary_points, sizeof(Point));
+    return track;
+
+fail:
+    reader_close(&reader);
+    free_track(track);
+    return NULL;
+}
+
+static int reader_open(LineReader *reader, const char *path) {
+    memset(reader, 0, sizeof(*reader));
+    reader->fd = open(path, O_RDONLY);
+    if (reader->fd < 0) {
+        return 1;
+    }
+    reader->capacity = READ_CHUNK_SIZE;
+    reader->buffer = xalloc(reader->capacity, 1);
+    return 0;
+}
+
+static void reader_close(LineReader *reader) {
+    if (reader->fd >= 0) {
+        close(reader->fd);
+    }
+    free(reader->buffer);
+    reader->buffer = NULL;
+}
+
+static int reader_next_line(LineReader *reader, char **line, size_t *length) {
+    // Returns 1 with a pointer to the next line (without '\n' or '\r'), 0 at end of input.
+    // Lines may be any length: the buffer grows when a single line exceeds it.
+    for (;;) {
+        char *begin = reader->buffer + reader->start;
+        char *newline = memchr(begin, '\n', reader->end - reader->start);
+
+        if (newline != NULL || (reader->eof && reader->end > reader->start)) {
+            char *stop = newline ? newline : reader->buffer + reader->end;
+            reader->start = newline ? (size_t)(newline - reader->buffer) + 1 : reader->end;
+            if (stop > begin && stop[-1] == '\r') stop--;
+            *line = begin;
+            *length = (size_t)(stop - begin);
+            reader->line_number++;
+            return 1;
+        }
+
+        if (reader->eof) {
+            return 0;
+        }
+
+        // Move the partial line to the front and refill the rest of the buffer
+        size_t pending = reader->end - reader->start;
+        memmove(reader->buffer, reader->buffer + reader->start, pending);
+        reader->start = 0;
+        reader->end = pending;
+        if (reader->end == reader->capacity) {
+            reader->capacity *= 2;
+            char *grown = realloc(reader->buffer, reader->capacity);
+            if (grown == NULL) {
+                fprintf(stderr, "Memory allocation failed\n");
+                exit(EXIT_FAILURE);
+            }
+            reader->buffer = grown;
+        }
+
+        ssize_t got = read(reader->fd, reader->buffer + reader->end, reader->capacity - reader->end);
+        if (got < 0) {
+            close(reader->fd);
+            reader->fd = -1;
+            reader->eof = 1;
+        }
+        else if (got == 0) {
+            reader->eof = 1;
+        }
+        else {
+            reader->end += (size_t)got;
+        }
+    }
+}
+
+static int next_nonempty_line(LineReader *reader, char **line, size_t *length) {
+    if (reader->unread_line != NULL) {
+        *line = reader->unread_line;
+        *length = reader->unread_length;
+        reader->unread_line = NULL;
+        return 1;
+    }
 
-    for (int i = 0; i < right_boundary_points; i++) { // Read right boundary points
-        fgets(line, sizeof(line), file);
-        sscanf(line, "%f %f", &track->right_boundary.points[i].x, &track->right_boundary.points[i].y);
+    while (reader_next_line(reader, line, length)) {
+        const char *content = skip_spaces(*line, *line + *length);
+        if (content != *line + *length) {
+            *length -= (size_t)(content - *line);
+            *line += content - *line;
+            return 1;
+        }
     }
+    return 0;
+}
 
-    fclose(file);
+static void reader_unread(LineReader *reader, char *line, size_t length) {
+    // Only valid straight after next_nonempty_line returned this line, before the buffer is refilled
+    reader->unread_line = line;
+    reader->unread_length = length;
+}
+
+static int parse_keyword_int(LineReader *reader, const char *keyword, int *value, int required, TrackLoadError *error) {
+    // Parses '<keyword> <int>'. When not required, the integer may be omitted.
+    char *line;
+    size_t length;
+    size_t keyword_length = strlen(keyword);
+
+    if (!next_nonempty_line(reader, &line, &length)) {
+        return set_error(error, TRACK_ERR_SYNTAX, reader->line_number, "unexpected end of file, expected '%s'", keyword);
+    }
+
+    const char *end = line + length;
+    if (length < keyword_length || strncmp(line, keyword, keyword_length) != 0 ||
+        (length > keyword_length && line[keyword_length] != ' ' && line[keyword_length] != '\t')) {
+        return set_error(error, TRACK_ERR_SYNTAX, reader->line_number, "expected '%s'", keyword);
+    }
+
+    const char *cursor = skip_spaces(line + keyword_length, end);
+    if (cursor == end && !required) {
+        *value = 0;
+        return 1;
+    }
+
+    cursor = parse_int(cursor, end, value);
+    if (cursor == NULL || skip_spaces(cursor, end) != end) {
+        return set_error(error, TRACK_ERR_SYNTAX, reader->line_number, "expected integer after '%s'", keyword);
+    }
+    return 1;
+}
+
+static int parse_points(LineReader *reader, const char *block, Point *points, int count, TrackLoadError *error) {
+    char *line;
+    size_t length;
+
+    for (int i = 0; i < count; i++) {
+        if (!next_nonempty_line(reader, &line, &length)) {
+            return set_error(error, TRACK_ERR_COUNT, reader->line_number, "%s: end of file after %d points", block, i);
+        }
+
+        const char *end = line + length;
+        const char *cursor = parse_float(line, end, &points[i].x);
+        if (cursor != NULL) {
+            cursor = parse_float(skip_spaces(cursor, end), end, &points[i].y);
+        }
+        if (cursor == NULL || skip_spaces(cursor, end) != end) {
+            if (line[0] >= 'A' && line[0] <= 'Z') {
+                return set_error(error, TRACK_ERR_COUNT, reader->line_number, "%s: found '%.*s' after %d points",
+                                 block, (int)(length < 32 ? length : 32), line, i);
+            }
+            return set_error(error, TRACK_ERR_SYNTAX, reader->line_number, "%s: expected '<x> <y>'", block);
+        }
+    }
+    return 1;
+}
+
+static const char *skip_spaces(const char *p, const char *end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+    return p;
+}
 
+static const char *parse_int(const char *p, const char *end, int *out) {
+    int negative = 0;
+    if (p < end && (*p == '-' || *p == '+')) negative = (*p++ == '-');
+    if (p == end || *p < '0' || *p > '9') return NULL;
+
+    long value = 0;
+    while (p < end && *p >= '0' && *p <= '9') {
+        value = value * 10 + (*p++ - '0');
+        if (value > 2147483647L) return NULL;
+    }
+    *out = (int)(negative ? -value : value);
+    return p;
+}
+
+static const char *parse_float(const char *p, const char *end, float *out) {
+    // Locale-independent decimal parser: [sign] digits [. digits] [e [sign] digits].
+    // Keeps the first 19 significant digits exactly, then scales once by a power of ten.
+    static const double powers[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    int negative = 0;
+    if (p < end && (*p == '-' || *p == '+')) negative = (*p++ == '-');
+
+    unsigned long long mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    int seen_digit = 0;
+
+    while (p < end && *p >= '0' && *p <= '9') {
+        if (digits < 19) {
+            mantissa = mantissa * 10 + (unsigned)(*p - '0');
+            if (mantissa) digits++;
+        } else {
+            exponent++;
+        }
+        seen_digit = 1;
+        p++;
+    }
+
+    if (p < end && *p == '.') {
+        p++;
+        while (p < end && *p >= '0' && *p <= '9') {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (unsigned)(*p - '0');
+                if (mantissa) digits++;
+                exponent--;
+            }
+            seen_digit = 1;
+            p++;
+        }
+    }
+
+    if (!seen_digit) return NULL;
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        int exp_value;
+        const char *after = parse_int(p + 1, end, &exp_value);
+        if (after == NULL) return NULL;
+        // Any exponent this large already gives 0 or inf; clamping keeps the sum from overflowing
+        if (exp_value > 1000) exp_value = 1000;
+        if (exp_value < -1000) exp_value = -1000;
+        exponent += exp_value;
+        p = after;
+    }
+
+    // 19 digits times 10^-70 rounds to 0 as a float and a nonzero mantissa times 10^70 to inf,
+    // so scaling no further gives the same result without a long loop
+    if (exponent > 70) exponent = 70;
+    if (exponent < -70) exponent = -70;
+
+    double value = (double)mantissa;
+    if (exponent < 0) {
+        while (exponent < -22) { value /= 1e22; exponent += 22; }
+        value /= powers[-exponent];
+    } else {
+        while (exponent > 22) { value *= 1e22; exponent -= 22; }
+        value *= powers[exponent];
+    }
+
+    *out = (float)(negative ? -value : value);
+    return p;
+}
+
+static int set_error(TrackLoadError *error, TrackErrorCode code, int line, const char *format, ...) {
+    // Always returns 0 so parse helpers can 'return set_error(...)' on failure
+    error->code = code;
+    error->line = line;
+    va_list args;
+    va_start(args, format);
+    vsnprintf(error->message, sizeof(error->message), format, args);
+    va_end(args);
+    return 0;
+}
+
+void track_tessellate(Track *track, const TessellationParams *params) {
+    // Replaces the boundaries and everything derived from them with an adaptive
+    // tessellation of the track's Bezier centerline
+    track_free_boundaries(track);
+    tessellate_boundaries(track->bezier_segments, track->num_bezier_segments, track->width, params,
+                          &track->left_boundary, &track->right_boundary);
     track_create_segments(track);
     track_calculate_lengths(track);
+}
 
-    return track;
+static void track_free_boundaries(Track *track) {
+    free(track->left_boundary.points);
+    free(track->right_boundary.points);
+    free(track->left_boundary_segments);
+    free(track->right_boundary_segments);
+    free(track->cumulative_length);
+    track->left_boundary.points = NULL;
+    track->right_boundary.points = NULL;
+    track->left_boundary_segments = NULL;
+    track->right_boundary_segments = NULL;
+    track->cumulative_length = NULL;
+    track->left_boundary.count = 0;
+    track->right_boundary.count = 0;
 }
 
 static void track_create_segments(Track *track) {
@@ -203,12 +574,14 @@ static void track_calculate_lengths(Track *track) {
 }
 
 void free_track(Track *track) {
-    if (track) {
-        free(track->left_boundary.points);
-        free(track->right_boundary.points);
-        free(track->left_boundary_segments);
-        free(track->right_boundary_segments);
-        free(track->cumulative_length);
+    if (track && track->mapped_data) {
+        // Arrays live inside the mapped binary track file
+        munmap(track->mapped_data, track->mapped_size);
+        free(track);
+    }
+    else if (track) {
+        track_free_boundaries(track);
+        free(track->bezier_segments);
         free(track);
     }
 }
\ No newline at end of file
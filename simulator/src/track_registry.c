@@ -0,0 +1,168 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "track_registry.h"
+#include "track_loader.h"
+#include "track_binary.h"
+#include "quad_tree.h"
+#include "util.h"
+
+static TrackEntry *entries = NULL;
+static int entry_count = 0;
+static int entry_capacity = 0;
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static SharedTrack *find_shared(const char *path);
+static SharedTrack *load_shared(const char *path);
+static void release_locked(SharedTrack *shared);
+static uint64_t track_fingerprint(const Track *track);
+
+int track_registry_add(const char *path, Point start_point, float start_heading) {
+    // Returns the new track id, or -1 if the track fails to load. A path that is already
+    // registered is not loaded again; the new entry shares its Track and quad tree.
+    pthread_mutex_lock(&registry_lock);
+
+    SharedTrack *shared = find_shared(path);
+    if (shared == NULL) {
+        shared = load_shared(path);
+        if (shared == NULL) {
+            pthread_mutex_unlock(&registry_lock);
+            return -1;
+        }
+    }
+    shared->ref_count++; // Reference held by the registry entry
+
+    if (entry_count == entry_capacity) {
+        int capacity = entry_capacity ? entry_capacity * 2 : 8;
+        TrackEntry *grown = xalloc(capacity, sizeof(TrackEntry));
+        if (entry_count > 0) {
+            memcpy(grown, entries, sizeof(TrackEntry) * entry_count);
+        }
+        free(entries);
+        entries = grown;
+        entry_capacity = capacity;
+    }
+
+    int track_id = entry_count++;
+    entries[track_id].shared = shared;
+    entries[track_id].start_point = start_point;
+    entries[track_id].start_heading = start_heading;
+
+    pthread_mutex_unlock(&registry_lock);
+    return track_id;
+}
+
+int track_registry_remove(int track_id) {
+    // Drops the registry's reference; envs still on the track keep it alive until they release it
+    pthread_mutex_lock(&registry_lock);
+    if (track_id < 0 || track_id >= entry_count || entries[track_id].shared == NULL) {
+        pthread_mutex_unlock(&registry_lock);
+        return 1;
+    }
+
+    release_locked(entries[track_id].shared);
+    entries[track_id].shared = NULL;
+
+    pthread_mutex_unlock(&registry_lock);
+    return 0;
+}
+
+int track_registry_acquire(int track_id, TrackEntry *entry_out) {
+    // Copies the entry and takes a reference on its shared data. Returns 1 for an unknown id.
+    pthread_mutex_lock(&registry_lock);
+    if (track_id < 0 || track_id >= entry_count || entries[track_id].shared == NULL) {
+        pthread_mutex_unlock(&registry_lock);
+        return 1;
+    }
+
+    *entry_out = entries[track_id];
+    entry_out->shared->ref_count++;
+
+    pthread_mutex_unlock(&registry_lock);
+    return 0;
+}
+
+void track_registry_release(SharedTrack *shared) {
+    if (shared == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&registry_lock);
+    release_locked(shared);
+    pthread_mutex_unlock(&registry_lock);
+}
+
+int track_registry_count(void) {
+    pthread_mutex_lock(&registry_lock);
+    int count = 0;
+    for (int i = 0; i < entry_count; i++) {
+        if (entries[i].shared) count++;
+    }
+    pthread_mutex_unlock(&registry_lock);
+    return count;
+}
+
+static SharedTrack *find_shared(const char *path) {
+    for (int i = 0; i < entry_count; i++) {
+        if (entries[i].shared && strcmp(entries[i].shared->path, path) == 0) {
+            return entries[i].shared;
+        }
+    }
+    return NULL;
+}
+
+static SharedTrack *load_shared(const char *path) {
+    Track *track;
+    QuadTreeNode *tree = NULL;
+
+    if (track_is_binary(path)) {
+        // Precompiled by trackc: derived data and quad tree come from the file
+        track = load_track_binary(path, &tree);
+    }
+    else {
+        track = load_track(path);
+        if (track) {
+            tree = build_track_quadtree(track);
+        }
+    }
+
+    if (track == NULL) {
+        return NULL;
+    }
+
+    SharedTrack *shared = xalloc(1, sizeof(SharedTrack));
+    shared->path = xalloc(strlen(path) + 1, 1);
+    memcpy(shared->path, path, strlen(path) + 1);
+    shared->track = track;
+    shared->tree = tree;
+    shared->fingerprint = track_fingerprint(track);
+    shared->ref_count = 0;
+    return shared;
+}
+
+static uint64_t track_fingerprint(const Track *track) {
+    // FNV-1a over the point counts and the raw boundary points, the data every step reads
+    const Boundary *boundaries[2] = {&track->left_boundary, &track->right_boundary};
+    uint64_t hash = 14695981039346656037ull;
+    for (int b = 0; b < 2; b++) {
+        int32_t count = boundaries[b]->count;
+        const unsigned char *bytes = (const unsigned char *)&count;
+        for (size_t i = 0; i < sizeof(count); i++) hash = (hash ^ bytes[i]) * 1099511628211ull;
+        bytes = (const unsigned char *)boundaries[b]->points;
+        for (size_t i = 0; i < sizeof(Point) * (size_t)count; i++) hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+static void release_locked(SharedTrack *shared) {
+    if (--shared->ref_count > 0) {
+        return;
+    }
+    free_quadtree(shared->tree);
+    free_track(shared->track);
+    free(shared->path);
+    free(shared);
+}
@@ -0,0 +1,121 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <time.h>
+#include "track_loader.h"
+#include "track_internals.h"
+#include "track_binary.h"
+#include "track_bezier.h"
+#include <string.h>
+#include "quad_tree.h"
+#include "quad_tree_tune.h"
+
+// Compiles a text track into the binary format read by load_track_binary
+// Usage: ./trackc [--tessellate] [--tune] tracks/track_001.txt tracks/track_001.trk
+// --tessellate replaces the pre-sampled boundaries with an adaptive tessellation of the Bezier centerline
+// --tune times the sim's ray casts and region queries over a grid of quad tree parameters and stores
+// the tree built with the fastest (the chosen parameters are recorded in the header)
+
+static double now_us(void);
+
+int main(int argc, char **argv) {
+    int tessellate = 0;
+    int tune = 0;
+    int arg = 1;
+    for (; arg < argc - 2; arg++) {
+        if (strcmp(argv[arg], "--tessellate") == 0) {
+            tessellate = 1;
+        } else if (strcmp(argv[arg], "--tune") == 0) {
+            tune = 1;
+        } else {
+            break;
+        }
+    }
+    if (argc < 3 || arg != argc - 2) {
+        fprintf(stderr, "Usage: %s [--tessellate] [--tune] <input.txt> <output.trk>\n", argv[0]);
+        return 1;
+    }
+    const char *input = argv[argc - 2];
+    const char *output = argv[argc - 1];
+
+    double t0 = now_us();
+    Track *track = load_track(input);
+    if (track == NULL) {
+        fprintf(stderr, "Failed to load track: %s\n", input);
+        return 1;
+    }
+
+    if (tessellate) {
+        if (track->num_bezier_segments == 0) {
+            fprintf(stderr, "%s has no cubic SEGMENT blocks to tessellate\n", input);
+            free_track(track);
+            return 1;
+        }
+        int sampled_segments = track->num_boundary_segments;
+        TessellationParams params;
+        tessellation_default_params(&params);
+        track_tessellate(track, &params);
+        printf("Tessellated %d Bezier segments: %d -> %d boundary segments\n",
+               track->num_bezier_segments, sampled_segments, track->num_boundary_segments);
+    }
+
+    QuadTreeParams params;
+    quadtree_default_params(&params);
+    QuadTreeNode *tree = build_track_quadtree_ex(track, &params);
+    double text_us = now_us() - t0;
+
+    if (tune) {
+        QuadTreeTuneReport report;
+        double tune_start = now_us();
+        free_quadtree(tree);
+        tree = build_track_quadtree_tuned(track, &params, &report);
+        printf("Tuned quad tree over %d candidates in %.0f ms\n", report.candidates, (now_us() - tune_start) / 1e3);
+        printf("  Default (depth %d, %d per leaf): %.0f ns per pose\n",
+               MAX_DEPTH, MAX_SEGMENTS_PER_NODE, report.default_ns);
+        printf("  Chosen  (depth %d, %d per leaf): %.0f ns per pose, %.2fx\n",
+               params.max_depth, params.max_segments_per_node, report.best_ns, report.default_ns / report.best_ns);
+    }
+
+    if (save_track_binary(track, tree, &params, output) != 0) {
+        free_quadtree(tree);
+        free_track(track);
+        return 1;
+    }
+
+    printf("Compiled %s -> %s\n", input, output);
+    printf("  Boundary segments: %d\n", track->num_boundary_segments);
+    QuadTreeStats stats;
+    quadtree_stats(tree, track->num_boundary_segments + 1, &stats);
+    printf("  Quad tree: %d nodes, %d leaves, %.1f segments per leaf (max %d), %d duplicates\n",
+           stats.nodes, stats.leaves, stats.mean_leaf_segments, stats.max_leaf_segments, stats.duplicates);
+    printf("  Text load + quad tree build: %.1f us\n", text_us);
+
+    free_quadtree(tree);
+    free_track(track);
+
+    // Round trip so a broken output is caught at compile time rather than at sim_init
+    QuadTreeNode *loaded_tree = NULL;
+    t0 = now_us();
+    Track *loaded = load_track_binary(output, &loaded_tree);
+    double binary_us = now_us() - t0;
+    if (loaded == NULL) {
+        fprintf(stderr, "Failed to reload compiled track: %s\n", output);
+        return 1;
+    }
+    printf("  Binary load: %.1f us\n", binary_us);
+
+    QuadTreeParams stored;
+    if (track_binary_params(output, &stored) == 0) {
+        printf("  Stored quad tree params: depth %d, %d segments per leaf\n", stored.max_depth, stored.max_segments_per_node);
+    }
+
+    free_quadtree(loaded_tree);
+    free_track(loaded);
+    return 0;
+}
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
@@ -0,0 +1,304 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sim_lib.h"
+#include "types.h"
+#include "nn.h"
+#include "optim.h"
+#include "train_common.h"
+#include "philox.h"
+#include "util.h"
+
+// Evolution strategies trainer (Salimans et al. 2017): every generation drives 2 * pairs
+// antithetic perturbations theta +- sigma * eps of the policy weights for one episode each, all
+// in parallel on a SimBatch, and moves theta along the rank-weighted sum of the eps.
+// eps for pair p is philox noise keyed by (seed, generation, p), so it is never stored or sent:
+// the workers rebuild it from the seed, and the update needs only one fitness scalar per member.
+// The policy is deterministic (actions are the network outputs); --out holds the best policy
+// seen, in the weights.bin layout the visualizer and evaluate load.
+// Usage: ./train_es [--track path] [--start x y heading] [--pairs n] [--sigma s] [--lr r]
+//                   [--generations n] [--seed n] [--threads n] [--weights init.bin] [--out path] [--until-success]
+
+#define NUM_PARAMS ((int)(sizeof(Network) / sizeof(float)))
+
+#define DEFAULT_PAIRS       512
+#define DEFAULT_SIGMA       0.05f
+#define DEFAULT_LR          0.02f
+#define DEFAULT_GENERATIONS 200
+#define WEIGHT_DECAY        0.005f // Keeps the tanh units out of saturation, where perturbations stop mattering
+
+typedef struct {
+    int num_pairs;
+    int num_members; // 2 * num_pairs perturbed, then theta itself (reported, not used in the update)
+    uint64_t seed;
+    uint32_t generation;
+    float sigma;
+    const Network* theta;
+
+    Network* members;
+    SimEnv** envs;
+    float* states;   // [num_members][NUM_STATE]
+    float* fitness;  // Episode return
+    int* success;
+    int* steps;
+    int* done;
+    int* active;     // Members still driving
+    int num_active;
+} Population;
+
+static void build_members(void* ctx, int begin, int end);
+static void drive_members(void* ctx, int begin, int end);
+static void centered_ranks(const float* fitness, int n, float* ranks);
+
+int main(int argc, char** argv) {
+    const char* track_path = "tracks/track_001.txt";
+    Point start_point = {.x = 12.5f, .y = 16.1f};
+    float start_heading = 0.0f;
+    int num_pairs = DEFAULT_PAIRS;
+    float sigma = DEFAULT_SIGMA;
+    float lr = DEFAULT_LR;
+    int generations = DEFAULT_GENERATIONS;
+    uint64_t seed = 16;
+    int threads = 0;
+    const char* init_path = NULL;
+    const char* out_path = "weights_es.bin";
+    int until_success = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--track") == 0 && i + 1 < argc) {
+            track_path = argv[++i];
+        } else if (strcmp(argv[i], "--start") == 0 && i + 3 < argc) {
+            start_point.x = strtof(argv[++i], NULL);
+            start_point.y = strtof(argv[++i], NULL);
+            start_heading = strtof(argv[++i], NULL);
+        } else if (strcmp(argv[i], "--pairs") == 0 && i + 1 < argc) {
+            num_pairs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--sigma") == 0 && i + 1 < argc) {
+            sigma = strtof(argv[++i], NULL);
+        } else if (strcmp(argv[i], "--lr") == 0 && i + 1 < argc) {
+            lr = strtof(argv[++i], NULL);
+        } else if (strcmp(argv[i], "--generations") == 0 && i + 1 < argc) {
+            generations = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--weights") == 0 && i + 1 < argc) {
+            init_path = argv[++i];
+        } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            out_path = argv[++i];
+        } else if (strcmp(argv[i], "--until-success") == 0) {
+            until_success = 1;
+        } else {
+            fprintf(stderr, "Usage: %s [--track path] [--start x y heading] [--pairs n] [--sigma s] [--lr r] [--generations n] "
+                            "[--seed n] [--threads n] [--weights path] [--out path] [--until-success]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (num_pairs < 1) {
+        fprintf(stderr, "--pairs must be at least 1\n");
+        return 1;
+    }
+
+    Network theta;
+    if (init_path) {
+        if (nn_load(&theta, init_path) != 0) {
+            fprintf(stderr, "Failed to load weights from %s\n", init_path);
+            return 1;
+        }
+    } else {
+        nn_init_random(&theta, seed);
+    }
+
+    int track_id = sim_register_track(track_path, start_point.x, start_point.y, start_heading);
+    if (track_id < 0) {
+        fprintf(stderr, "Failed to load track %s\n", track_path);
+        return 1;
+    }
+
+    Population pop = {.num_pairs = num_pairs, .num_members = 2 * num_pairs + 1, .seed = seed, .sigma = sigma, .theta = &theta};
+    pop.members = xalloc(pop.num_members, sizeof(Network));
+    pop.envs = xalloc(pop.num_members, sizeof(SimEnv*));
+    pop.states = xalloc((size_t)pop.num_members * NUM_STATE, sizeof(float));
+    pop.fitness = xalloc(pop.num_members, sizeof(float));
+    pop.success = xalloc(pop.num_members, sizeof(int));
+    pop.steps = xalloc(pop.num_members, sizeof(int));
+    pop.done = xalloc(pop.num_members, sizeof(int));
+    pop.active = xalloc(pop.num_members, sizeof(int));
+    for (int i = 0; i < pop.num_members; i++) {
+        pop.envs[i] = sim_env_create(track_id);
+    }
+    SimBatch* batch = sim_batch_create(threads);
+
+    float* ranks = xalloc(2 * num_pairs, sizeof(float));
+    float* grad = xalloc(NUM_PARAMS, sizeof(float));
+    float* eps = xalloc(NUM_PARAMS, sizeof(float));
+    OptimConfig config = optim_default_config(OPTIM_ADAM, lr);
+    config.weight_decay = WEIGHT_DECAY;
+    Optimizer* optimizer = optim_create(&config, NUM_PARAMS);
+
+    printf("ES: %d policies per generation (%d antithetic pairs + the mean), %d parameters, sigma %.3f, lr %.3f\n",
+           pop.num_members, num_pairs, NUM_PARAMS, sigma, lr);
+
+    double start_time = now_seconds();
+    float best_fitness = -INFINITY;
+    int first_success_generation = -1;
+
+    for (int generation = 0; generation < generations; generation++) {
+        double generation_start = now_seconds();
+        pop.generation = (uint32_t)generation;
+        sim_batch_for(batch, num_pairs + 1, build_members, &pop);
+
+        // Roll out every member until it crashes, finishes or hits the step cap
+        for (int i = 0; i < pop.num_members; i++) {
+            sim_env_reset(pop.envs[i], -1, &pop.states[i * NUM_STATE]);
+            pop.fitness[i] = 0.0f;
+            pop.success[i] = pop.steps[i] = pop.done[i] = 0;
+            pop.active[i] = i;
+        }
+        pop.num_active = pop.num_members;
+        long long total_steps = 0;
+        while (pop.num_active > 0) {
+            sim_batch_for(batch, pop.num_active, drive_members, &pop);
+            total_steps += pop.num_active;
+            int kept = 0;
+            for (int a = 0; a < pop.num_active; a++) {
+                if (!pop.done[pop.active[a]]) pop.active[kept++] = pop.active[a];
+            }
+            pop.num_active = kept;
+        }
+
+        // Update from the fitness scalars alone: rebuild each pair's eps from the seed
+        centered_ranks(pop.fitness, 2 * num_pairs, ranks);
+        memset(grad, 0, NUM_PARAMS * sizeof(float));
+        for (int p = 0; p < num_pairs; p++) {
+            float weight = ranks[2 * p] - ranks[2 * p + 1];
+            if (weight == 0.0f) continue;
+            philox_normals(seed, pop.generation, 0, (uint32_t)p, eps, NUM_PARAMS);
+            for (int k = 0; k < NUM_PARAMS; k++) grad[k] += weight * eps[k];
+        }
+        // Adam minimizes, so the fitness gradient goes in negated
+        optim_step(optimizer, (float*)&theta, grad, -1.0f / (2.0f * num_pairs * sigma));
+
+        // Report, and keep the best policy driven so far
+        int best = 0, successes = 0;
+        double mean = 0.0;
+        for (int i = 0; i < pop.num_members; i++) {
+            if (pop.fitness[i] > pop.fitness[best]) best = i;
+            successes += pop.success[i];
+            mean += pop.fitness[i];
+        }
+        mean /= pop.num_members;
+        if (pop.fitness[best] > best_fitness) {
+            best_fitness = pop.fitness[best];
+            if (nn_save(&pop.members[best], out_path) != 0) {
+                fprintf(stderr, "Failed to write %s\n", out_path);
+            }
+        }
+
+        double now = now_seconds();
+        double elapsed = now - start_time;
+        int mean_member = pop.num_members - 1;
+        printf("Generation %4d | mean: %8.2f | best: %8.2f | theta: %8.2f (%4d steps) | success: %4d | %6.1fs | %.2fM steps/s\n",
+               generation + 1, mean, pop.fitness[best], pop.fitness[mean_member], pop.steps[mean_member], successes,
+               elapsed, total_steps / 1e6 / (now - generation_start));
+        fflush(stdout);
+
+        if (successes > 0 && first_success_generation < 0) {
+            first_success_generation = generation + 1;
+            printf("First track completion: generation %d, %.1fs wall clock\n", first_success_generation, elapsed);
+            if (until_success) break;
+        }
+    }
+
+    printf("Best return %.2f, weights in %s\n", best_fitness, out_path);
+
+    optim_destroy(optimizer);
+    free(eps);
+    free(grad);
+    free(ranks);
+    sim_batch_destroy(batch);
+    for (int i = 0; i < pop.num_members; i++) {
+        sim_env_destroy(pop.envs[i]);
+    }
+    free(pop.active);
+    free(pop.done);
+    free(pop.steps);
+    free(pop.success);
+    free(pop.fitness);
+    free(pop.states);
+    free(pop.envs);
+    free(pop.members);
+    sim_unregister_track(track_id);
+    return 0;
+}
+
+static void build_members(void* ctx, int begin, int end) {
+    // Item p < num_pairs: members 2p and 2p + 1 = theta +- sigma * eps_p; item num_pairs: theta
+    Population* pop = ctx;
+    const float* theta = (const float*)pop->theta;
+    float eps[NUM_PARAMS];
+    for (int p = begin; p < end; p++) {
+        if (p == pop->num_pairs) {
+            pop->members[pop->num_members - 1] = *pop->theta;
+            continue;
+        }
+        philox_normals(pop->seed, pop->generation, 0, (uint32_t)p, eps, NUM_PARAMS);
+        float* plus = (float*)&pop->members[2 * p];
+        float* minus = (float*)&pop->members[2 * p + 1];
+        for (int k = 0; k < NUM_PARAMS; k++) {
+            plus[k] = theta[k] + pop->sigma * eps[k];
+            minus[k] = theta[k] - pop->sigma * eps[k];
+        }
+    }
+}
+
+static void drive_members(void* ctx, int begin, int end) {
+    // One policy step and one sim step for each active member in [begin, end)
+    Population* pop = ctx;
+    for (int a = begin; a < end; a++) {
+        int i = pop->active[a];
+        float* state = &pop->states[i * NUM_STATE];
+        float action[NN_OUTPUT];
+        float reward;
+        int alive, success;
+        nn_forward(&pop->members[i], state, action);
+        sim_env_step(pop->envs[i], action[0], action[1], state, &reward, &alive, &success);
+        pop->fitness[i] += reward;
+        pop->steps[i]++;
+        if (success) {
+            pop->fitness[i] += SUCCESS_BONUS;
+            pop->success[i] = 1;
+        }
+        pop->done[i] = !alive || success;
+    }
+}
+
+static const float* sort_keys;
+
+static int compare_fitness(const void* a, const void* b) {
+    int i = *(const int*)a, j = *(const int*)b;
+    if (sort_keys[i] != sort_keys[j]) return sort_keys[i] < sort_keys[j] ? -1 : 1;
+    return i - j;
+}
+
+static void centered_ranks(const float* fitness, int n, float* ranks) {
+    // Ranks scaled to [-0.5, 0.5]: the update ignores the scale of the returns and outliers.
+    // Equal returns share their mean rank, so members that drove alike do not pull theta apart.
+    int* order = xalloc(n, sizeof(int));
+    for (int i = 0; i < n; i++) order[i] = i;
+    sort_keys = fitness;
+    qsort(order, n, sizeof(int), compare_fitness);
+    for (int r = 0; r < n;) {
+        int tie_end = r + 1;
+        while (tie_end < n && fitness[order[tie_end]] == fitness[order[r]]) tie_end++;
+        float rank = n > 1 ? 0.5f * (r + tie_end - 1) / (n - 1) - 0.5f : 0.0f;
+        for (int k = r; k < tie_end; k++) ranks[order[k]] = rank;
+        r = tie_end;
+    }
+    free(order);
+}
@@ -0,0 +1,387 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sim_lib.h"
+#include "types.h"
+#include "nn.h"
+#include "optim.h"
+#include "train_common.h"
+#include "philox.h"
+#include "util.h"
+
+// Proximal policy optimization (Schulman et al. 2017): every iteration drives num_envs envs for
+// horizon steps in parallel on a SimBatch, estimates advantages with GAE and takes several epochs
+// of shuffled minibatch steps on the clipped surrogate plus a value loss.
+// The actor is the usual Network with Gaussian exploration of width sigma around its outputs, as
+// in train.py; the critic is a ValueHead on the same hidden layers, evaluated in the same forward
+// pass. Episodes carry on across iterations, and an env that crashes or finishes is reset in place.
+// --out holds the policy of the iteration with the best mean episode return, in the weights.bin
+// layout the visualizer and evaluate load (the value head is not saved).
+// Usage: ./train_ppo [--track path] [--start x y heading] [--envs n] [--horizon n] [--epochs n]
+//                    [--minibatch n] [--sigma s] [--lr r] [--iterations n] [--seed n] [--threads n]
+//                    [--weights init.bin] [--out path] [--until-success]
+
+#define SHUFFLE_STEP 0xFFFFFFFFu // Philox step of the minibatch shuffles; rollout steps count from 0
+
+#define DEFAULT_ENVS       64
+#define DEFAULT_HORIZON    128
+#define DEFAULT_EPOCHS     4
+#define DEFAULT_MINIBATCH  512
+#define DEFAULT_SIGMA      0.3f
+#define DEFAULT_LR         3e-4f
+#define DEFAULT_ITERATIONS 300
+
+#define GAMMA         0.99f
+#define GAE_LAMBDA    0.95f
+#define CLIP_RATIO    0.2f
+#define VALUE_COEF    0.5f
+#define REWARD_SCALE  0.01f // Keeps value targets near 1 with the success bonus included
+#define MAX_GRAD_NORM 0.5f
+
+typedef struct {
+    Network policy;
+    ValueHead value;
+} ActorCritic;
+
+#define NUM_PARAMS ((int)(sizeof(ActorCritic) / sizeof(float)))
+
+typedef struct {
+    int num_envs;
+    int horizon;
+    uint64_t seed;
+    uint32_t iteration;
+    int step;
+    float sigma;
+    ActorCritic* model;
+
+    SimEnv** envs;
+    float* states;        // [num_envs][NUM_STATE], the observation each env acts on next
+    float* episode_return;
+    // Rollout buffers, row step * num_envs + env
+    float* observations;  // [rows][NUM_STATE]
+    float* actions;       // [rows][NN_OUTPUT]
+    float* log_probs;     // Up to the constant shared by every action under a fixed sigma
+    float* values;        // [rows + num_envs]: the last num_envs are the bootstrap values
+    float* rewards;       // Scaled by REWARD_SCALE
+    int* dones;
+    float* finished_return; // Unscaled return of the episode that ended at this row
+    int* finished_success;
+} Rollout;
+
+static void step_envs(void* ctx, int begin, int end);
+static void bootstrap_values(void* ctx, int begin, int end);
+static void compute_gae(const Rollout* ro, float* advantages, float* returns);
+static void shuffle(int* order, int n, uint64_t seed, uint32_t iteration, uint32_t epoch);
+
+int main(int argc, char** argv) {
+    const char* track_path = "tracks/track_001.txt";
+    Point start_point = {.x = 12.5f, .y = 16.1f};
+    float start_heading = 0.0f;
+    int num_envs = DEFAULT_ENVS;
+    int horizon = DEFAULT_HORIZON;
+    int epochs = DEFAULT_EPOCHS;
+    int minibatch = DEFAULT_MINIBATCH;
+    float sigma = DEFAULT_SIGMA;
+    float lr = DEFAULT_LR;
+    int iterations = DEFAULT_ITERATIONS;
+    uint64_t seed = 16;
+    int threads = 0;
+    const char* init_path = NULL;
+    const char* out_path = "weights_ppo.bin";
+    int until_success = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--track") == 0 && i + 1 < argc) {
+            track_path = argv[++i];
+        } else if (strcmp(argv[i], "--start") == 0 && i + 3 < argc) {
+            start_point.x = strtof(argv[++i], NULL);
+            start_point.y = strtof(argv[++i], NULL);
+            start_heading = strtof(argv[++i], NULL);
+        } else if (strcmp(argv[i], "--envs") == 0 && i + 1 < argc) {
+            num_envs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--horizon") == 0 && i + 1 < argc) {
+            horizon = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--epochs") == 0 && i + 1 < argc) {
+            epochs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--minibatch") == 0 && i + 1 < argc) {
+            minibatch = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--sigma") == 0 && i + 1 < argc) {
+            sigma = strtof(argv[++i], NULL);
+        } else if (strcmp(argv[i], "--lr") == 0 && i + 1 < argc) {
+            lr = strtof(argv[++i], NULL);
+        } else if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+            iterations = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--weights") == 0 && i + 1 < argc) {
+            init_path = argv[++i];
+        } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            out_path = argv[++i];
+        } else if (strcmp(argv[i], "--until-success") == 0) {
+            until_success = 1;
+        } else {
+            fprintf(stderr, "Usage: %s [--track path] [--start x y heading] [--envs n] [--horizon n] [--epochs n] [--minibatch n] "
+                            "[--sigma s] [--lr r] [--iterations n] [--seed n] [--threads n] [--weights path] [--out path] "
+                            "[--until-success]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (num_envs < 1 || horizon < 1 || epochs < 1 || minibatch < 1) {
+        fprintf(stderr, "--envs, --horizon, --epochs and --minibatch must be at least 1\n");
+        return 1;
+    }
+    int num_rows = num_envs * horizon;
+    if (minibatch > num_rows) minibatch = num_rows;
+
+    ActorCritic model;
+    memset(&model, 0, sizeof(model)); // The value head starts at zero
+    nn_init_random(&model.policy, seed);
+    if (init_path && nn_load(&model.policy, init_path) != 0) {
+        fprintf(stderr, "Failed to load weights from %s\n", init_path);
+        return 1;
+    }
+
+    int track_id = sim_register_track(track_path, start_point.x, start_point.y, start_heading);
+    if (track_id < 0) {
+        fprintf(stderr, "Failed to load track %s\n", track_path);
+        return 1;
+    }
+
+    Rollout ro = {.num_envs = num_envs, .horizon = horizon, .seed = seed, .sigma = sigma, .model = &model};
+    ro.envs = xalloc(num_envs, sizeof(SimEnv*));
+    ro.states = xalloc((size_t)num_envs * NUM_STATE, sizeof(float));
+    ro.episode_return = xalloc(num_envs, sizeof(float));
+    ro.observations = xalloc((size_t)num_rows * NUM_STATE, sizeof(float));
+    ro.actions = xalloc((size_t)num_rows * NN_OUTPUT, sizeof(float));
+    ro.log_probs = xalloc(num_rows, sizeof(float));
+    ro.values = xalloc((size_t)num_rows + num_envs, sizeof(float));
+    ro.rewards = xalloc(num_rows, sizeof(float));
+    ro.dones = xalloc(num_rows, sizeof(int));
+    ro.finished_return = xalloc(num_rows, sizeof(float));
+    ro.finished_success = xalloc(num_rows, sizeof(int));
+    for (int i = 0; i < num_envs; i++) {
+        ro.envs[i] = sim_env_create(track_id);
+        sim_env_reset(ro.envs[i], -1, &ro.states[i * NUM_STATE]);
+    }
+    SimBatch* batch = sim_batch_create(threads);
+
+    float* advantages = xalloc(num_rows, sizeof(float));
+    float* returns = xalloc(num_rows, sizeof(float));
+    int* order = xalloc(num_rows, sizeof(int));
+    NNBatchCache cache;
+    nn_batch_cache_init(&cache, minibatch);
+    float* dL_da3 = xalloc((size_t)minibatch * NN_OUTPUT, sizeof(float));
+    float* dL_dv = xalloc(minibatch, sizeof(float));
+    ActorCritic grads;
+    OptimConfig config = optim_default_config(OPTIM_ADAM, lr);
+    Optimizer* optimizer = optim_create(&config, NUM_PARAMS);
+    float* grad = (float*)&grads;
+
+    printf("PPO: %d envs x %d steps per iteration, %d epochs of %d-sample minibatches, %d parameters, sigma %.3f, lr %g\n",
+           num_envs, horizon, epochs, minibatch, NUM_PARAMS, sigma, lr);
+
+    double start_time = now_seconds();
+    float best_mean_return = -INFINITY;
+    int first_success_iteration = -1;
+    float inv_var = 1.0f / (sigma * sigma);
+
+    for (int iteration = 0; iteration < iterations; iteration++) {
+        double iteration_start = now_seconds();
+        ro.iteration = (uint32_t)iteration;
+
+        // Rollout: the policy forward pass and the sim step for every env, on the batch's threads
+        for (ro.step = 0; ro.step < horizon; ro.step++) {
+            sim_batch_for(batch, num_envs, step_envs, &ro);
+        }
+        sim_batch_for(batch, num_envs, bootstrap_values, &ro);
+        double rollout_seconds = now_seconds() - iteration_start;
+
+        int episodes = 0, successes = 0;
+        double return_sum = 0.0;
+        for (int r = 0; r < num_rows; r++) {
+            if (!ro.dones[r]) continue;
+            episodes++;
+            successes += ro.finished_success[r];
+            return_sum += ro.finished_return[r];
+        }
+
+        compute_gae(&ro, advantages, returns);
+        double mean = 0.0, var = 0.0;
+        for (int r = 0; r < num_rows; r++) mean += advantages[r];
+        mean /= num_rows;
+        for (int r = 0; r < num_rows; r++) var += (advantages[r] - mean) * (advantages[r] - mean);
+        float inv_std = 1.0f / (sqrtf((float)(var / num_rows)) + 1e-8f);
+        for (int r = 0; r < num_rows; r++) advantages[r] = (float)(advantages[r] - mean) * inv_std;
+
+        // Update: epochs of shuffled minibatches, re-evaluating the policy as it moves
+        long long clipped = 0, samples = 0;
+        double value_loss = 0.0;
+        for (int epoch = 0; epoch < epochs; epoch++) {
+            shuffle(order, num_rows, seed, ro.iteration, (uint32_t)epoch);
+            for (int first = 0; first + minibatch <= num_rows; first += minibatch) {
+                cache.count = 0;
+                for (int b = 0; b < minibatch; b++) {
+                    int r = order[first + b];
+                    float mu[NN_OUTPUT], value;
+                    nn_forward_value_cached(&model.policy, &model.value, &ro.observations[r * NUM_STATE], &cache, b, mu, &value);
+
+                    // Clipped surrogate -min(ratio * A, clip(ratio) * A): its gradient is zero
+                    // once the ratio has left the clip range in the direction A favours
+                    const float* action = &ro.actions[r * NN_OUTPUT];
+                    float log_prob = 0.0f;
+                    for (int k = 0; k < NN_OUTPUT; k++) log_prob -= 0.5f * (action[k] - mu[k]) * (action[k] - mu[k]) * inv_var;
+                    float ratio = expf(log_prob - ro.log_probs[r]);
+                    float advantage = advantages[r];
+                    int is_clipped = (advantage > 0.0f && ratio > 1.0f + CLIP_RATIO) || (advantage < 0.0f && ratio < 1.0f - CLIP_RATIO);
+                    float scale = is_clipped ? 0.0f : -advantage * ratio * inv_var / minibatch;
+                    for (int k = 0; k < NN_OUTPUT; k++) dL_da3[b * NN_OUTPUT + k] = scale * (action[k] - mu[k]);
+                    clipped += is_clipped;
+
+                    // Value loss VALUE_COEF * (V - R)^2 / 2
+                    float error = value - returns[r];
+                    dL_dv[b] = VALUE_COEF * error / minibatch;
+                    value_loss += 0.5 * error * error;
+                }
+                samples += minibatch;
+                nn_backward_value_batch(&model.policy, &model.value, &cache, dL_da3, dL_dv, &grads.policy, &grads.value);
+
+                // Clip the global gradient norm; the rescale is folded into the optimizer's pass
+                float norm = 0.0f;
+                for (int k = 0; k < NUM_PARAMS; k++) norm += grad[k] * grad[k];
+                norm = sqrtf(norm);
+                optim_step(optimizer, (float*)&model, grad, norm > MAX_GRAD_NORM ? MAX_GRAD_NORM / norm : 1.0f);
+            }
+        }
+
+        // Report, and keep the policy of the best iteration so far
+        float mean_return = episodes ? (float)(return_sum / episodes) : -INFINITY;
+        if (episodes && mean_return > best_mean_return) {
+            best_mean_return = mean_return;
+            if (nn_save(&model.policy, out_path) != 0) {
+                fprintf(stderr, "Failed to write %s\n", out_path);
+            }
+        }
+
+        double now = now_seconds();
+        double elapsed = now - start_time;
+        printf("Iteration %4d | episodes: %4d | mean return: %8.2f | success: %4d | clipped: %4.1f%% | value loss: %7.4f | %6.1fs | %.2fM steps/s\n",
+               iteration + 1, episodes, episodes ? mean_return : 0.0f, successes, samples ? 100.0 * clipped / samples : 0.0,
+               samples ? value_loss / samples : 0.0, elapsed, num_rows / 1e6 / rollout_seconds);
+        fflush(stdout);
+
+        if (successes > 0 && first_success_iteration < 0) {
+            first_success_iteration = iteration + 1;
+            printf("First track completion: iteration %d, %.1fs wall clock\n", first_success_iteration, elapsed);
+            if (until_success) break;
+        }
+    }
+
+    printf("Best mean return %.2f, weights in %s\n", best_mean_return, out_path);
+
+    optim_destroy(optimizer);
+    free(dL_dv);
+    free(dL_da3);
+    nn_batch_cache_free(&cache);
+    free(order);
+    free(returns);
+    free(advantages);
+    sim_batch_destroy(batch);
+    for (int i = 0; i < num_envs; i++) {
+        sim_env_destroy(ro.envs[i]);
+    }
+    free(ro.finished_success);
+    free(ro.finished_return);
+    free(ro.dones);
+    free(ro.rewards);
+    free(ro.values);
+    free(ro.log_probs);
+    free(ro.actions);
+    free(ro.observations);
+    free(ro.episode_return);
+    free(ro.states);
+    free(ro.envs);
+    sim_unregister_track(track_id);
+    return 0;
+}
+
+static void step_envs(void* ctx, int begin, int end) {
+    // Sample an action around the policy output, record the transition and step, for each env in [begin, end)
+    Rollout* ro = ctx;
+    for (int i = begin; i < end; i++) {
+        int r = ro->step * ro->num_envs + i;
+        float* state = &ro->states[i * NUM_STATE];
+        float* action = &ro->actions[r * NN_OUTPUT];
+        float mu[NN_OUTPUT], noise[NN_OUTPUT];
+        memcpy(&ro->observations[r * NUM_STATE], state, sizeof(float) * NUM_STATE);
+        nn_forward_value(&ro->model->policy, &ro->model->value, state, mu, &ro->values[r]);
+        philox_normals(ro->seed, ro->iteration, (uint32_t)ro->step, (uint32_t)i, noise, NN_OUTPUT);
+        float log_prob = 0.0f;
+        for (int k = 0; k < NN_OUTPUT; k++) {
+            action[k] = mu[k] + ro->sigma * noise[k];
+            log_prob -= 0.5f * noise[k] * noise[k];
+        }
+        ro->log_probs[r] = log_prob;
+
+        float reward;
+        int alive, success;
+        sim_env_step(ro->envs[i], action[0], action[1], state, &reward, &alive, &success);
+        if (success) reward += SUCCESS_BONUS;
+        ro->rewards[r] = reward * REWARD_SCALE;
+        ro->episode_return[i] += reward;
+        ro->dones[r] = !alive || success;
+        if (ro->dones[r]) {
+            ro->finished_return[r] = ro->episode_return[i];
+            ro->finished_success[r] = success;
+            ro->episode_return[i] = 0.0f;
+            sim_env_reset(ro->envs[i], -1, state);
+        }
+    }
+}
+
+static void bootstrap_values(void* ctx, int begin, int end) {
+    // Value of the state each env will act on next, for the last step's GAE target
+    Rollout* ro = ctx;
+    for (int i = begin; i < end; i++) {
+        float mu[NN_OUTPUT];
+        nn_forward_value(&ro->model->policy, &ro->model->value, &ro->states[i * NUM_STATE], mu,
+                         &ro->values[ro->horizon * ro->num_envs + i]);
+    }
+}
+
+static void compute_gae(const Rollout* ro, float* advantages, float* returns) {
+    // A_t = delta_t + gamma * lambda * A_t+1 with delta_t = r_t + gamma * V(s_t+1) - V(s_t),
+    // cut at every episode end; the value targets are A_t + V(s_t)
+    int n = ro->num_envs;
+    for (int i = 0; i < n; i++) {
+        float gae = 0.0f;
+        for (int t = ro->horizon - 1; t >= 0; t--) {
+            int r = t * n + i;
+            float not_done = ro->dones[r] ? 0.0f : 1.0f;
+            float delta = ro->rewards[r] + GAMMA * ro->values[r + n] * not_done - ro->values[r];
+            gae = delta + GAMMA * GAE_LAMBDA * not_done * gae;
+            advantages[r] = gae;
+            returns[r] = gae + ro->values[r];
+        }
+    }
+}
+
+static void shuffle(int* order, int n, uint64_t seed, uint32_t iteration, uint32_t epoch) {
+    // Fisher-Yates with philox draws, so the minibatches depend only on the seed
+    for (int i = 0; i < n; i++) order[i] = i;
+    for (int i = n - 1; i > 0; i--) {
+        uint32_t counter[4] = {(uint32_t)i, SHUFFLE_STEP, epoch, iteration}; // philox_normals' layout
+        uint32_t bits[4];
+        philox4x32(counter, seed, bits);
+        int j = (int)(bits[0] % (uint32_t)(i + 1));
+        int tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+}
+
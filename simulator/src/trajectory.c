@@ -0,0 +1,545 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "trajectory.h"
+#include "util.h"
+
+#define FIELD_COUNT        (8 + NUM_RAYS + 2)
+#define MAX_STEP_BYTES     (5 + FIELD_COUNT * 10) // Mask plus the longest varint of every field
+#define WRITE_QUEUE_BLOCKS 8
+
+// Fixed-point step of each field, and whether it is predicted linearly from the last two
+// steps (smooth quantities) or just from the last one
+typedef struct {
+    float scale;
+    int second_order;
+} FieldCodec;
+
+static const FieldCodec FIELD_CODECS[FIELD_COUNT] = {
+    {1.0f / 256, 1}, {1.0f / 256, 1},   // position
+    {1.0f / 1024, 1},                   // heading
+    {1.0f / 256, 1},                    // speed
+    {1.0f / 1024, 0},                   // acceleration
+    {1.0f / 1024, 0},                   // steering angle
+    {1.0f / 256, 0}, {1.0f / 256, 0},   // action
+    {1.0f / 64, 0}, {1.0f / 64, 0}, {1.0f / 64, 0}, {1.0f / 64, 0}, {1.0f / 64, 0},
+    {1.0f / 64, 0}, {1.0f / 64, 0}, {1.0f / 64, 0}, {1.0f / 64, 0}, // ray distances
+    {1.0f / 4096, 0},                   // reward
+    {1.0f, 0}                           // flags
+};
+
+// Prediction state of one block, shared by the encoder and decoder so they stay in step
+typedef struct {
+    int64_t prev[FIELD_COUNT];
+    int64_t prev2[FIELD_COUNT];
+    int history;
+} Predictor;
+
+typedef struct {
+    TrajectoryBlockHeader header;
+    uint8_t *payload;
+} PendingBlock;
+
+struct TrajectoryWriter {
+    int fd;
+
+    // Encoder, used on the appending thread
+    uint8_t *block;
+    size_t block_size;
+    uint32_t block_steps;
+    uint64_t step_count;
+    Predictor predictor;
+
+    // Written blocks and their index, owned by the I/O thread until it exits
+    uint64_t offset;
+    TrajectoryIndexEntry *index;
+    uint64_t index_count;
+    uint64_t index_capacity;
+    int failed;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    PendingBlock queue[WRITE_QUEUE_BLOCKS];
+    int queue_head;
+    int queue_count;
+    int closing;
+};
+
+struct TrajectoryReader {
+    const uint8_t *data;
+    size_t size;
+    const TrajectoryHeader *header;
+    TrajectoryIndexEntry *index;
+    uint64_t block_count;
+    uint64_t step_count;
+
+    // Last decoded block
+    int64_t cached_block;
+    uint32_t cached_count;
+    TrajectoryStep *cached_steps;
+};
+
+static void *writer_thread_main(void *arg);
+static void flush_block(TrajectoryWriter *writer);
+static int write_all(int fd, const void *data, size_t size);
+static void step_to_fields(const TrajectoryStep *step, float *fields);
+static void fields_to_step(const float *fields, TrajectoryStep *step);
+static int64_t predict(const Predictor *predictor, int field);
+static void predictor_push(Predictor *predictor, const int64_t *values);
+static size_t put_varint(uint8_t *out, uint64_t value);
+static int get_varint(const uint8_t **cursor, const uint8_t *end, uint64_t *value);
+static int decode_block(TrajectoryReader *reader, uint64_t block);
+static int scan_blocks(TrajectoryReader *reader);
+
+TrajectoryWriter *trajectory_writer_open(const char *path, const char *track_path, Point start_point, float start_heading) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Error: unable to create trajectory file %s\n", path);
+        return NULL;
+    }
+
+    TrajectoryHeader header = {0};
+    header.magic = TRAJECTORY_MAGIC;
+    header.version = TRAJECTORY_VERSION;
+    header.block_steps = TRAJECTORY_BLOCK_STEPS;
+    header.field_count = FIELD_COUNT;
+    header.start_x = start_point.x;
+    header.start_y = start_point.y;
+    header.start_heading = start_heading;
+    if (track_path) {
+        strncpy(header.track_path, track_path, sizeof(header.track_path) - 1);
+    }
+    if (write_all(fd, &header, sizeof(header)) != 0) {
+        fprintf(stderr, "Error: unable to write trajectory file %s\n", path);
+        close(fd);
+        return NULL;
+    }
+
+    TrajectoryWriter *writer = xalloc(1, sizeof(TrajectoryWriter));
+    writer->fd = fd;
+    writer->offset = sizeof(header);
+    writer->block = xalloc(TRAJECTORY_BLOCK_STEPS, MAX_STEP_BYTES);
+    pthread_mutex_init(&writer->lock, NULL);
+    pthread_cond_init(&writer->not_empty, NULL);
+    pthread_cond_init(&writer->not_full, NULL);
+
+    if (pthread_create(&writer->thread, NULL, writer_thread_main, writer) != 0) {
+        fprintf(stderr, "Error: unable to start trajectory writer thread\n");
+        pthread_cond_destroy(&writer->not_full);
+        pthread_cond_destroy(&writer->not_empty);
+        pthread_mutex_destroy(&writer->lock);
+        free(writer->block);
+        free(writer);
+        close(fd);
+        return NULL;
+    }
+    return writer;
+}
+
+void trajectory_writer_append(TrajectoryWriter *writer, const TrajectoryStep *step) {
+    float fields[FIELD_COUNT];
+    int64_t values[FIELD_COUNT];
+    uint64_t residuals[FIELD_COUNT];
+    uint32_t mask = 0;
+
+    step_to_fields(step, fields);
+    for (int f = 0; f < FIELD_COUNT; f++) {
+        values[f] = llrintf(fields[f] / FIELD_CODECS[f].scale);
+        int64_t residual = values[f] - predict(&writer->predictor, f);
+        residuals[f] = ((uint64_t)residual << 1) ^ (uint64_t)(residual >> 63); // Zigzag
+        if (residuals[f] != 0) mask |= 1u << f;
+    }
+    predictor_push(&writer->predictor, values);
+
+    uint8_t *out = writer->block + writer->block_size;
+    out += put_varint(out, mask);
+    for (int f = 0; f < FIELD_COUNT; f++) {
+        if (mask & (1u << f)) out += put_varint(out, residuals[f]);
+    }
+    writer->block_size = out - writer->block;
+    writer->block_steps++;
+    writer->step_count++;
+
+    if (writer->block_steps == TRAJECTORY_BLOCK_STEPS) {
+        flush_block(writer);
+    }
+}
+
+int trajectory_writer_close(TrajectoryWriter *writer) {
+    if (writer == NULL) {
+        return 1;
+    }
+    flush_block(writer);
+
+    pthread_mutex_lock(&writer->lock);
+    writer->closing = 1;
+    pthread_cond_signal(&writer->not_empty);
+    pthread_mutex_unlock(&writer->lock);
+    pthread_join(writer->thread, NULL);
+
+    TrajectoryFooter footer = {0};
+    footer.index_offset = writer->offset;
+    footer.block_count = writer->index_count;
+    footer.step_count = writer->step_count;
+    footer.magic = TRAJECTORY_FOOTER_MAGIC;
+
+    int failed = writer->failed;
+    if (!failed && writer->index_count > 0) {
+        failed = write_all(writer->fd, writer->index, sizeof(TrajectoryIndexEntry) * writer->index_count);
+    }
+    if (!failed) {
+        failed = write_all(writer->fd, &footer, sizeof(footer));
+    }
+    if (close(writer->fd) != 0) {
+        failed = 1;
+    }
+    if (failed) {
+        fprintf(stderr, "Error: trajectory file write failed\n");
+    }
+
+    pthread_cond_destroy(&writer->not_full);
+    pthread_cond_destroy(&writer->not_empty);
+    pthread_mutex_destroy(&writer->lock);
+    free(writer->index);
+    free(writer->block);
+    free(writer);
+    return failed;
+}
+
+TrajectoryReader *trajectory_reader_open(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Error: unable to open trajectory file %s\n", path);
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(TrajectoryHeader)) {
+        fprintf(stderr, "Error: %s is not a trajectory file\n", path);
+        close(fd);
+        return NULL;
+    }
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "Error: unable to map trajectory file %s\n", path);
+        return NULL;
+    }
+
+    TrajectoryReader *reader = xalloc(1, sizeof(TrajectoryReader));
+    reader->data = data;
+    reader->size = st.st_size;
+    reader->header = data;
+    reader->cached_block = -1;
+
+    const TrajectoryHeader *header = reader->header;
+    if (header->magic != TRAJECTORY_MAGIC || header->version != TRAJECTORY_VERSION ||
+        header->field_count != FIELD_COUNT || header->block_steps == 0) {
+        fprintf(stderr, "Error: %s is not a trajectory file of this version\n", path);
+        trajectory_reader_close(reader);
+        return NULL;
+    }
+
+    // Use the footer's index when the file was closed cleanly, otherwise rebuild it
+    const TrajectoryFooter *footer = NULL;
+    if (reader->size >= sizeof(TrajectoryHeader) + sizeof(TrajectoryFooter)) {
+        footer = (const TrajectoryFooter *)(reader->data + reader->size - sizeof(TrajectoryFooter));
+    }
+    if (footer && footer->magic == TRAJECTORY_FOOTER_MAGIC && footer->index_offset <= reader->size &&
+        footer->block_count <= (reader->size - footer->index_offset) / sizeof(TrajectoryIndexEntry)) {
+        reader->block_count = footer->block_count;
+        reader->step_count = footer->step_count;
+        reader->index = xalloc(reader->block_count + 1, sizeof(TrajectoryIndexEntry));
+        memcpy(reader->index, reader->data + footer->index_offset, sizeof(TrajectoryIndexEntry) * reader->block_count);
+    } else if (scan_blocks(reader) != 0) {
+        fprintf(stderr, "Error: %s has no readable blocks\n", path);
+        trajectory_reader_close(reader);
+        return NULL;
+    }
+
+    reader->cached_steps = xalloc(header->block_steps, sizeof(TrajectoryStep));
+    return reader;
+}
+
+uint64_t trajectory_reader_step_count(const TrajectoryReader *reader) {
+    return reader->step_count;
+}
+
+const TrajectoryHeader *trajectory_reader_header(const TrajectoryReader *reader) {
+    return reader->header;
+}
+
+int trajectory_reader_get(TrajectoryReader *reader, uint64_t step, TrajectoryStep *out) {
+    if (step >= reader->step_count) {
+        return 1;
+    }
+
+    // Last block whose first step is <= step
+    uint64_t lo = 0, hi = reader->block_count;
+    while (hi - lo > 1) {
+        uint64_t mid = (lo + hi) / 2;
+        if (reader->index[mid].first_step <= step) lo = mid;
+        else hi = mid;
+    }
+
+    if (reader->cached_block != (int64_t)lo && decode_block(reader, lo) != 0) {
+        return 1;
+    }
+    uint64_t within = step - reader->index[lo].first_step;
+    if (within >= reader->cached_count) {
+        return 1;
+    }
+    *out = reader->cached_steps[within];
+    return 0;
+}
+
+void trajectory_reader_close(TrajectoryReader *reader) {
+    if (reader == NULL) {
+        return;
+    }
+    munmap((void *)reader->data, reader->size);
+    free(reader->cached_steps);
+    free(reader->index);
+    free(reader);
+}
+
+static void *writer_thread_main(void *arg) {
+    TrajectoryWriter *writer = arg;
+
+    pthread_mutex_lock(&writer->lock);
+    while (1) {
+        while (writer->queue_count == 0 && !writer->closing) {
+            pthread_cond_wait(&writer->not_empty, &writer->lock);
+        }
+        if (writer->queue_count == 0) {
+            break; // Closing and drained
+        }
+        PendingBlock block = writer->queue[writer->queue_head];
+        pthread_mutex_unlock(&writer->lock);
+
+        if (!writer->failed) {
+            if (writer->index_count == writer->index_capacity) {
+                uint64_t capacity = writer->index_capacity ? writer->index_capacity * 2 : 64;
+                TrajectoryIndexEntry *grown = xalloc(capacity, sizeof(TrajectoryIndexEntry));
+                if (writer->index_count > 0) {
+                    memcpy(grown, writer->index, sizeof(TrajectoryIndexEntry) * writer->index_count);
+                }
+                free(writer->index);
+                writer->index = grown;
+                writer->index_capacity = capacity;
+            }
+            writer->index[writer->index_count].first_step = block.header.first_step;
+            writer->index[writer->index_count].offset = writer->offset;
+            writer->index_count++;
+
+            writer->failed = write_all(writer->fd, &block.header, sizeof(block.header)) ||
+                             write_all(writer->fd, block.payload, block.header.payload_size);
+            writer->offset += sizeof(block.header) + block.header.payload_size;
+        }
+        free(block.payload);
+
+        pthread_mutex_lock(&writer->lock);
+        writer->queue_head = (writer->queue_head + 1) % WRITE_QUEUE_BLOCKS;
+        writer->queue_count--;
+        pthread_cond_signal(&writer->not_full);
+    }
+    pthread_mutex_unlock(&writer->lock);
+    return NULL;
+}
+
+static void flush_block(TrajectoryWriter *writer) {
+    // Hands the current block to the I/O thread; waits only if WRITE_QUEUE_BLOCKS are pending
+    if (writer->block_steps == 0) {
+        return;
+    }
+
+    PendingBlock block;
+    block.header.magic = TRAJECTORY_BLOCK_MAGIC;
+    block.header.step_count = writer->block_steps;
+    block.header.first_step = writer->step_count - writer->block_steps;
+    block.header.payload_size = (uint32_t)writer->block_size;
+    block.header.flags = 0;
+    block.payload = writer->block;
+
+    pthread_mutex_lock(&writer->lock);
+    while (writer->queue_count == WRITE_QUEUE_BLOCKS) {
+        pthread_cond_wait(&writer->not_full, &writer->lock);
+    }
+    writer->queue[(writer->queue_head + writer->queue_count) % WRITE_QUEUE_BLOCKS] = block;
+    writer->queue_count++;
+    pthread_cond_signal(&writer->not_empty);
+    pthread_mutex_unlock(&writer->lock);
+
+    writer->block = xalloc(TRAJECTORY_BLOCK_STEPS, MAX_STEP_BYTES);
+    writer->block_size = 0;
+    writer->block_steps = 0;
+    memset(&writer->predictor, 0, sizeof(writer->predictor)); // Next block is a keyframe
+}
+
+static int write_all(int fd, const void *data, size_t size) {
+    const uint8_t *cursor = data;
+    while (size > 0) {
+        ssize_t written = write(fd, cursor, size);
+        if (written < 0) {
+            return 1;
+        }
+        cursor += written;
+        size -= written;
+    }
+    return 0;
+}
+
+static void step_to_fields(const TrajectoryStep *step, float *fields) {
+    fields[0] = step->position.x;
+    fields[1] = step->position.y;
+    fields[2] = step->heading;
+    fields[3] = step->speed;
+    fields[4] = step->acceleration;
+    fields[5] = step->steering_angle;
+    fields[6] = step->action[0];
+    fields[7] = step->action[1];
+    for (int i = 0; i < NUM_RAYS; i++) {
+        fields[8 + i] = step->ray_distances[i];
+    }
+    fields[8 + NUM_RAYS] = step->reward;
+    fields[9 + NUM_RAYS] = (float)step->flags;
+}
+
+static void fields_to_step(const float *fields, TrajectoryStep *step) {
+    step->position.x = fields[0];
+    step->position.y = fields[1];
+    step->heading = fields[2];
+    step->speed = fields[3];
+    step->acceleration = fields[4];
+    step->steering_angle = fields[5];
+    step->action[0] = fields[6];
+    step->action[1] = fields[7];
+    for (int i = 0; i < NUM_RAYS; i++) {
+        step->ray_distances[i] = fields[8 + i];
+    }
+    step->reward = fields[8 + NUM_RAYS];
+    step->flags = (uint32_t)fields[9 + NUM_RAYS];
+}
+
+static int64_t predict(const Predictor *predictor, int field) {
+    if (predictor->history == 0) {
+        return 0;
+    }
+    if (FIELD_CODECS[field].second_order && predictor->history >= 2) {
+        return 2 * predictor->prev[field] - predictor->prev2[field];
+    }
+    return predictor->prev[field];
+}
+
+static void predictor_push(Predictor *predictor, const int64_t *values) {
+    memcpy(predictor->prev2, predictor->prev, sizeof(predictor->prev));
+    memcpy(predictor->prev, values, sizeof(predictor->prev));
+    predictor->history++;
+}
+
+static size_t put_varint(uint8_t *out, uint64_t value) {
+    size_t n = 0;
+    while (value >= 0x80) {
+        out[n++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = (uint8_t)value;
+    return n;
+}
+
+static int get_varint(const uint8_t **cursor, const uint8_t *end, uint64_t *value) {
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (*cursor >= end) {
+            return 1;
+        }
+        uint8_t byte = *(*cursor)++;
+        result |= (uint64_t)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            *value = result;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int decode_block(TrajectoryReader *reader, uint64_t block) {
+    uint64_t offset = reader->index[block].offset;
+    if (offset > reader->size || reader->size - offset < sizeof(TrajectoryBlockHeader)) {
+        return 1;
+    }
+    const TrajectoryBlockHeader *header = (const TrajectoryBlockHeader *)(reader->data + offset);
+    const uint8_t *cursor = reader->data + offset + sizeof(TrajectoryBlockHeader);
+    if (header->magic != TRAJECTORY_BLOCK_MAGIC || header->flags != 0 ||
+        header->step_count > reader->header->block_steps ||
+        header->payload_size > reader->size - offset - sizeof(TrajectoryBlockHeader)) {
+        return 1;
+    }
+    const uint8_t *end = cursor + header->payload_size;
+
+    Predictor predictor = {0};
+    for (uint32_t s = 0; s < header->step_count; s++) {
+        uint64_t mask;
+        if (get_varint(&cursor, end, &mask) != 0) {
+            return 1;
+        }
+
+        int64_t values[FIELD_COUNT];
+        float fields[FIELD_COUNT];
+        for (int f = 0; f < FIELD_COUNT; f++) {
+            uint64_t zigzag = 0;
+            if ((mask & (1ull << f)) && get_varint(&cursor, end, &zigzag) != 0) {
+                return 1;
+            }
+            int64_t residual = (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+            values[f] = predict(&predictor, f) + residual;
+            fields[f] = (float)values[f] * FIELD_CODECS[f].scale;
+        }
+        predictor_push(&predictor, values);
+        fields_to_step(fields, &reader->cached_steps[s]);
+    }
+
+    reader->cached_block = block;
+    reader->cached_count = header->step_count;
+    return 0;
+}
+
+static int scan_blocks(TrajectoryReader *reader) {
+    // Walks the block headers of a file without a footer, stopping at the first incomplete block
+    uint64_t capacity = 64;
+    reader->index = xalloc(capacity, sizeof(TrajectoryIndexEntry));
+    reader->block_count = 0;
+    reader->step_count = 0;
+
+    uint64_t offset = sizeof(TrajectoryHeader);
+    while (reader->size - offset >= sizeof(TrajectoryBlockHeader)) {
+        const TrajectoryBlockHeader *header = (const TrajectoryBlockHeader *)(reader->data + offset);
+        if (header->magic != TRAJECTORY_BLOCK_MAGIC ||
+            header->payload_size > reader->size - offset - sizeof(TrajectoryBlockHeader)) {
+            break;
+        }
+        if (reader->block_count == capacity) {
+            TrajectoryIndexEntry *grown = xalloc(capacity * 2, sizeof(TrajectoryIndexEntry));
+            memcpy(grown, reader->index, sizeof(TrajectoryIndexEntry) * capacity);
+            free(reader->index);
+            reader->index = grown;
+            capacity *= 2;
+        }
+        reader->index[reader->block_count].first_step = reader->step_count;
+        reader->index[reader->block_count].offset = offset;
+        reader->block_count++;
+        reader->step_count += header->step_count;
+        offset += sizeof(TrajectoryBlockHeader) + header->payload_size;
+    }
+    return reader->block_count == 0;
+}